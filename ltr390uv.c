@@ -17,13 +17,76 @@
 
 /********************************************************/
 /* header includes */
+#include <string.h>
 #include "ltr390uv.h"
 
+/* Gain factor, indexed by LTR390_VAL_GAIN_RANGE_xxx */
+static const uint8_t a_gain[5] = {1,3,6,9,18};
+
+/* Integration time factor relative to 100ms, indexed by LTR390_VAL_RES_xxx */
+static const double a_int[6] = {4.,2.,1.,0.5,0.25,0.125};
+
+/* Measurement rate in us, indexed by LTR390_VAL_MEAS_RATE_xxx */
+static const uint32_t meas_rate_us[7] = {25000, 50000, 100000, 200000, 500000, 1000000, 2000000};
+
+/* Conversion time in us, indexed by LTR390_VAL_RES_xxx */
+static const uint32_t conv_time_us[6] = {400000, 200000, 100000, 50000, 25000, 12500};
+
+/* Integration time factor times 8, indexed by LTR390_VAL_RES_xxx */
+static const uint8_t int_x8[6] = {32, 16, 8, 4, 2, 1};
+
+/* Full scale counts, also the data register masks, indexed by LTR390_VAL_RES_xxx */
+const uint32_t ltr390_full_scale[LTR390_VAL_RES_13_BIT + 1] = {0xFFFFF, 0x7FFFF, 0x3FFFF, 0x1FFFF, 0xFFFF, 0x1FFF};
+
+/* Register blocks written by ltr390_configure, indexed by LTR390_CFG_BLK_xxx */
+static const uint8_t cfg_blk_reg[LTR390_CFG_BLK_COUNT] = {
+	LTR390_REG_ALS_UVS_MEAS_RATE, LTR390_REG_INT_CFG, LTR390_REG_ALS_UVS_THRES_UP_0, LTR390_REG_MAIN_CTRL
+};
+
+static const uint8_t cfg_blk_len[LTR390_CFG_BLK_COUNT] = {2, 2, 6, 1};
+
+static const uint8_t cfg_blk_offset[LTR390_CFG_BLK_COUNT] = {
+	offsetof(struct ltr390_shadow, meas), offsetof(struct ltr390_shadow, intr),
+	offsetof(struct ltr390_shadow, thres), offsetof(struct ltr390_shadow, main_ctrl)
+};
+
 static int8_t null_ptr_check( struct ltr390_dev *dev);
 
-static int8_t get_als_data(uint32_t *data,  struct ltr390_dev *dev);
+static int8_t get_channel_data(uint8_t reg_addr, uint32_t *data,  struct ltr390_dev *dev);
+
+static int8_t poll_job(uint8_t *status, uint32_t *data,  struct ltr390_dev *dev);
+
+static void bus_op_init(struct ltr390_bus_op *op, uint8_t dir, uint8_t reg_addr, uint8_t *buf, uint16_t len, const struct ltr390_dev *dev);
+
+static int8_t shadow_check(struct ltr390_dev *dev);
+
+static int8_t shadow_write(uint8_t reg_addr, uint8_t *shadow_reg, const uint8_t *reg_data, uint8_t len, struct ltr390_dev *dev);
 
-static int8_t get_uvs_data(uint32_t *data,  struct ltr390_dev *dev);
+static uint8_t block_differs(const uint8_t *a, const uint8_t *b, uint8_t len);
+
+static void shadow_load_defaults(struct ltr390_shadow *shadow);
+
+static int8_t por_recover(struct ltr390_dev *dev);
+
+#ifdef LTR390_ENABLE_STATS
+static uint32_t stats_begin(struct ltr390_dev *dev, uint8_t dir, uint8_t reg_addr, uint8_t len);
+
+static void stats_end(struct ltr390_dev *dev, uint8_t dir, uint8_t reg_addr, uint8_t len, int8_t rslt, uint32_t start_us);
+
+static void stats_error(struct ltr390_dev *dev, int8_t rslt);
+
+#define LTR390_STATS_ERROR(dev, rslt)           stats_error((dev), (rslt))
+#define LTR390_STATS_INC(dev, field)            ((dev)->stats.field++)
+#else
+#define LTR390_STATS_ERROR(dev, rslt)           ((void)0)
+#define LTR390_STATS_INC(dev, field)            ((void)0)
+#endif
+
+static int8_t settings_to_image(const struct ltr390_settings *settings, const struct ltr390_dev *dev, struct ltr390_shadow *image);
+
+static int8_t dual_switch(uint8_t mode, uint8_t gain_range, uint8_t resolution, struct ltr390_dev *dev);
+
+static int8_t dual_acquire(uint8_t mode, struct ltr390_sample *sample, struct ltr390_dev *dev);
 
 /********************************************************/
 
@@ -34,6 +97,7 @@ int8_t ltr390_init(struct ltr390_dev *dev)
 	/* chip id read try count */
 	uint8_t try_count = 5;
 	uint8_t part_id = 0;
+	uint8_t status;
 
 	/* Check for null pointer in the device structure*/
 	rslt = null_ptr_check(dev);
@@ -42,18 +106,27 @@ int8_t ltr390_init(struct ltr390_dev *dev)
 		while (try_count) {
 			/* Read the part id of sensor */
 			rslt = ltr390_get_regs(LTR390_REG_PART_ID, &part_id, 1, dev);
-			/* Check for part id validity */
-			if ((rslt == LTR390_OK) && (part_id == LTR390_PART_ID)) {
+			/* Check for part id validity, low nibble is the revision */
+			if ((rslt == LTR390_OK) &&
+				(LTR390_GET_BITS(part_id, LTR390_POS_PART_ID, LTR390_MASK_PART_ID) == LTR390_PART_ID)) {
 				dev->part_id = part_id;
+				ltr390_reset_dual(dev);
 				/* Reset the sensor */
 				rslt = ltr390_soft_reset(dev);
+				/* Consume the power-on flag, later ones are brownouts */
+				if (rslt == LTR390_OK)
+					rslt = ltr390_get_regs(LTR390_REG_MAIN_STATUS, &status, 1, dev);
 				break;
 			}
 			--try_count;
+			if (try_count)
+				LTR390_STATS_INC(dev, retries);
 		}
 		/* Chip part id check failed */
-		if (!try_count)
+		if (!try_count) {
 			rslt = LTR390_E_DEV_NOT_FOUND;
+			LTR390_STATS_ERROR(dev, rslt);
+		}
 	}
 
 	return rslt;
@@ -63,8 +136,58 @@ int8_t ltr390_init(struct ltr390_dev *dev)
 int8_t ltr390_configure(struct ltr390_dev *dev)
 {
 	int8_t rslt;
-	/* set up UV or ALS mode  */
-	rslt = ltr390_set_mode(dev->settings.mode, dev);
+	struct ltr390_shadow image;
+	struct ltr390_bus_op ops[LTR390_CFG_BLK_COUNT];
+	uint8_t blk[LTR390_CFG_BLK_COUNT];
+	uint8_t *image_reg;
+	uint8_t reg_addr;
+	uint8_t len;
+	uint8_t count = 0;
+	uint8_t i;
+
+	/* Check for null pointer in the device structure*/
+	rslt = null_ptr_check(dev);
+	if (rslt != LTR390_OK)
+		return rslt;
+
+	/* Translate the settings into a register image */
+	rslt = ltr390_prepare_image(&image, dev);
+	if (rslt != LTR390_OK)
+		return rslt;
+
+	/* Write the image as one job of contiguous bursts, sensor enabled last */
+	for (i = 0; i < LTR390_CFG_BLK_COUNT; i++) {
+		dev->cfg_rslt[i] = LTR390_OK;
+		image_reg = ltr390_cfg_block(&image, i, &reg_addr, &len);
+		if (ltr390_shadow_dirty(ltr390_cfg_block(&dev->shadow, i, NULL, NULL), image_reg, len, dev) == TRUE) {
+			bus_op_init(&ops[count], LTR390_BUS_WRITE, reg_addr, image_reg, len, dev);
+			blk[count++] = i;
+		}
+	}
+	(void)ltr390_bus_submit(ops, count, dev);
+
+	/* Shadow follows the blocks the sensor took */
+	for (i = 0; i < count; i++) {
+		dev->cfg_rslt[blk[i]] = ops[i].rslt;
+		if (ops[i].rslt == LTR390_OK)
+			memcpy(ltr390_cfg_block(&dev->shadow, blk[i], NULL, NULL), ops[i].buf, ops[i].len);
+	}
+
+	/* Report the first failing block, the shadow is only trusted if all succeeded */
+	for (i = 0; i < LTR390_CFG_BLK_COUNT; i++) {
+		if ((dev->cfg_rslt[i] != LTR390_OK) && (rslt == LTR390_OK))
+			rslt = dev->cfg_rslt[i];
+	}
+	dev->shadow.valid = (rslt == LTR390_OK) ? TRUE : FALSE;
+
+	return rslt;
+}
+
+
+int8_t ltr390_prepare_image(struct ltr390_shadow *image,  struct ltr390_dev *dev)
+{
+	if ((image == NULL) || (dev == NULL))
+		return LTR390_E_NULL_PTR;
 
 	/* default UV mode gain=18x, res=20b, rate>500ms */
 	if(dev->settings.mode==LTR390_VAL_UVS_MODE_UVS)
@@ -77,52 +200,124 @@ int8_t ltr390_configure(struct ltr390_dev *dev)
 		dev->settings.gain_range = LTR390_VAL_GAIN_RANGE_18;
 	}
 
-	/* set up measure rate */
-	rslt |= ltr390_set_rate(dev->settings.rate, dev);
+	return settings_to_image(&dev->settings, dev, image);
+}
 
-	/* set up measure resolution 13-20b */
-	rslt |= ltr390_set_resolution(dev->settings.resolution, dev);
 
-	/* set up measure gain 3x-18x */
-	rslt |= ltr390_set_gain(dev->settings.gain_range, dev);
+uint8_t *ltr390_cfg_block(struct ltr390_shadow *shadow, uint8_t blk, uint8_t *reg_addr, uint8_t *len)
+{
+	if ((shadow == NULL) || (blk >= LTR390_CFG_BLK_COUNT))
+		return NULL;
 
-	/* set up interrupt */
-	rslt |= ltr390_set_int(dev->settings.int_enabled, dev);
+	/* Register address and length are optional */
+	if (reg_addr != NULL)
+		*reg_addr = cfg_blk_reg[blk];
+	if (len != NULL)
+		*len = cfg_blk_len[blk];
 
-	/* if interrupt enabled */
-	if(dev->settings.int_enabled==TRUE)
-	{
-		/* set up interrupt source (UVS/ALS) */
-		rslt |= ltr390_set_int_src(dev->settings.int_src, dev);
+	return (uint8_t *)shadow + cfg_blk_offset[blk];
+}
+
+
+void ltr390_reset_shadow(struct ltr390_dev *dev)
+{
+	/* Registers known to be at their power-on values */
+	if (dev != NULL)
+		shadow_load_defaults(&dev->shadow);
+}
+
+
+uint8_t ltr390_shadow_dirty(const uint8_t *shadow_reg, const uint8_t *reg_data, uint8_t len, const struct ltr390_dev *dev)
+{
+	if ((shadow_reg == NULL) || (reg_data == NULL) || (dev == NULL))
+		return TRUE;
+
+	/* Skip the bus access if the sensor is known to hold these values */
+	return ((block_differs(shadow_reg, reg_data, len) == TRUE) || (dev->shadow.valid != TRUE) ||
+			(dev->write_mode != LTR390_SHADOW_WRITE_CHANGED)) ? TRUE : FALSE;
+}
 
-		/* set up interrupt persist */
-		rslt |= ltr390_set_int_pers(dev->settings.int_pers, dev);
 
-		/* set up threshold low */
-		rslt |= ltr390_set_thresh_low(dev->settings.int_thresh_low, dev);
+void ltr390_reset_dual(struct ltr390_dev *dev)
+{
+	if (dev == NULL)
+		return;
+
+	/*
+	 * Alternating mode setup: the configured channel as set, UVS
+	 * otherwise at its 18x/20-bit default, ALS at the reset value
+	 */
+	dev->dual[LTR390_VAL_UVS_MODE_ALS].gain_range = LTR390_VAL_GAIN_RANGE_3;
+	dev->dual[LTR390_VAL_UVS_MODE_ALS].resolution = LTR390_VAL_RES_18_BIT;
+	dev->dual[LTR390_VAL_UVS_MODE_UVS].gain_range = LTR390_VAL_GAIN_RANGE_18;
+	dev->dual[LTR390_VAL_UVS_MODE_UVS].resolution = LTR390_VAL_RES_20_BIT;
+	if (dev->settings.mode == LTR390_VAL_UVS_MODE_ALS) {
+		dev->dual[LTR390_VAL_UVS_MODE_ALS].gain_range = dev->settings.gain_range;
+		dev->dual[LTR390_VAL_UVS_MODE_ALS].resolution = dev->settings.resolution;
+	}
+}
+
+
+void ltr390_default_image(struct ltr390_shadow *image)
+{
+	if (image != NULL)
+		shadow_load_defaults(image);
+}
 
-		/* set up threshold up */
-		rslt |= ltr390_set_thresh_up(dev->settings.int_thresh_up, dev);
+
+int8_t ltr390_restore(struct ltr390_dev *dev)
+{
+	int8_t rslt;
+	struct ltr390_shadow defaults;
+	struct ltr390_bus_op ops[LTR390_CFG_BLK_COUNT];
+	uint8_t *shadow_reg;
+	uint8_t reg_addr;
+	uint8_t len;
+	uint8_t count = 0;
+	uint8_t i;
+
+	/* Check for null pointer in the device structure*/
+	rslt = null_ptr_check(dev);
+	if (rslt != LTR390_OK)
+		return rslt;
+	/* Nothing known to replay */
+	if (dev->shadow.valid != TRUE)
+		return LTR390_E_INVALID_VAL;
+
+	/*
+	 * Sensor back at its power-on values, only write the blocks that differ,
+	 * whole blocks from the shadow, in one job. Sensor enabled last, as
+	 * ltr390_configure.
+	 */
+	shadow_load_defaults(&defaults);
+	for (i = 0; i < LTR390_CFG_BLK_COUNT; i++) {
+		shadow_reg = ltr390_cfg_block(&dev->shadow, i, &reg_addr, &len);
+		if (block_differs(shadow_reg, ltr390_cfg_block(&defaults, i, NULL, NULL), len) == TRUE)
+			bus_op_init(&ops[count++], LTR390_BUS_WRITE, reg_addr, shadow_reg, len, dev);
 	}
+	LTR390_POR_ADD(dev, writes, count);
+	rslt = ltr390_bus_submit(ops, count, dev);
 
-	return LTR390_OK;
-	
+	/* Partly restored, resync on next access */
+	if (rslt != LTR390_OK)
+		dev->shadow.valid = FALSE;
+
+	return rslt;
 }
 
 
 int8_t ltr390_get_regs(uint8_t reg_addr, uint8_t *reg_data, uint8_t len, struct ltr390_dev *dev)
 {
 	int8_t rslt;
+	struct ltr390_bus_op op;
 
 	/* Check for null pointer in the device structure*/
 	rslt = null_ptr_check(dev);
 	/* Proceed if null check is fine */
 	if (rslt == LTR390_OK) {
 		/* Read the data  */
-		rslt = dev->read((uint8_t)((dev->dev_id<<1)|0x01), reg_addr, reg_data, len);
-		/* Check for communication error */
-		if (rslt != LTR390_OK)
-			rslt = LTR390_E_COMM_FAIL;
+		bus_op_init(&op, LTR390_BUS_READ, reg_addr, reg_data, len, dev);
+		rslt = ltr390_bus_submit(&op, 1, dev);
 	}
 
 	return rslt;
@@ -132,9 +327,7 @@ int8_t ltr390_get_regs(uint8_t reg_addr, uint8_t *reg_data, uint8_t len, struct
 int8_t ltr390_set_regs(uint8_t *reg_addr,  uint8_t *reg_data, uint8_t len, struct ltr390_dev *dev)
 {
 	int8_t rslt;
-
-	if (len > 3) /* Typically not to write more than 3 registers */
-		len = 3;
+	struct ltr390_bus_op op;
 
 	/* Check for null pointer in the device structure*/
 	rslt = null_ptr_check(dev);
@@ -142,10 +335,8 @@ int8_t ltr390_set_regs(uint8_t *reg_addr,  uint8_t *reg_data, uint8_t len, struc
 	if ((rslt ==  LTR390_OK) && (reg_addr != NULL) && (reg_data != NULL)) {
 		if (len > 0) {
 			/* write data */
-			rslt = dev->write((uint8_t)(dev->dev_id<<1), reg_addr[0], reg_data, len);
-			/* Check for communication error */
-			if (rslt != LTR390_OK)
-				rslt = LTR390_E_COMM_FAIL;
+			bus_op_init(&op, LTR390_BUS_WRITE, reg_addr[0], reg_data, len, dev);
+			rslt = ltr390_bus_submit(&op, 1, dev);
 		} else {
 			rslt = LTR390_E_INVALID_LEN;
 		}
@@ -157,28 +348,129 @@ int8_t ltr390_set_regs(uint8_t *reg_addr,  uint8_t *reg_data, uint8_t len, struc
 }
 
 
+int8_t ltr390_bus_submit(struct ltr390_bus_op *ops, uint8_t count, struct ltr390_dev *dev)
+{
+	int8_t rslt;
+	ltr390_com_fptr_t com;
+	uint8_t i;
+#ifdef LTR390_ENABLE_STATS
+	uint32_t start_us = 0;
+#endif
+
+	/* Check for null pointer in the device structure*/
+	rslt = null_ptr_check(dev);
+	if ((rslt == LTR390_OK) && (ops == NULL) && (count > 0))
+		rslt = LTR390_E_NULL_PTR;
+	if (rslt != LTR390_OK)
+		return rslt;
+
+	for (i = 0; i < count; i++) {
+		ops[i].rslt = LTR390_E_COMM_FAIL;
+		/* Close the time slice spent in the current enable state */
+		if ((ops[i].dir == LTR390_BUS_WRITE) && (ops[i].reg_addr == LTR390_REG_MAIN_CTRL))
+			ltr390_power_account(dev);
+	}
+
+	if (dev->xfer != NULL) {
+		/* One submission, a failed job leaves the unconfirmed operations failed */
+#ifdef LTR390_ENABLE_STATS
+		for (i = 0; i < count; i++)
+			start_us = stats_begin(dev, ops[i].dir, ops[i].reg_addr, (uint8_t)ops[i].len);
+#endif
+		if ((count > 0) && (dev->xfer(ops, count, dev->xfer_ctx) == LTR390_OK)) {
+			for (i = 0; i < count; i++)
+				ops[i].rslt = LTR390_OK;
+		}
+#ifdef LTR390_ENABLE_STATS
+		for (i = 0; i < count; i++)
+			stats_end(dev, ops[i].dir, ops[i].reg_addr, (uint8_t)ops[i].len,
+					(ops[i].rslt == LTR390_OK) ? LTR390_OK : LTR390_E_COMM_FAIL, start_us);
+#endif
+	} else {
+		/* One callback per operation, a failure does not stop the next ones */
+		for (i = 0; i < count; i++) {
+#ifdef LTR390_ENABLE_STATS
+			start_us = stats_begin(dev, ops[i].dir, ops[i].reg_addr, (uint8_t)ops[i].len);
+#endif
+			com = (ops[i].dir == LTR390_BUS_READ) ? dev->read : dev->write;
+			if (com(ops[i].addr, ops[i].reg_addr, ops[i].buf, ops[i].len) == LTR390_OK)
+				ops[i].rslt = LTR390_OK;
+#ifdef LTR390_ENABLE_STATS
+			stats_end(dev, ops[i].dir, ops[i].reg_addr, (uint8_t)ops[i].len, ops[i].rslt, start_us);
+#endif
+		}
+	}
+
+	/* Check for communication error, the first failure is reported */
+	for (i = 0; i < count; i++) {
+		if (ops[i].rslt != LTR390_OK) {
+			ops[i].rslt = LTR390_E_COMM_FAIL;
+			if (rslt == LTR390_OK)
+				rslt = LTR390_E_COMM_FAIL;
+		}
+	}
+
+	return rslt;
+}
+
+
 int8_t ltr390_soft_reset( struct ltr390_dev *dev) 
 {
-    int8_t rslt;
-    uint8_t reg_addr = LTR390_REG_MAIN_CTRL;
-	uint8_t reg_data;
-    
+	int8_t rslt;
+	uint8_t reg_addr = LTR390_REG_MAIN_CTRL;
+	uint8_t reg_data = LTR390_DEF_MAIN_CTRL;
+
 	/* Check for null pointer in the device structure*/
-    rslt = null_ptr_check(dev);
+	rslt = null_ptr_check(dev);
 	if (rslt == LTR390_OK) {
-		/* Get register value*/
-		rslt = ltr390_get_regs(reg_addr,&reg_data,1,dev);
+		/* Every register is reset, only keep the known MAIN_CTRL bits */
+		if (dev->shadow.valid == TRUE)
+			reg_data = dev->shadow.main_ctrl;
+		/* prepare command to write */
+		uint8_t soft_rst_cmd = LTR390_SET_BITS(reg_data,
+											LTR390_POS_SOFT_RST,
+											LTR390_MASK_SOFT_RST,
+											LTR390_VAL_SOFT_RST_EN);
+		/* Write the soft reset command in the sensor */
+		rslt = ltr390_set_regs(&reg_addr, &soft_rst_cmd, 1, dev);
 		if (rslt == LTR390_OK) {
-			/* prepare command to write */
-			uint8_t soft_rst_cmd = LTR390_SET_BITS(reg_data,
-												LTR390_POS_SOFT_RST,
-												LTR390_MASK_SOFT_RST,
-												LTR390_VAL_SOFT_RST_EN);
-			if (rslt == LTR390_OK) {
-				/* Write the soft reset command in the sensor */
-				rslt = ltr390_set_regs(&reg_addr, &soft_rst_cmd, 1, dev);
-			}
+			/* Registers are back to their power-on values */
+			shadow_load_defaults(&dev->shadow);
+		} else {
+			/* Reset state unknown, resync on next access */
+			dev->shadow.valid = FALSE;
+		}
+	}
+
+	return rslt;
+}
+
+
+int8_t ltr390_sync_regs(struct ltr390_dev *dev)
+{
+	int8_t rslt;
+	uint8_t main_ctrl;
+
+	/* Check for null pointer in the device structure*/
+	rslt = null_ptr_check(dev);
+	if (rslt == LTR390_OK) {
+		dev->shadow.valid = FALSE;
+		/* MAIN_CTRL */
+		rslt = ltr390_get_regs(LTR390_REG_MAIN_CTRL, &main_ctrl, 1, dev);
+		if (rslt == LTR390_OK) {
+			/* Soft reset bit is a command, never keep it */
+			dev->shadow.main_ctrl = main_ctrl & (uint8_t)~LTR390_MASK_SOFT_RST;
+			/* ALS_UVS_MEAS_RATE and ALS_UVS_GAIN */
+			rslt = ltr390_get_regs(LTR390_REG_ALS_UVS_MEAS_RATE, dev->shadow.meas, 2, dev);
 		}
+		/* INT_CFG and INT_PST */
+		if (rslt == LTR390_OK)
+			rslt = ltr390_get_regs(LTR390_REG_INT_CFG, dev->shadow.intr, 2, dev);
+		/* ALS_UVS_THRES_UP_0 to ALS_UVS_THRES_LOW_2 */
+		if (rslt == LTR390_OK)
+			rslt = ltr390_get_regs(LTR390_REG_ALS_UVS_THRES_UP_0, dev->shadow.thres, 6, dev);
+		if (rslt == LTR390_OK)
+			dev->shadow.valid = TRUE;
 	}
 
 	return rslt;
@@ -188,28 +480,22 @@ int8_t ltr390_soft_reset( struct ltr390_dev *dev)
 int8_t ltr390_set_mode(uint8_t mode,  struct ltr390_dev *dev)
 {
 	int8_t rslt;
-    uint8_t reg_addr = LTR390_REG_MAIN_CTRL;
-	uint8_t reg_data;
-    
+
 	/* Control input value */
 	switch (mode) 
 	{
 		case LTR390_VAL_UVS_MODE_ALS:
 		case LTR390_VAL_UVS_MODE_UVS:
-			/* Check for null pointer in the device structure*/
-			rslt = null_ptr_check(dev);
+			/* Check for null pointer and shadow registers */
+			rslt = shadow_check(dev);
 			if (rslt == LTR390_OK) {
-				/* Get register value*/
-				rslt = ltr390_get_regs(reg_addr,&reg_data,1,dev);
-				if (rslt == LTR390_OK) {
-					/* prepare command to write */
-					uint8_t conf_mode = LTR390_SET_BITS(reg_data,
-														LTR390_POS_UVS_MODE,
-														LTR390_MASK_UVS_MODE,
-														mode);
-					/* Write mode in the sensor's register */
-					rslt = ltr390_set_regs(&reg_addr, &conf_mode, 1, dev);
-				}
+				/* prepare command to write */
+				uint8_t conf_mode = LTR390_SET_BITS(dev->shadow.main_ctrl,
+													LTR390_POS_UVS_MODE,
+													LTR390_MASK_UVS_MODE,
+													mode);
+				/* Write mode in the sensor's register */
+				rslt = shadow_write(LTR390_REG_MAIN_CTRL, &dev->shadow.main_ctrl, &conf_mode, 1, dev);
 			}
 			break;
 		default:
@@ -219,12 +505,38 @@ int8_t ltr390_set_mode(uint8_t mode,  struct ltr390_dev *dev)
 	return rslt;
 }
 
+int8_t ltr390_set_enable(uint8_t enable,  struct ltr390_dev *dev)
+{
+	int8_t rslt;
+	uint8_t was_active;
+	uint8_t conf_en;
+
+	/* Control input value */
+	if ((enable != LTR390_VAL_ALS_UVS_STANDBY) && (enable != LTR390_VAL_ALS_UVS_ACTIVE))
+		return LTR390_E_INVALID_VAL;
+
+	/* Check for null pointer and shadow registers */
+	rslt = shadow_check(dev);
+	if (rslt == LTR390_OK) {
+		was_active = (dev->shadow.main_ctrl & LTR390_MASK_ALS_UVS_EN) ? TRUE : FALSE;
+		/* prepare command to write */
+		conf_en = LTR390_SET_BITS(dev->shadow.main_ctrl,
+								LTR390_POS_ALS_UVS_EN,
+								LTR390_MASK_ALS_UVS_EN,
+								enable);
+		/* Write enable in the sensor's register */
+		rslt = shadow_write(LTR390_REG_MAIN_CTRL, &dev->shadow.main_ctrl, &conf_en, 1, dev);
+		if ((rslt == LTR390_OK) && (was_active == FALSE) && (enable == LTR390_VAL_ALS_UVS_ACTIVE))
+			dev->power.wakeups++;
+	}
+
+	return rslt;
+}
+
 int8_t ltr390_set_rate(uint8_t rate,  struct ltr390_dev *dev)
 {
 	int8_t rslt;
-    uint8_t reg_addr = LTR390_REG_ALS_UVS_MEAS_RATE;
-	uint8_t reg_data;
-    
+
 	/* Control input value */
 	switch (rate) 
 	{
@@ -235,20 +547,16 @@ int8_t ltr390_set_rate(uint8_t rate,  struct ltr390_dev *dev)
 		case LTR390_VAL_MEAS_RATE_500_MS:
 		case LTR390_VAL_MEAS_RATE_1000_MS:
 		case LTR390_VAL_MEAS_RATE_2000_MS:
-			/* Check for null pointer in the device structure*/
-			rslt = null_ptr_check(dev);
+			/* Check for null pointer and shadow registers */
+			rslt = shadow_check(dev);
 			if (rslt == LTR390_OK) {
-				/* Get register value*/
-				rslt = ltr390_get_regs(reg_addr,&reg_data,1,dev);
-				if (rslt == LTR390_OK) {
-					/* prepare command to write */
-					uint8_t conf_rate = LTR390_SET_BITS(reg_data,
-														LTR390_POS_ALS_UVS_MEAS_RATE,
-														LTR390_MASK_ALS_UVS_MEAS_RATE,
-														rate);
-					/* Write mode in the sensor's register */
-					rslt = ltr390_set_regs(&reg_addr, &conf_rate, 1, dev);
-				}
+				/* prepare command to write */
+				uint8_t conf_rate = LTR390_SET_BITS(dev->shadow.meas[0],
+													LTR390_POS_ALS_UVS_MEAS_RATE,
+													LTR390_MASK_ALS_UVS_MEAS_RATE,
+													rate);
+				/* Write rate in the sensor's register */
+				rslt = shadow_write(LTR390_REG_ALS_UVS_MEAS_RATE, &dev->shadow.meas[0], &conf_rate, 1, dev);
 			}
 			break;
 		default:
@@ -261,9 +569,7 @@ int8_t ltr390_set_rate(uint8_t rate,  struct ltr390_dev *dev)
 int8_t ltr390_set_resolution(uint8_t resolution,  struct ltr390_dev *dev)
 {
 	int8_t rslt;
-    uint8_t reg_addr = LTR390_REG_ALS_UVS_MEAS_RATE;
-	uint8_t reg_data;
-    
+
 	/* Control input value */
 	switch (resolution) 
 	{
@@ -273,20 +579,16 @@ int8_t ltr390_set_resolution(uint8_t resolution,  struct ltr390_dev *dev)
 		case LTR390_VAL_RES_18_BIT:
 		case LTR390_VAL_RES_19_BIT:
 		case LTR390_VAL_RES_20_BIT:
-			/* Check for null pointer in the device structure*/
-			rslt = null_ptr_check(dev);
+			/* Check for null pointer and shadow registers */
+			rslt = shadow_check(dev);
 			if (rslt == LTR390_OK) {
-				/* Get register value*/
-				rslt = ltr390_get_regs(reg_addr,&reg_data,1,dev);
-				if (rslt == LTR390_OK) {
-					/* prepare command to write */
-					uint8_t conf_res = LTR390_SET_BITS(reg_data,
-														LTR390_POS_ALS_UVS_RES,
-														LTR390_MASK_ALS_UVS_RES,
-														resolution);
-					/* Write mode in the sensor's register */
-					rslt = ltr390_set_regs(&reg_addr, &conf_res, 1, dev);
-				}
+				/* prepare command to write */
+				uint8_t conf_res = LTR390_SET_BITS(dev->shadow.meas[0],
+													LTR390_POS_ALS_UVS_RES,
+													LTR390_MASK_ALS_UVS_RES,
+													resolution);
+				/* Write resolution in the sensor's register */
+				rslt = shadow_write(LTR390_REG_ALS_UVS_MEAS_RATE, &dev->shadow.meas[0], &conf_res, 1, dev);
 			}
 			break;
 		default:
@@ -299,9 +601,7 @@ int8_t ltr390_set_resolution(uint8_t resolution,  struct ltr390_dev *dev)
 int8_t ltr390_set_gain(uint8_t gain_range,  struct ltr390_dev *dev)
 {
 	int8_t rslt;
-    uint8_t reg_addr = LTR390_POS_ALS_UVS_GAIN_RANGE;
-	uint8_t reg_data;
-    
+
 	/* Control input value */
 	switch (gain_range) 
 	{
@@ -310,20 +610,16 @@ int8_t ltr390_set_gain(uint8_t gain_range,  struct ltr390_dev *dev)
 		case LTR390_VAL_GAIN_RANGE_6:
 		case LTR390_VAL_GAIN_RANGE_9:
 		case LTR390_VAL_GAIN_RANGE_18:
-			/* Check for null pointer in the device structure*/
-			rslt = null_ptr_check(dev);
+			/* Check for null pointer and shadow registers */
+			rslt = shadow_check(dev);
 			if (rslt == LTR390_OK) {
-				/* Get register value*/
-				rslt = ltr390_get_regs(reg_addr,&reg_data,1,dev);
-				if (rslt == LTR390_OK) {
-					/* prepare command to write */
-					uint8_t conf_gain = LTR390_SET_BITS(reg_data,
-														LTR390_POS_ALS_UVS_GAIN_RANGE,
-														LTR390_MASK_ALS_UVS_GAIN_RANGE,
-														gain_range);
-					/* Write mode in the sensor's register */
-					rslt = ltr390_set_regs(&reg_addr, &conf_gain, 1, dev);
-				}
+				/* prepare command to write */
+				uint8_t conf_gain = LTR390_SET_BITS(dev->shadow.meas[1],
+													LTR390_POS_ALS_UVS_GAIN_RANGE,
+													LTR390_MASK_ALS_UVS_GAIN_RANGE,
+													gain_range);
+				/* Write gain in the sensor's register */
+				rslt = shadow_write(LTR390_REG_ALS_UVS_GAIN, &dev->shadow.meas[1], &conf_gain, 1, dev);
 			}
 			break;
 		default:
@@ -336,28 +632,22 @@ int8_t ltr390_set_gain(uint8_t gain_range,  struct ltr390_dev *dev)
 int8_t ltr390_set_int(uint8_t int_enabled,  struct ltr390_dev *dev)
 {
 	int8_t rslt;
-    uint8_t reg_addr = LTR390_REG_INT_CFG;
-	uint8_t reg_data;
-    
+
 	/* Control input value */
 	switch (int_enabled) 
 	{
 		case FALSE:
 		case TRUE:
-			/* Check for null pointer in the device structure*/
-			rslt = null_ptr_check(dev);
+			/* Check for null pointer and shadow registers */
+			rslt = shadow_check(dev);
 			if (rslt == LTR390_OK) {
-				/* Get register value*/
-				rslt = ltr390_get_regs(reg_addr,&reg_data,1,dev);
-				if (rslt == LTR390_OK) {
-					/* prepare command to write */
-					uint8_t conf_int = LTR390_SET_BITS(reg_data,
-														LTR390_POS_LS_INT_EN,
-														LTR390_MASK_LS_INT_EN,
-														(int_enabled==TRUE?LTR390_VAL_LS_INT_EN:LTR390_VAL_LS_INT_DIS));
-					/* Write mode in the sensor's register */
-					rslt = ltr390_set_regs(&reg_addr, &conf_int, 1, dev);
-				}
+				/* prepare command to write */
+				uint8_t conf_int = LTR390_SET_BITS(dev->shadow.intr[0],
+													LTR390_POS_LS_INT_EN,
+													LTR390_MASK_LS_INT_EN,
+													(int_enabled==TRUE?LTR390_VAL_LS_INT_EN:LTR390_VAL_LS_INT_DIS));
+				/* Write interrupt enable in the sensor's register */
+				rslt = shadow_write(LTR390_REG_INT_CFG, &dev->shadow.intr[0], &conf_int, 1, dev);
 			}
 			break;
 		default:
@@ -370,28 +660,22 @@ int8_t ltr390_set_int(uint8_t int_enabled,  struct ltr390_dev *dev)
 int8_t ltr390_set_int_src(uint8_t int_src,  struct ltr390_dev *dev)
 {
 	int8_t rslt;
-    uint8_t reg_addr = LTR390_REG_INT_CFG;
-	uint8_t reg_data;
-    
+
 	/* Control input value */
 	switch (int_src) 
 	{
 		case LTR390_VAL_LS_INT_SEL_ALS:
 		case LTR390_VAL_LS_INT_SEL_UVS:
-			/* Check for null pointer in the device structure*/
-			rslt = null_ptr_check(dev);
+			/* Check for null pointer and shadow registers */
+			rslt = shadow_check(dev);
 			if (rslt == LTR390_OK) {
-				/* Get register value*/
-				rslt = ltr390_get_regs(reg_addr,&reg_data,1,dev);
-				if (rslt == LTR390_OK) {
-					/* prepare command to write */
-					uint8_t conf_int_src = LTR390_SET_BITS(reg_data,
-														LTR390_POS_LS_INT_SEL,
-														LTR390_MASK_LS_INT_SEL,
-														int_src);
-					/* Write mode in the sensor's register */
-					rslt = ltr390_set_regs(&reg_addr, &conf_int_src, 1, dev);
-				}
+				/* prepare command to write */
+				uint8_t conf_int_src = LTR390_SET_BITS(dev->shadow.intr[0],
+													LTR390_POS_LS_INT_SEL,
+													LTR390_MASK_LS_INT_SEL,
+													int_src);
+				/* Write interrupt source in the sensor's register */
+				rslt = shadow_write(LTR390_REG_INT_CFG, &dev->shadow.intr[0], &conf_int_src, 1, dev);
 			}
 			break;
 		default:
@@ -404,9 +688,7 @@ int8_t ltr390_set_int_src(uint8_t int_src,  struct ltr390_dev *dev)
 int8_t ltr390_set_int_pers(uint8_t int_pers,  struct ltr390_dev *dev)
 {
 	int8_t rslt;
-    uint8_t reg_addr = LTR390_REG_INT_PST;
-	uint8_t reg_data;
-    
+
 	/* Control input value */
 	switch (int_pers) 
 	{
@@ -426,20 +708,16 @@ int8_t ltr390_set_int_pers(uint8_t int_pers,  struct ltr390_dev *dev)
 		case LTR390_VAL_ALS_UVS_TRIG_INT_14_CONS:
 		case LTR390_VAL_ALS_UVS_TRIG_INT_15_CONS:
 		case LTR390_VAL_ALS_UVS_TRIG_INT_16_CONS:
-			/* Check for null pointer in the device structure*/
-			rslt = null_ptr_check(dev);
+			/* Check for null pointer and shadow registers */
+			rslt = shadow_check(dev);
 			if (rslt == LTR390_OK) {
-				/* Get register value*/
-				rslt = ltr390_get_regs(reg_addr,&reg_data,1,dev);
-				if (rslt == LTR390_OK) {
-					/* prepare command to write */
-					uint8_t conf_int_pers = LTR390_SET_BITS(reg_data,
-														LTR390_POS_ALS_UVS_PERSIST,
-														LTR390_MASK_ALS_UVS_PERSIST,
-														int_pers);
-					/* Write mode in the sensor's register */
-					rslt = ltr390_set_regs(&reg_addr, &conf_int_pers, 1, dev);
-				}
+				/* prepare command to write */
+				uint8_t conf_int_pers = LTR390_SET_BITS(dev->shadow.intr[1],
+													LTR390_POS_ALS_UVS_PERSIST,
+													LTR390_MASK_ALS_UVS_PERSIST,
+													int_pers);
+				/* Write interrupt persist in the sensor's register */
+				rslt = shadow_write(LTR390_REG_INT_PST, &dev->shadow.intr[1], &conf_int_pers, 1, dev);
 			}
 			break;
 		default:
@@ -452,36 +730,28 @@ int8_t ltr390_set_int_pers(uint8_t int_pers,  struct ltr390_dev *dev)
 int8_t ltr390_set_thresh_low(uint32_t int_thresh_low,  struct ltr390_dev *dev)
 {
 	int8_t rslt;
-    uint8_t reg_addr[3] = {LTR390_REG_ALS_UVS_THRES_LOW_0,
-				LTR390_REG_ALS_UVS_THRES_LOW_1,
-				LTR390_REG_ALS_UVS_THRES_LOW_2};
-	uint8_t reg_data[3]={0};
 	uint8_t conf_thresh_low[3];
-    
-	/* Check for null pointer in the device structure*/
-    rslt = null_ptr_check(dev);
+
+	/* Check for null pointer and shadow registers */
+	rslt = shadow_check(dev);
 	if (rslt == LTR390_OK) {
-		/* Get register value*/
-		if (rslt == LTR390_OK) {
-			/* prepare command to write */
-			conf_thresh_low[0] = LTR390_SET_BITS(reg_data[0],
-									LTR390_POS_ALS_UVS_THRES_LOW_0,
-									LTR390_MASK_ALS_UVS_THRES_LOW_0,
-									LTR390_GET_LSB(int_thresh_low));
-			/* Write the soft reset command in the sensor */
-			rslt = ltr390_set_regs(reg_addr, conf_thresh_low, 3, dev);
-
-			conf_thresh_low[1] = LTR390_SET_BITS(reg_data[1],
-									LTR390_POS_ALS_UVS_THRES_LOW_0,
-									LTR390_MASK_ALS_UVS_THRES_LOW_0,
-									LTR390_GET_MID(int_thresh_low));
-
-			conf_thresh_low[2] = LTR390_SET_BITS(reg_data[2],
-									LTR390_POS_ALS_UVS_THRES_LOW_0,
-									LTR390_MASK_ALS_UVS_THRES_LOW_0,
-									LTR390_GET_MSB(int_thresh_low));
-			
-		}
+		/* prepare command to write */
+		conf_thresh_low[0] = LTR390_SET_BITS(dev->shadow.thres[3],
+								LTR390_POS_ALS_UVS_THRES_LOW_0,
+								LTR390_MASK_ALS_UVS_THRES_LOW_0,
+								LTR390_GET_LSB(int_thresh_low));
+
+		conf_thresh_low[1] = LTR390_SET_BITS(dev->shadow.thres[4],
+								LTR390_POS_ALS_UVS_THRES_LOW_1,
+								LTR390_MASK_ALS_UVS_THRES_LOW_1,
+								LTR390_GET_MID(int_thresh_low));
+
+		conf_thresh_low[2] = LTR390_SET_BITS(dev->shadow.thres[5],
+								LTR390_POS_ALS_UVS_THRES_LOW_2,
+								LTR390_MASK_ALS_UVS_THRES_LOW_2,
+								LTR390_GET_MSB(int_thresh_low));
+		/* Write the low threshold in the sensor's registers */
+		rslt = shadow_write(LTR390_REG_ALS_UVS_THRES_LOW_0, &dev->shadow.thres[3], conf_thresh_low, 3, dev);
 	}
 
 	return rslt;
@@ -490,34 +760,28 @@ int8_t ltr390_set_thresh_low(uint32_t int_thresh_low,  struct ltr390_dev *dev)
 int8_t ltr390_set_thresh_up(uint32_t int_thresh_up,  struct ltr390_dev *dev)
 {
 	int8_t rslt;
-    uint8_t reg_addr[3] = {LTR390_REG_ALS_UVS_THRES_UP_0,
-				LTR390_REG_ALS_UVS_THRES_UP_1,
-				LTR390_REG_ALS_UVS_THRES_UP_2};
-	uint8_t reg_data[3]={0};
 	uint8_t conf_thresh_up[3];
-    
-	/* Check for null pointer in the device structure*/
-    rslt = null_ptr_check(dev);
+
+	/* Check for null pointer and shadow registers */
+	rslt = shadow_check(dev);
 	if (rslt == LTR390_OK) {
-		if (rslt == LTR390_OK) {
-			/* prepare command to write */
-			conf_thresh_up[0] = LTR390_SET_BITS(reg_data[0],
-									LTR390_POS_ALS_UVS_THRES_UP_0,
-									LTR390_MASK_ALS_UVS_THRES_UP_0,
-									LTR390_GET_LSB(int_thresh_up));
-
-			conf_thresh_up[1] = LTR390_SET_BITS(reg_data[1],
-									LTR390_POS_ALS_UVS_THRES_UP_0,
-									LTR390_MASK_ALS_UVS_THRES_UP_0,
-									LTR390_GET_MID(int_thresh_up));
-
-			conf_thresh_up[2] = LTR390_SET_BITS(reg_data[2],
-									LTR390_POS_ALS_UVS_THRES_UP_0,
-									LTR390_MASK_ALS_UVS_THRES_UP_0,
-									LTR390_GET_MSB(int_thresh_up));
-			/* Write the soft reset command in the sensor */
-			rslt = ltr390_set_regs(reg_addr, conf_thresh_up, 3, dev);
-		}
+		/* prepare command to write */
+		conf_thresh_up[0] = LTR390_SET_BITS(dev->shadow.thres[0],
+								LTR390_POS_ALS_UVS_THRES_UP_0,
+								LTR390_MASK_ALS_UVS_THRES_UP_0,
+								LTR390_GET_LSB(int_thresh_up));
+
+		conf_thresh_up[1] = LTR390_SET_BITS(dev->shadow.thres[1],
+								LTR390_POS_ALS_UVS_THRES_UP_1,
+								LTR390_MASK_ALS_UVS_THRES_UP_1,
+								LTR390_GET_MID(int_thresh_up));
+
+		conf_thresh_up[2] = LTR390_SET_BITS(dev->shadow.thres[2],
+								LTR390_POS_ALS_UVS_THRES_UP_2,
+								LTR390_MASK_ALS_UVS_THRES_UP_2,
+								LTR390_GET_MSB(int_thresh_up));
+		/* Write the up threshold in the sensor's registers */
+		rslt = shadow_write(LTR390_REG_ALS_UVS_THRES_UP_0, &dev->shadow.thres[0], conf_thresh_up, 3, dev);
 	}
 
 	return rslt;
@@ -530,11 +794,11 @@ int8_t ltr390_get_raw_data(uint32_t *data,  struct ltr390_dev *dev)
 	switch (dev->settings.mode)
 	{
 		case LTR390_VAL_UVS_MODE_ALS:
-			rslt=get_als_data(data, dev);
+			rslt=get_channel_data(LTR390_REG_ALS_DATA_0, data, dev);
 			break;
 
 		case LTR390_VAL_UVS_MODE_UVS:
-			rslt=get_uvs_data(data, dev);
+			rslt=get_channel_data(LTR390_REG_UVS_DATA_0, data, dev);
 			break;
 		
 		default:
@@ -545,20 +809,505 @@ int8_t ltr390_get_raw_data(uint32_t *data,  struct ltr390_dev *dev)
 	return rslt;
 }
 
+int8_t ltr390_get_status(uint8_t *status,  struct ltr390_dev *dev)
+{
+	int8_t rslt;
+
+	if (status == NULL)
+		return LTR390_E_NULL_PTR;
+
+	/* Read MAIN_STATUS, status bits are cleared by the read */
+	rslt = ltr390_get_regs(LTR390_REG_MAIN_STATUS, status, 1, dev);
+	/* Brownout: the sensor lost its configuration */
+	if ((rslt == LTR390_OK) && (*status & LTR390_MASK_ALS_UVS_PWR_ON_STAT))
+		rslt = por_recover(dev);
+
+	return rslt;
+}
+
+int8_t ltr390_get_new_data(struct ltr390_sample *sample,  struct ltr390_dev *dev)
+{
+	int8_t rslt;
+	uint8_t status;
+	uint32_t raw = 0;
+	uint8_t job = FALSE;
+
+	if (sample == NULL)
+		return LTR390_E_NULL_PTR;
+
+	sample->flags = 0;
+	/*
+	 * Only fetch the data registers if a new conversion is available. A job
+	 * transport takes both in one submission, stale data is dropped.
+	 */
+	if ((dev != NULL) && (dev->xfer != NULL)) {
+		rslt = poll_job(&status, &raw, dev);
+		job = TRUE;
+	} else {
+		rslt = ltr390_get_status(&status, dev);
+	}
+	if (rslt == LTR390_OK) {
+		if (LTR390_GET_BITS(status, LTR390_POS_ALS_UVS_DATA_STAT, LTR390_MASK_ALS_UVS_DATA_STAT)
+			== LTR390_VAL_ALS_UVS_DATA_NEW) {
+			if (job == TRUE)
+				sample->raw = raw;
+			else
+				rslt = ltr390_get_raw_data(&sample->raw, dev);
+			if (rslt == LTR390_OK) {
+				sample->mode = dev->settings.mode;
+				sample->gain_range = dev->settings.gain_range;
+				sample->resolution = dev->settings.resolution;
+				sample->flags = LTR390_SAMPLE_FRESH;
+				if (status & LTR390_MASK_ALS_UVS_PWR_ON_STAT)
+					sample->flags |= LTR390_SAMPLE_PWR_ON;
+				if ((sample->resolution <= LTR390_VAL_RES_13_BIT) &&
+					(sample->raw >= ltr390_full_scale[sample->resolution]))
+					sample->flags |= LTR390_SAMPLE_SATURATED;
+			}
+		} else {
+			rslt = LTR390_W_NO_NEW_DATA;
+			LTR390_STATS_INC(dev, stale);
+		}
+	}
+
+	return rslt;
+}
+
+int8_t ltr390_wait_new_data(struct ltr390_sample *sample, uint32_t timeout_us,  struct ltr390_dev *dev)
+{
+	int8_t rslt;
+	uint32_t poll_us;
+	uint32_t step_us;
+	uint32_t start_us = 0;
+	uint32_t elapsed_us = 0;
+
+	/* Check for null pointer in the device structure*/
+	rslt = null_ptr_check(dev);
+	if ((rslt == LTR390_OK) && (dev->delay_us == NULL))
+		rslt = LTR390_E_NULL_PTR;
+	if (rslt != LTR390_OK)
+		return rslt;
+
+	if (dev->settings.resolution > LTR390_VAL_RES_13_BIT)
+		return LTR390_E_INVALID_VAL;
+
+	/* Poll a few times per conversion */
+	poll_us = conv_time_us[dev->settings.resolution] / LTR390_DATA_POLL_DIV;
+	if (dev->get_time_us != NULL)
+		start_us = dev->get_time_us();
+
+	rslt = ltr390_get_new_data(sample, dev);
+	while (rslt == LTR390_W_NO_NEW_DATA) {
+		if (elapsed_us >= timeout_us) {
+			rslt = LTR390_E_TIMEOUT;
+			LTR390_STATS_ERROR(dev, rslt);
+			break;
+		}
+		/* Never sleep past the deadline */
+		step_us = poll_us;
+		if (step_us > (timeout_us - elapsed_us))
+			step_us = timeout_us - elapsed_us;
+		dev->delay_us(step_us);
+
+		/* Use the clock if available, the accumulated delays otherwise */
+		if (dev->get_time_us != NULL)
+			elapsed_us = dev->get_time_us() - start_us;
+		else
+			elapsed_us += step_us;
+
+		rslt = ltr390_get_new_data(sample, dev);
+	}
+
+	return rslt;
+}
+
+int8_t ltr390_get_frame(struct ltr390_frame *frame,  struct ltr390_dev *dev)
+{
+	int8_t rslt;
+	uint8_t reg_data[LTR390_FRAME_LEN];
+
+	if (frame == NULL)
+		return LTR390_E_NULL_PTR;
+
+	/* MAIN_STATUS to UVS_DATA_2 in a single auto-increment read */
+	rslt = ltr390_get_regs(LTR390_REG_MAIN_STATUS, reg_data, LTR390_FRAME_LEN, dev);
+	if (rslt == LTR390_OK) {
+		ltr390_decode_frame(frame, reg_data, dev);
+		/* Brownout: the sensor lost its configuration */
+		if (frame->sample.flags & LTR390_SAMPLE_PWR_ON)
+			rslt = por_recover(dev);
+	}
+
+	return rslt;
+}
+
+void ltr390_decode_frame(struct ltr390_frame *frame, const uint8_t *reg_data,  const struct ltr390_dev *dev)
+{
+	uint8_t status = reg_data[0];
+
+	frame->status = status;
+	frame->als = ltr390_decode_data(&reg_data[LTR390_REG_ALS_DATA_0 - LTR390_REG_MAIN_STATUS],
+							dev->settings.resolution);
+	frame->uvs = ltr390_decode_data(&reg_data[LTR390_REG_UVS_DATA_0 - LTR390_REG_MAIN_STATUS],
+							dev->settings.resolution);
+
+	/* Active channel sample, tagged with the status flags */
+	frame->sample.raw = (dev->settings.mode == LTR390_VAL_UVS_MODE_UVS) ? frame->uvs : frame->als;
+	frame->sample.mode = dev->settings.mode;
+	frame->sample.gain_range = dev->settings.gain_range;
+	frame->sample.resolution = dev->settings.resolution;
+	frame->sample.flags = 0;
+	if (status & LTR390_MASK_ALS_UVS_DATA_STAT)
+		frame->sample.flags |= LTR390_SAMPLE_FRESH;
+	if (status & LTR390_MASK_ALS_UVS_INT_STAT)
+		frame->sample.flags |= LTR390_SAMPLE_INT_TRIG;
+	if (status & LTR390_MASK_ALS_UVS_PWR_ON_STAT)
+		frame->sample.flags |= LTR390_SAMPLE_PWR_ON;
+	if ((frame->sample.resolution <= LTR390_VAL_RES_13_BIT) &&
+		(frame->sample.raw >= ltr390_full_scale[frame->sample.resolution]))
+		frame->sample.flags |= LTR390_SAMPLE_SATURATED;
+}
+
+int8_t ltr390_set_dual_cfg(uint8_t mode, uint8_t gain_range, uint8_t resolution,  struct ltr390_dev *dev)
+{
+	if (dev == NULL)
+		return LTR390_E_NULL_PTR;
+
+	/* Control input values */
+	if ((mode > LTR390_VAL_UVS_MODE_UVS) ||
+		(gain_range > LTR390_VAL_GAIN_RANGE_18) ||
+		(resolution > LTR390_VAL_RES_13_BIT))
+		return LTR390_E_INVALID_VAL;
+
+	/* Applied on the next switch to this channel */
+	dev->dual[mode].gain_range = gain_range;
+	dev->dual[mode].resolution = resolution;
+
+	return LTR390_OK;
+}
+
+int8_t ltr390_get_pair(struct ltr390_pair *pair,  struct ltr390_dev *dev)
+{
+	int8_t rslt;
+	struct ltr390_sample samples[2];
+	uint8_t active;
+	uint8_t other;
+	uint8_t mode;
+	uint8_t gain_range;
+	uint8_t resolution;
+
+	if (pair == NULL)
+		return LTR390_E_NULL_PTR;
+
+	/* Check for null pointer and shadow registers */
+	rslt = shadow_check(dev);
+	if ((rslt == LTR390_OK) && (dev->delay_us == NULL))
+		rslt = LTR390_E_NULL_PTR;
+	if (rslt != LTR390_OK)
+		return rslt;
+
+	active = (uint8_t)LTR390_GET_BITS(dev->shadow.main_ctrl, LTR390_POS_UVS_MODE, LTR390_MASK_UVS_MODE);
+	other = (active == LTR390_VAL_UVS_MODE_UVS) ? LTR390_VAL_UVS_MODE_ALS : LTR390_VAL_UVS_MODE_UVS;
+	mode = dev->settings.mode;
+	gain_range = dev->settings.gain_range;
+	resolution = dev->settings.resolution;
+
+	/* A result already waiting on the active channel saves one switch */
+	rslt = LTR390_W_NO_NEW_DATA;
+	if ((dev->shadow.main_ctrl & LTR390_MASK_ALS_UVS_EN) &&
+		(dev->settings.mode == active) &&
+		(dev->settings.gain_range == dev->dual[active].gain_range) &&
+		(dev->settings.resolution == dev->dual[active].resolution))
+		rslt = ltr390_get_new_data(&samples[active], dev);
+
+	if (rslt == LTR390_OK) {
+		rslt = dual_acquire(other, &samples[other], dev);
+	} else if (rslt == LTR390_W_NO_NEW_DATA) {
+		/* Other channel first, so the sensor is left on the channel read last */
+		rslt = dual_acquire(other, &samples[other], dev);
+		if (rslt == LTR390_OK)
+			rslt = dual_acquire(active, &samples[active], dev);
+	}
+
+	/*
+	 * Back to the entry settings, usually free as the channel read last
+	 * is the entry one with its seeded setup. The sensor stays enabled.
+	 */
+	if ((rslt == LTR390_OK) && (mode <= LTR390_VAL_UVS_MODE_UVS) &&
+		((dev->settings.mode != mode) || (dev->settings.gain_range != gain_range) ||
+		(dev->settings.resolution != resolution)))
+		rslt = dual_switch(mode, gain_range, resolution, dev);
+
+	if (rslt == LTR390_OK) {
+		pair->als = samples[LTR390_VAL_UVS_MODE_ALS];
+		pair->uvs = samples[LTR390_VAL_UVS_MODE_UVS];
+	}
+
+	return rslt;
+}
+
+int8_t ltr390_change_init(struct ltr390_change *chg, uint8_t pct, uint32_t min_counts, uint8_t int_pers,  struct ltr390_dev *dev)
+{
+	int8_t rslt;
+	uint8_t int_src;
+	uint8_t conf_int[2];
+
+	if (chg == NULL)
+		return LTR390_E_NULL_PTR;
+	/* Control input values */
+	if ((pct > 100) || ((pct == 0) && (min_counts == 0)) ||
+		(int_pers > LTR390_VAL_ALS_UVS_TRIG_INT_16_CONS))
+		return LTR390_E_INVALID_VAL;
+
+	/* Check for null pointer and shadow registers */
+	rslt = shadow_check(dev);
+	if (rslt != LTR390_OK)
+		return rslt;
+
+	/* Interrupt on the measured channel, persistence as debounce */
+	int_src = (dev->settings.mode == LTR390_VAL_UVS_MODE_UVS) ?
+				LTR390_VAL_LS_INT_SEL_UVS : LTR390_VAL_LS_INT_SEL_ALS;
+	conf_int[0] = LTR390_SET_BITS(dev->shadow.intr[0], LTR390_POS_LS_INT_SEL,
+								LTR390_MASK_LS_INT_SEL, int_src);
+	conf_int[0] = LTR390_SET_BITS(conf_int[0], LTR390_POS_LS_INT_EN,
+								LTR390_MASK_LS_INT_EN, LTR390_VAL_LS_INT_EN);
+	conf_int[1] = LTR390_SET_BITS(dev->shadow.intr[1], LTR390_POS_ALS_UVS_PERSIST,
+								LTR390_MASK_ALS_UVS_PERSIST, int_pers);
+	rslt = shadow_write(LTR390_REG_INT_CFG, dev->shadow.intr, conf_int, 2, dev);
+	if (rslt != LTR390_OK)
+		return rslt;
+
+	/* Kept in the settings so a later configure does not undo it */
+	dev->settings.int_enabled = TRUE;
+	dev->settings.int_src = int_src;
+	dev->settings.int_pers = int_pers;
+
+	chg->pct = pct;
+	chg->min_counts = min_counts;
+	chg->centre = 0;
+	chg->recentres = 0;
+
+	return LTR390_OK;
+}
+
+int8_t ltr390_change_update(struct ltr390_change *chg, const struct ltr390_sample *sample,  struct ltr390_dev *dev)
+{
+	int8_t rslt;
+	uint32_t half;
+	uint32_t low;
+	uint32_t up;
+	uint8_t conf_thres[6];
+
+	if ((chg == NULL) || (sample == NULL))
+		return LTR390_E_NULL_PTR;
+
+	/* Check for null pointer and shadow registers */
+	rslt = shadow_check(dev);
+	if ((rslt != LTR390_OK) || !(sample->flags & LTR390_SAMPLE_FRESH))
+		return rslt;
+
+	/* Only centre on conversions taken with the active configuration */
+	if ((sample->mode != dev->settings.mode) ||
+		(sample->gain_range != dev->settings.gain_range) ||
+		(sample->resolution != dev->settings.resolution) ||
+		(sample->resolution > LTR390_VAL_RES_13_BIT))
+		return LTR390_OK;
+
+	/* +/- pct percent, never narrower than min_counts */
+	half = (uint32_t)(((uint64_t)sample->raw * chg->pct) / 100);
+	if (half < chg->min_counts)
+		half = chg->min_counts;
+	low = (sample->raw > half) ? (sample->raw - half) : 0;
+	up = sample->raw + half;
+	if (up > ltr390_full_scale[sample->resolution])
+		up = ltr390_full_scale[sample->resolution];
+
+	/* Both thresholds in one burst */
+	conf_thres[0] = LTR390_GET_LSB(up);
+	conf_thres[1] = LTR390_GET_MID(up);
+	conf_thres[2] = LTR390_GET_MSB(up);
+	conf_thres[3] = LTR390_GET_LSB(low);
+	conf_thres[4] = LTR390_GET_MID(low);
+	conf_thres[5] = LTR390_GET_MSB(low);
+	rslt = shadow_write(LTR390_REG_ALS_UVS_THRES_UP_0, dev->shadow.thres, conf_thres, 6, dev);
+	if (rslt == LTR390_OK) {
+		dev->settings.int_thresh_up = up;
+		dev->settings.int_thresh_low = low;
+		chg->centre = sample->raw;
+		chg->recentres++;
+	}
+
+	return rslt;
+}
+
+void ltr390_power_init(struct ltr390_dev *dev)
+{
+	if (dev == NULL)
+		return;
+
+	dev->power.active_ua = LTR390_POWER_ACTIVE_UA;
+	dev->power.standby_ua = LTR390_POWER_STANDBY_UA;
+	dev->power.active_us = 0;
+	dev->power.standby_us = 0;
+	dev->power.wakeups = 0;
+	dev->power.last_us = (dev->get_time_us != NULL) ? dev->get_time_us() : 0;
+	dev->power.running = TRUE;
+}
+
+void ltr390_power_account(struct ltr390_dev *dev)
+{
+	uint32_t now_us;
+	uint32_t elapsed_us;
+
+	if ((dev == NULL) || (dev->power.running != TRUE) || (dev->get_time_us == NULL))
+		return;
+
+	/* Unknown state counts as active, the upper bound */
+	now_us = dev->get_time_us();
+	elapsed_us = now_us - dev->power.last_us;
+	if ((dev->shadow.valid == TRUE) && !(dev->shadow.main_ctrl & LTR390_MASK_ALS_UVS_EN))
+		dev->power.standby_us += elapsed_us;
+	else
+		dev->power.active_us += elapsed_us;
+	dev->power.last_us = now_us;
+}
+
+uint32_t ltr390_power_lead_us(const struct ltr390_dev *dev)
+{
+	/* One integration at the current resolution, from wake-up to result */
+	if ((dev == NULL) || (dev->settings.resolution > LTR390_VAL_RES_13_BIT))
+		return 0;
+
+	return conv_time_us[dev->settings.resolution];
+}
+
+int8_t ltr390_power_sample(struct ltr390_sample *sample,  struct ltr390_dev *dev)
+{
+	int8_t rslt;
+	int8_t standby_rslt;
+	uint8_t status;
+	uint32_t lead_us;
+
+	if (sample == NULL)
+		return LTR390_E_NULL_PTR;
+
+	/* Check for null pointer and shadow registers */
+	rslt = shadow_check(dev);
+	if ((rslt == LTR390_OK) && (dev->delay_us == NULL))
+		rslt = LTR390_E_NULL_PTR;
+	if (rslt != LTR390_OK)
+		return rslt;
+
+	lead_us = ltr390_power_lead_us(dev);
+	if (lead_us == 0)
+		return LTR390_E_INVALID_VAL;
+
+	/* Wake up, the enable write starts a new conversion */
+	rslt = ltr390_set_enable(LTR390_VAL_ALS_UVS_ACTIVE, dev);
+	/* Drop a data-ready flag left from before standby */
+	if (rslt == LTR390_OK)
+		rslt = ltr390_get_status(&status, dev);
+	if (rslt == LTR390_OK) {
+		/* One integration time, then poll for the rest of one more */
+		dev->delay_us(lead_us);
+		rslt = ltr390_wait_new_data(sample, lead_us, dev);
+	}
+
+	/* Back to standby even if the read failed */
+	standby_rslt = ltr390_set_enable(LTR390_VAL_ALS_UVS_STANDBY, dev);
+	if (rslt == LTR390_OK)
+		rslt = standby_rslt;
+
+	return rslt;
+}
+
+uint64_t ltr390_power_charge_nc(struct ltr390_dev *dev)
+{
+	if (dev == NULL)
+		return 0;
+
+	/* uA x us is pC */
+	ltr390_power_account(dev);
+
+	return ((dev->power.active_us * dev->power.active_ua) +
+			(dev->power.standby_us * dev->power.standby_ua)) / 1000;
+}
+
+uint32_t ltr390_power_avg_na(struct ltr390_dev *dev)
+{
+	uint64_t charge_nc;
+	uint64_t total_us;
+
+	if (dev == NULL)
+		return 0;
+
+	/* nC / us is mA, scaled to nA */
+	charge_nc = ltr390_power_charge_nc(dev);
+	total_us = dev->power.active_us + dev->power.standby_us;
+	if (total_us == 0)
+		return 0;
+
+	return (uint32_t)((charge_nc * 1000000) / total_us);
+}
+
+uint32_t ltr390_meas_period_us(uint8_t rate, uint8_t resolution)
+{
+	uint32_t period_us = 0;
+
+	if ((rate <= LTR390_VAL_MEAS_RATE_2000_MS) && (resolution <= LTR390_VAL_RES_13_BIT)) {
+		/* A conversion cannot be faster than its integration time */
+		period_us = meas_rate_us[rate];
+		if (conv_time_us[resolution] > period_us)
+			period_us = conv_time_us[resolution];
+	}
+
+	return period_us;
+}
+
 int8_t ltr390_computed_data(uint32_t raw_data, double *computed_data,  struct ltr390_dev *dev)
+{
+	struct ltr390_sample sample;
+
+	if (dev == NULL)
+		return LTR390_E_NULL_PTR;
+
+	/* Conversion taken with the current settings */
+	sample.raw = raw_data;
+	sample.mode = dev->settings.mode;
+	sample.gain_range = dev->settings.gain_range;
+	sample.resolution = dev->settings.resolution;
+	sample.flags = 0;
+
+	return ltr390_computed_sample(&sample, computed_data, dev);
+}
+
+int8_t ltr390_computed_sample(const struct ltr390_sample *sample, double *computed_data,  struct ltr390_dev *dev)
 {
 	int8_t rslt = LTR390_OK;
+	double sensitivity;
 
-	switch (dev->settings.mode)
+	if ((sample == NULL) || (computed_data == NULL) || (dev == NULL))
+		return LTR390_E_NULL_PTR;
+	if ((sample->gain_range > LTR390_VAL_GAIN_RANGE_18) || (sample->resolution > LTR390_VAL_RES_13_BIT))
+		return LTR390_E_INVALID_VAL;
+
+	/* Gain and resolution of the conversion itself, not the current settings */
+	switch (sample->mode)
 	{
 		case LTR390_VAL_UVS_MODE_ALS:
-			*computed_data = (double)((0.6*raw_data)/(a_gain[dev->settings.gain_range]*a_int[dev->settings.resolution]))*dev->settings.w_fac;
+			*computed_data = ((0.6*sample->raw)/(a_gain[sample->gain_range]*a_int[sample->resolution]))*dev->settings.w_fac;
 			break;
 
 		case LTR390_VAL_UVS_MODE_UVS:
-			*computed_data = (double)(raw_data/dev->settings.uv_sensitivity)*dev->settings.w_fac;
+			/* Sensitivity is specified at gain 18x and 20-bit, scale it */
+			sensitivity = (double)dev->settings.uv_sensitivity *
+							(a_gain[sample->gain_range] / 18.) * (a_int[sample->resolution] / 4.);
+			if (sensitivity > 0.)
+				*computed_data = ((double)sample->raw / sensitivity)*dev->settings.w_fac;
+			else
+				rslt = LTR390_E_INVALID_VAL;
 			break;
-		
+
 		default:
 			rslt=LTR390_E_INVALID_VAL;
 			break;
@@ -567,79 +1316,485 @@ int8_t ltr390_computed_data(uint32_t raw_data, double *computed_data,  struct lt
 	return rslt;
 }
 
-static int8_t get_als_data(uint32_t *data,  struct ltr390_dev *dev)
+void ltr390_autorange_init(struct ltr390_autorange *ar,  const struct ltr390_dev *dev)
+{
+	if ((ar == NULL) || (dev == NULL))
+		return;
+
+	ar->gain_min = LTR390_VAL_GAIN_RANGE_1;
+	ar->gain_max = LTR390_VAL_GAIN_RANGE_18;
+	/* Configured resolution, up to 20-bit when starved, down to 16-bit when saturated */
+	ar->res_base = dev->settings.resolution;
+	ar->res_max = LTR390_VAL_RES_20_BIT;
+	ar->res_min = LTR390_VAL_RES_16_BIT;
+	if (ar->res_base > ar->res_min)
+		ar->res_min = ar->res_base;
+	ar->high_pct = LTR390_AUTORANGE_HIGH_PCT;
+	ar->low_pct = LTR390_AUTORANGE_LOW_PCT;
+	ar->switches = 0;
+	ar->saturated = 0;
+}
+
+int8_t ltr390_autorange_update(struct ltr390_autorange *ar, const struct ltr390_sample *sample,  struct ltr390_dev *dev)
+{
+	int8_t rslt;
+	uint8_t gain;
+	uint8_t res;
+	uint8_t g;
+	uint32_t fs;
+	uint32_t target;
+	uint64_t predicted;
+	uint8_t conf_meas[2];
+
+	if ((ar == NULL) || (sample == NULL))
+		return LTR390_E_NULL_PTR;
+	if ((ar->gain_min > ar->gain_max) || (ar->gain_max > LTR390_VAL_GAIN_RANGE_18) ||
+		(ar->res_max > ar->res_base) || (ar->res_base > ar->res_min) ||
+		(ar->res_min > LTR390_VAL_RES_13_BIT) ||
+		(ar->low_pct >= ar->high_pct) || (ar->high_pct > 100))
+		return LTR390_E_INVALID_VAL;
+
+	/* Check for null pointer and shadow registers */
+	rslt = shadow_check(dev);
+	if ((rslt != LTR390_OK) || !(sample->flags & LTR390_SAMPLE_FRESH))
+		return rslt;
+
+	/* Only judge conversions taken with the active configuration */
+	gain = dev->settings.gain_range;
+	res = dev->settings.resolution;
+	if ((sample->gain_range != gain) || (sample->resolution != res) ||
+		(gain > LTR390_VAL_GAIN_RANGE_18) || (res > LTR390_VAL_RES_13_BIT))
+		return LTR390_OK;
+
+	fs = ltr390_full_scale[res];
+	if (sample->raw >= fs)
+		ar->saturated++;
+
+	if (sample->raw >= (uint32_t)(((uint64_t)fs * ar->high_pct) / 100)) {
+		/*
+		 * Too bright: highest gain expected to land mid-range, base
+		 * resolution. Once the gain is at its floor, shorten the
+		 * integration one step at a time down to res_min.
+		 */
+		target = (uint32_t)(((uint64_t)fs * (ar->high_pct + ar->low_pct)) / 200);
+		for (g = gain; g > ar->gain_min; g--) {
+			predicted = ((uint64_t)sample->raw * a_gain[g]) / a_gain[gain];
+			if (predicted <= target)
+				break;
+		}
+		/* Saturated counts only bound the light from below, go straight to the floor */
+		if (sample->raw >= fs)
+			g = ar->gain_min;
+		if ((g != gain) || (res < ar->res_base)) {
+			gain = g;
+			res = ar->res_base;
+		} else if (res < ar->res_min) {
+			res++;
+		}
+	} else if (sample->raw <= (uint32_t)(((uint64_t)fs * ar->low_pct) / 100)) {
+		/* Too dark: back to the base resolution, raise the gain, then the integration time */
+		target = (uint32_t)(((uint64_t)fs * (ar->high_pct + ar->low_pct)) / 200);
+		g = gain;
+		while ((g < ar->gain_max) && (res <= ar->res_base)) {
+			predicted = ((uint64_t)sample->raw * a_gain[g + 1]) / a_gain[gain];
+			if (predicted > target)
+				break;
+			g++;
+		}
+		if (g != gain)
+			gain = g;
+		else if (res > ar->res_max)
+			res--;
+	}
+
+	if ((gain == dev->settings.gain_range) && (res == dev->settings.resolution))
+		return LTR390_OK;
+
+	/* MEAS_RATE and GAIN in one burst */
+	conf_meas[0] = LTR390_SET_BITS(dev->shadow.meas[0], LTR390_POS_ALS_UVS_RES,
+								LTR390_MASK_ALS_UVS_RES, res);
+	conf_meas[1] = LTR390_SET_BITS(dev->shadow.meas[1], LTR390_POS_ALS_UVS_GAIN_RANGE,
+								LTR390_MASK_ALS_UVS_GAIN_RANGE, gain);
+	rslt = shadow_write(LTR390_REG_ALS_UVS_MEAS_RATE, dev->shadow.meas, conf_meas, 2, dev);
+	if (rslt == LTR390_OK) {
+		dev->settings.gain_range = gain;
+		dev->settings.resolution = res;
+		ar->switches++;
+	}
+
+	return rslt;
+}
+
+int8_t ltr390_fixp_prepare(struct ltr390_fixp *fp, const struct ltr390_sample *cfg,  struct ltr390_dev *dev)
+{
+	uint64_t num;
+	uint64_t den;
+	uint8_t shift;
+
+	if ((fp == NULL) || (cfg == NULL) || (dev == NULL))
+		return LTR390_E_NULL_PTR;
+	if ((cfg->gain_range > LTR390_VAL_GAIN_RANGE_18) || (cfg->resolution > LTR390_VAL_RES_13_BIT))
+		return LTR390_E_INVALID_VAL;
+
+	/*
+	 * Scale factor computed once per configuration, conversion is then one
+	 * multiply, add and shift. Outputs match ltr390_computed_sample to
+	 * within one milli-unit over the whole 20-bit raw range: half a
+	 * milli-unit from rounding the result, plus the rounding of the scale
+	 * (half an LSB of Q(shift) per count, at least 30 significant bits).
+	 *
+	 * Integration factor times 8 keeps everything integer:
+	 * ALS: mlux/count = 1000 * 0.6 * w_fac / (gain * int)
+	 * UVS: mUVI/count = 1000 * w_fac / (sens * gain/18 * int/4)
+	 */
+	switch (cfg->mode)
+	{
+		case LTR390_VAL_UVS_MODE_ALS:
+			num = (uint64_t)LTR390_FIXP_UNIT * 6 * 8 * dev->settings.w_fac;
+			den = (uint64_t)10 * a_gain[cfg->gain_range] * int_x8[cfg->resolution];
+			break;
+		case LTR390_VAL_UVS_MODE_UVS:
+			num = (uint64_t)LTR390_FIXP_UNIT * 18 * 32 * dev->settings.w_fac;
+			den = (uint64_t)dev->settings.uv_sensitivity * a_gain[cfg->gain_range] * int_x8[cfg->resolution];
+			break;
+		default:
+			return LTR390_E_INVALID_VAL;
+	}
+	if ((num == 0) || (den == 0))
+		return LTR390_E_INVALID_VAL;
+
+	/* Widest fraction that keeps the scale in 32 bits */
+	shift = LTR390_FIXP_MAX_SHIFT;
+	while ((shift > 1) && (((num << shift) + den / 2) / den > UINT32_MAX))
+		shift--;
+
+	fp->scale = (uint32_t)(((num << shift) + den / 2) / den);
+	fp->round = UINT32_C(1) << (shift - 1);
+	fp->shift = shift;
+
+	return LTR390_OK;
+}
+
+uint32_t ltr390_fixp_convert(uint32_t raw_data, const struct ltr390_fixp *fp)
+{
+	uint64_t out = LTR390_FIXP_APPLY(raw_data, fp);
+
+	return (out > UINT32_MAX) ? UINT32_MAX : (uint32_t)out;
+}
+
+uint32_t ltr390_decode_data(const uint8_t *reg_data, uint8_t resolution)
+{
+	/* Resolution clamped once here, bulk decoders take the mask instead */
+	return LTR390_DECODE_DATA(reg_data, ltr390_full_scale[LTR390_RES_INDEX(resolution)]);
+}
+
+static int8_t get_channel_data(uint8_t reg_addr, uint32_t *data,  struct ltr390_dev *dev)
 {
 	int8_t rslt;
-    uint8_t reg_addr = LTR390_REG_ALS_DATA_0;
 	uint8_t reg_data[3]={0};
 
 	/* Check for null pointer in the device structure*/
-    rslt = null_ptr_check(dev);
+	rslt = null_ptr_check(dev);
 	if (rslt == LTR390_OK) {
 		/* Get register value*/
 		rslt = ltr390_get_regs(reg_addr,reg_data,3,dev);
-		if (rslt == LTR390_OK) {
-			switch(dev->settings.resolution)
-			{
-				case LTR390_VAL_RES_13_BIT:
-					*data=(uint32_t)(((uint32_t)(reg_data[1]<<8)&0x1F00)|(uint32_t)reg_data[0]);
-					break;
-				case LTR390_VAL_RES_16_BIT:
-					*data=(uint32_t)(((uint32_t)(reg_data[1]<<8))|(uint32_t)reg_data[0]);
-					break;
-				case LTR390_VAL_RES_17_BIT:
-					*data=(uint32_t)(((uint32_t)(reg_data[2]<<16)&0x10000)|((uint32_t)(reg_data[1]<<8))|(uint32_t)reg_data[0]);
-					break;
-				case LTR390_VAL_RES_18_BIT:
-					*data=(uint32_t)(((uint32_t)(reg_data[2]<<16)&0x30000)|((uint32_t)(reg_data[1]<<8))|(uint32_t)reg_data[0]);
-					break;
-				case LTR390_VAL_RES_19_BIT:
-					*data=(uint32_t)(((uint32_t)(reg_data[2]<<16)&0x70000)|((uint32_t)(reg_data[1]<<8))|(uint32_t)reg_data[0]);
-					break;
-				default:
-					*data=(uint32_t)(((uint32_t)(reg_data[2]<<16)&0xF0000)|((uint32_t)(reg_data[1]<<8))|(uint32_t)reg_data[0]);
-					break;
-			}
-		}
+		if (rslt == LTR390_OK)
+			*data = ltr390_decode_data(reg_data, dev->settings.resolution);
 	}
 
 	return rslt;
 }
 
-static int8_t get_uvs_data(uint32_t *data,  struct ltr390_dev *dev)
+static int8_t poll_job(uint8_t *status, uint32_t *data,  struct ltr390_dev *dev)
+{
+	int8_t rslt;
+	struct ltr390_bus_op ops[2];
+	uint8_t reg_data[3] = {0};
+	uint8_t reg_addr;
+
+	switch (dev->settings.mode)
+	{
+		case LTR390_VAL_UVS_MODE_ALS:
+			reg_addr = LTR390_REG_ALS_DATA_0;
+			break;
+		case LTR390_VAL_UVS_MODE_UVS:
+			reg_addr = LTR390_REG_UVS_DATA_0;
+			break;
+		default:
+			return LTR390_E_INVALID_VAL;
+	}
+
+	/* MAIN_STATUS and the active channel, status bits are cleared by the read */
+	bus_op_init(&ops[0], LTR390_BUS_READ, LTR390_REG_MAIN_STATUS, status, 1, dev);
+	bus_op_init(&ops[1], LTR390_BUS_READ, reg_addr, reg_data, 3, dev);
+	rslt = ltr390_bus_submit(ops, 2, dev);
+	if (rslt == LTR390_OK) {
+		*data = ltr390_decode_data(reg_data, dev->settings.resolution);
+		/* Brownout: the sensor lost its configuration */
+		if (*status & LTR390_MASK_ALS_UVS_PWR_ON_STAT)
+			rslt = por_recover(dev);
+	}
+
+	return rslt;
+}
+
+static void bus_op_init(struct ltr390_bus_op *op, uint8_t dir, uint8_t reg_addr, uint8_t *buf, uint16_t len, const struct ltr390_dev *dev)
+{
+	/* Same addressing as the read/write callbacks */
+	if (dir == LTR390_BUS_READ)
+		op->addr = (uint8_t)((dev->dev_id<<1)|0x01);
+	else
+		op->addr = (uint8_t)(dev->dev_id<<1);
+	op->reg_addr = reg_addr;
+	op->dir = dir;
+	op->buf = buf;
+	op->len = len;
+	op->rslt = LTR390_E_COMM_FAIL;
+}
+
+static int8_t dual_switch(uint8_t mode, uint8_t gain_range, uint8_t resolution, struct ltr390_dev *dev)
+{
+	int8_t rslt = LTR390_OK;
+	uint8_t reg_addr = LTR390_REG_MAIN_CTRL;
+	uint8_t meas[2];
+	uint8_t main_ctrl;
+
+	if ((gain_range > LTR390_VAL_GAIN_RANGE_18) || (resolution > LTR390_VAL_RES_13_BIT))
+		return LTR390_E_INVALID_VAL;
+
+	/* Channel gain/resolution, only written when they differ */
+	meas[0] = LTR390_SET_BITS(dev->shadow.meas[0], LTR390_POS_ALS_UVS_RES,
+							LTR390_MASK_ALS_UVS_RES, resolution);
+	meas[1] = LTR390_SET_BITS(dev->shadow.meas[1], LTR390_POS_ALS_UVS_GAIN_RANGE,
+							LTR390_MASK_ALS_UVS_GAIN_RANGE, gain_range);
+	if ((meas[0] != dev->shadow.meas[0]) || (meas[1] != dev->shadow.meas[1]))
+		rslt = shadow_write(LTR390_REG_ALS_UVS_MEAS_RATE, dev->shadow.meas, meas, 2, dev);
+
+	/* Channel switch, always written as it restarts the conversion */
+	if (rslt == LTR390_OK) {
+		main_ctrl = LTR390_SET_BITS(dev->shadow.main_ctrl, LTR390_POS_UVS_MODE,
+									LTR390_MASK_UVS_MODE, mode);
+		main_ctrl = LTR390_SET_BITS(main_ctrl, LTR390_POS_ALS_UVS_EN,
+									LTR390_MASK_ALS_UVS_EN, LTR390_VAL_ALS_UVS_ACTIVE);
+		rslt = ltr390_set_regs(&reg_addr, &main_ctrl, 1, dev);
+		if (rslt == LTR390_OK)
+			dev->shadow.main_ctrl = main_ctrl;
+	}
+	if (rslt != LTR390_OK)
+		return rslt;
+
+	dev->settings.mode = mode;
+	dev->settings.gain_range = gain_range;
+	dev->settings.resolution = resolution;
+
+	return LTR390_OK;
+}
+
+static int8_t dual_acquire(uint8_t mode, struct ltr390_sample *sample, struct ltr390_dev *dev)
+{
+	int8_t rslt;
+	const struct ltr390_chan_cfg *cfg = &dev->dual[mode];
+	uint8_t status;
+
+	rslt = dual_switch(mode, cfg->gain_range, cfg->resolution, dev);
+	if (rslt != LTR390_OK)
+		return rslt;
+
+	/* Drop a data-ready flag left by the previous channel */
+	rslt = ltr390_get_status(&status, dev);
+	if (rslt != LTR390_OK)
+		return rslt;
+
+	/*
+	 * One integration time, then a poll. A slow sensor clock gets a
+	 * single retry a quarter conversion later, not a second conversion.
+	 */
+	dev->delay_us(conv_time_us[cfg->resolution]);
+
+	return ltr390_wait_new_data(sample, conv_time_us[cfg->resolution] / LTR390_DATA_POLL_DIV, dev);
+}
+
+static int8_t shadow_check(struct ltr390_dev *dev)
 {
 	int8_t rslt;
-    uint8_t reg_addr= LTR390_REG_UVS_DATA_0;
-	uint8_t reg_data[3]={0};
 
 	/* Check for null pointer in the device structure*/
-    rslt = null_ptr_check(dev);
+	rslt = null_ptr_check(dev);
+	/* Fetch the registers from the sensor once if needed */
+	if ((rslt == LTR390_OK) && (dev->shadow.valid != TRUE))
+		rslt = ltr390_sync_regs(dev);
+
+	return rslt;
+}
+
+static int8_t shadow_write(uint8_t reg_addr, uint8_t *shadow_reg, const uint8_t *reg_data, uint8_t len, struct ltr390_dev *dev)
+{
+	int8_t rslt = LTR390_OK;
+	uint8_t buf[LTR390_MAX_BURST_LEN];
+
+	if ((len == 0) || (len > LTR390_MAX_BURST_LEN))
+		return LTR390_E_INVALID_LEN;
+
+	if (ltr390_shadow_dirty(shadow_reg, reg_data, len, dev) == TRUE) {
+		memcpy(buf, reg_data, len);
+		rslt = ltr390_set_regs(&reg_addr, buf, len, dev);
+		if (rslt == LTR390_OK)
+			memcpy(shadow_reg, buf, len);
+	}
+
+	return rslt;
+}
+
+static uint8_t block_differs(const uint8_t *a, const uint8_t *b, uint8_t len)
+{
+	return (memcmp(a, b, len) != 0) ? TRUE : FALSE;
+}
+
+static void shadow_load_defaults(struct ltr390_shadow *shadow)
+{
+	shadow->main_ctrl = LTR390_DEF_MAIN_CTRL;
+	shadow->meas[0] = LTR390_DEF_ALS_UVS_MEAS_RATE;
+	shadow->meas[1] = LTR390_DEF_ALS_UVS_GAIN;
+	shadow->intr[0] = LTR390_DEF_INT_CFG;
+	shadow->intr[1] = LTR390_DEF_INT_PST;
+	shadow->thres[0] = LTR390_GET_LSB(LTR390_DEF_ALS_UVS_THRES_UP);
+	shadow->thres[1] = LTR390_GET_MID(LTR390_DEF_ALS_UVS_THRES_UP);
+	shadow->thres[2] = LTR390_GET_MSB(LTR390_DEF_ALS_UVS_THRES_UP);
+	shadow->thres[3] = LTR390_GET_LSB(LTR390_DEF_ALS_UVS_THRES_LOW);
+	shadow->thres[4] = LTR390_GET_MID(LTR390_DEF_ALS_UVS_THRES_LOW);
+	shadow->thres[5] = LTR390_GET_MSB(LTR390_DEF_ALS_UVS_THRES_LOW);
+	shadow->valid = TRUE;
+}
+
+static int8_t por_recover(struct ltr390_dev *dev)
+{
+	int8_t rslt = LTR390_OK;
+
+	LTR390_POR_ADD(dev, events, 1);
+	/* Registers never known, nothing to replay */
+	if (dev->shadow.valid != TRUE)
+		return rslt;
+
+	rslt = ltr390_restore(dev);
+	if (rslt == LTR390_OK)
+		LTR390_POR_ADD(dev, restored, 1);
+	else
+		LTR390_POR_ADD(dev, failed, 1);
+
+	return rslt;
+}
+
+#ifdef LTR390_ENABLE_STATS
+static uint32_t stats_begin(struct ltr390_dev *dev, uint8_t dir, uint8_t reg_addr, uint8_t len)
+{
+	if (dev->stats.trace != NULL)
+		dev->stats.trace(dev->dev_id, LTR390_TRACE_BEGIN, dir, reg_addr, len, LTR390_OK, dev->stats.trace_ctx);
+
+	return (dev->get_time_us != NULL) ? dev->get_time_us() : 0;
+}
+
+static void stats_end(struct ltr390_dev *dev, uint8_t dir, uint8_t reg_addr, uint8_t len, int8_t rslt, uint32_t start_us)
+{
+	struct ltr390_stats *stats = &dev->stats;
+	uint32_t lat_us;
+	uint32_t t;
+	uint8_t bin = 0;
+
+	if (dir == LTR390_TRACE_READ) {
+		stats->reads++;
+		if (rslt == LTR390_OK)
+			stats->bytes_read += len;
+	} else {
+		stats->writes++;
+		if (rslt == LTR390_OK)
+			stats->bytes_written += len;
+	}
+	stats_error(dev, rslt);
+
+	if (dev->get_time_us != NULL) {
+		lat_us = dev->get_time_us() - start_us;
+		if ((stats->lat_count == 0) || (lat_us < stats->lat_min_us))
+			stats->lat_min_us = lat_us;
+		if (lat_us > stats->lat_max_us)
+			stats->lat_max_us = lat_us;
+		stats->lat_sum_us += lat_us;
+		stats->lat_count++;
+		/* Logarithmic bins, 4x wider each */
+		t = lat_us >> LTR390_STATS_HIST_BASE_SHIFT;
+		while ((t != 0) && (bin < LTR390_STATS_HIST_BINS - 1)) {
+			t >>= 2;
+			bin++;
+		}
+		stats->lat_hist[bin]++;
+	}
+
+	if (stats->trace != NULL)
+		stats->trace(dev->dev_id, LTR390_TRACE_END, dir, reg_addr, len, rslt, stats->trace_ctx);
+}
+
+static void stats_error(struct ltr390_dev *dev, int8_t rslt)
+{
+	if ((rslt < 0) && (rslt >= -LTR390_STATS_ERR_COUNT))
+		dev->stats.errors[-rslt - 1]++;
+}
+#endif
+
+static int8_t settings_to_image(const struct ltr390_settings *settings, const struct ltr390_dev *dev, struct ltr390_shadow *image)
+{
+	int8_t rslt = LTR390_OK;
+
+	/* Bits not driven by the settings keep their known (or power-on) values */
+	if (dev->shadow.valid == TRUE)
+		*image = dev->shadow;
+	else
+		shadow_load_defaults(image);
+
+	/* Control input values */
+	if ((settings->mode > LTR390_VAL_UVS_MODE_UVS) ||
+		(settings->rate > LTR390_VAL_MEAS_RATE_2000_MS) ||
+		(settings->resolution > LTR390_VAL_RES_13_BIT) ||
+		(settings->gain_range > LTR390_VAL_GAIN_RANGE_18) ||
+		(settings->int_enabled > TRUE))
+		rslt = LTR390_E_INVALID_VAL;
+
+	if ((rslt == LTR390_OK) && (settings->int_enabled == TRUE)) {
+		if (((settings->int_src != LTR390_VAL_LS_INT_SEL_ALS) &&
+			(settings->int_src != LTR390_VAL_LS_INT_SEL_UVS)) ||
+			(settings->int_pers > LTR390_VAL_ALS_UVS_TRIG_INT_16_CONS))
+			rslt = LTR390_E_INVALID_VAL;
+	}
+
 	if (rslt == LTR390_OK) {
-		/* Get register value*/
-		rslt = ltr390_get_regs(reg_addr,reg_data,3,dev);
-		if (rslt == LTR390_OK) {
-			switch(dev->settings.resolution)
-			{
-				case LTR390_VAL_RES_13_BIT:
-					*data=(uint32_t)(((uint32_t)(reg_data[1]<<8)&0x1F00)|(uint32_t)reg_data[0]);
-					break;
-				case LTR390_VAL_RES_16_BIT:
-					*data=(uint32_t)(((uint32_t)(reg_data[1]<<8))|(uint32_t)reg_data[0]);
-					break;
-				case LTR390_VAL_RES_17_BIT:
-					*data=(uint32_t)(((uint32_t)(reg_data[2]<<16)&0x10000)|((uint32_t)(reg_data[1]<<8))|(uint32_t)reg_data[0]);
-					break;
-				case LTR390_VAL_RES_18_BIT:
-					*data=(uint32_t)(((uint32_t)(reg_data[2]<<16)&0x30000)|((uint32_t)(reg_data[1]<<8))|(uint32_t)reg_data[0]);
-					break;
-				case LTR390_VAL_RES_19_BIT:
-					*data=(uint32_t)(((uint32_t)(reg_data[2]<<16)&0x70000)|((uint32_t)(reg_data[1]<<8))|(uint32_t)reg_data[0]);
-					break;
-				default:
-					*data=(uint32_t)(((uint32_t)(reg_data[2]<<16)&0xF0000)|((uint32_t)(reg_data[1]<<8))|(uint32_t)reg_data[0]);
-					break;
-			}
+		/* MAIN_CTRL: mode and sensor active */
+		image->main_ctrl = LTR390_SET_BITS(image->main_ctrl, LTR390_POS_UVS_MODE,
+								LTR390_MASK_UVS_MODE, settings->mode);
+		image->main_ctrl = LTR390_SET_BITS(image->main_ctrl, LTR390_POS_ALS_UVS_EN,
+								LTR390_MASK_ALS_UVS_EN, LTR390_VAL_ALS_UVS_ACTIVE);
+		/* ALS_UVS_MEAS_RATE and ALS_UVS_GAIN */
+		image->meas[0] = LTR390_SET_BITS(image->meas[0], LTR390_POS_ALS_UVS_MEAS_RATE,
+								LTR390_MASK_ALS_UVS_MEAS_RATE, settings->rate);
+		image->meas[0] = LTR390_SET_BITS(image->meas[0], LTR390_POS_ALS_UVS_RES,
+								LTR390_MASK_ALS_UVS_RES, settings->resolution);
+		image->meas[1] = LTR390_SET_BITS(image->meas[1], LTR390_POS_ALS_UVS_GAIN_RANGE,
+								LTR390_MASK_ALS_UVS_GAIN_RANGE, settings->gain_range);
+		/* INT_CFG */
+		image->intr[0] = LTR390_SET_BITS(image->intr[0], LTR390_POS_LS_INT_EN,
+								LTR390_MASK_LS_INT_EN,
+								(settings->int_enabled==TRUE?LTR390_VAL_LS_INT_EN:LTR390_VAL_LS_INT_DIS));
+		/* Interrupt source, persist and thresholds only if interrupt enabled */
+		if (settings->int_enabled == TRUE) {
+			image->intr[0] = LTR390_SET_BITS(image->intr[0], LTR390_POS_LS_INT_SEL,
+									LTR390_MASK_LS_INT_SEL, settings->int_src);
+			image->intr[1] = LTR390_SET_BITS(image->intr[1], LTR390_POS_ALS_UVS_PERSIST,
+									LTR390_MASK_ALS_UVS_PERSIST, settings->int_pers);
+			image->thres[0] = LTR390_GET_LSB(settings->int_thresh_up);
+			image->thres[1] = LTR390_GET_MID(settings->int_thresh_up);
+			image->thres[2] = LTR390_GET_MSB(settings->int_thresh_up);
+			image->thres[3] = LTR390_GET_LSB(settings->int_thresh_low);
+			image->thres[4] = LTR390_GET_MID(settings->int_thresh_low);
+			image->thres[5] = LTR390_GET_MSB(settings->int_thresh_low);
 		}
+		image->valid = TRUE;
 	}
 
 	return rslt;
@@ -649,7 +1804,7 @@ static int8_t null_ptr_check( struct ltr390_dev *dev)
 {
 	int8_t rslt;
 
-	if ((dev == NULL) || (dev->read == NULL) || (dev->write == NULL)) {
+	if ((dev == NULL) || ((dev->xfer == NULL) && ((dev->read == NULL) || (dev->write == NULL)))) {
 		/* Device structure pointer is not valid */
 		rslt = LTR390_E_NULL_PTR;
 	} else {
@@ -29,14 +29,34 @@ int8_t ltr390_get_regs(uint8_t reg_addr, uint8_t *reg_data, uint8_t len, struct
 
 int8_t ltr390_set_regs(uint8_t *reg_addr,  uint8_t *reg_data, uint8_t len, struct ltr390_dev *dev);
 
+int8_t ltr390_bus_submit(struct ltr390_bus_op *ops, uint8_t count, struct ltr390_dev *dev);
+
 int8_t ltr390_init(struct ltr390_dev *dev);
 
 int8_t ltr390_configure(struct ltr390_dev *dev);
 
+int8_t ltr390_prepare_image(struct ltr390_shadow *image,  struct ltr390_dev *dev);
+
+uint8_t *ltr390_cfg_block(struct ltr390_shadow *shadow, uint8_t blk, uint8_t *reg_addr, uint8_t *len);
+
+void ltr390_reset_shadow(struct ltr390_dev *dev);
+
+uint8_t ltr390_shadow_dirty(const uint8_t *shadow_reg, const uint8_t *reg_data, uint8_t len, const struct ltr390_dev *dev);
+
+void ltr390_reset_dual(struct ltr390_dev *dev);
+
+void ltr390_default_image(struct ltr390_shadow *image);
+
+int8_t ltr390_restore(struct ltr390_dev *dev);
+
 int8_t ltr390_soft_reset( struct ltr390_dev *dev);
 
+int8_t ltr390_sync_regs(struct ltr390_dev *dev);
+
 int8_t ltr390_set_mode(uint8_t mode,  struct ltr390_dev *dev);
 
+int8_t ltr390_set_enable(uint8_t enable,  struct ltr390_dev *dev);
+
 int8_t ltr390_set_rate(uint8_t rate,  struct ltr390_dev *dev);
 
 int8_t ltr390_set_resolution(uint8_t resolution,  struct ltr390_dev *dev);
@@ -55,6 +75,58 @@ int8_t ltr390_set_thresh_up(uint32_t int_thresh_up,  struct ltr390_dev *dev);
 
 int8_t ltr390_get_raw_data(uint32_t *data,  struct ltr390_dev *dev);
 
+int8_t ltr390_get_status(uint8_t *status,  struct ltr390_dev *dev);
+
+int8_t ltr390_get_new_data(struct ltr390_sample *sample,  struct ltr390_dev *dev);
+
+int8_t ltr390_wait_new_data(struct ltr390_sample *sample, uint32_t timeout_us,  struct ltr390_dev *dev);
+
+int8_t ltr390_get_frame(struct ltr390_frame *frame,  struct ltr390_dev *dev);
+
+void ltr390_decode_frame(struct ltr390_frame *frame, const uint8_t *reg_data,  const struct ltr390_dev *dev);
+
+int8_t ltr390_set_dual_cfg(uint8_t mode, uint8_t gain_range, uint8_t resolution,  struct ltr390_dev *dev);
+
+int8_t ltr390_get_pair(struct ltr390_pair *pair,  struct ltr390_dev *dev);
+
+int8_t ltr390_change_init(struct ltr390_change *chg, uint8_t pct, uint32_t min_counts, uint8_t int_pers,  struct ltr390_dev *dev);
+
+int8_t ltr390_change_update(struct ltr390_change *chg, const struct ltr390_sample *sample,  struct ltr390_dev *dev);
+
+void ltr390_power_init(struct ltr390_dev *dev);
+
+void ltr390_power_account(struct ltr390_dev *dev);
+
+uint32_t ltr390_power_lead_us(const struct ltr390_dev *dev);
+
+int8_t ltr390_power_sample(struct ltr390_sample *sample,  struct ltr390_dev *dev);
+
+uint64_t ltr390_power_charge_nc(struct ltr390_dev *dev);
+
+uint32_t ltr390_power_avg_na(struct ltr390_dev *dev);
+
+uint32_t ltr390_meas_period_us(uint8_t rate, uint8_t resolution);
+
 int8_t ltr390_computed_data(uint32_t raw_data, double *computed_data,  struct ltr390_dev *dev);
 
+int8_t ltr390_computed_sample(const struct ltr390_sample *sample, double *computed_data,  struct ltr390_dev *dev);
+
+void ltr390_autorange_init(struct ltr390_autorange *ar,  const struct ltr390_dev *dev);
+
+int8_t ltr390_autorange_update(struct ltr390_autorange *ar, const struct ltr390_sample *sample,  struct ltr390_dev *dev);
+
+int8_t ltr390_fixp_prepare(struct ltr390_fixp *fp, const struct ltr390_sample *cfg,  struct ltr390_dev *dev);
+
+uint32_t ltr390_fixp_convert(uint32_t raw_data, const struct ltr390_fixp *fp);
+
+uint32_t ltr390_decode_data(const uint8_t *reg_data, uint8_t resolution);
+
+/* Full-scale counts, also the data register masks, indexed by LTR390_VAL_RES_xxx */
+extern const uint32_t ltr390_full_scale[LTR390_VAL_RES_13_BIT + 1];
+
+static inline uint32_t ltr390_data_mask(uint8_t resolution)
+{
+	return ltr390_full_scale[LTR390_RES_INDEX(resolution)];
+}
+
 #endif /* LTR390_H_ */ 
\ No newline at end of file
@@ -0,0 +1,345 @@
+/*
+ * This file is part of the LTR-390-UV-01 library (https://github.com/Cplaton/ltr390).
+ * Copyright (c) 2021 Clement Platon.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * C++ (14 or later) wrapper for firmware with a fixed sensor configuration.
+ *
+ * The configuration is a template parameter: invalid settings fail to
+ * compile, the register image and the conversion factors are constants,
+ * configure is a fixed sequence of bursts and the read path does not
+ * branch on the settings. The C API stays reachable through dev() and
+ * sees a shadow and settings consistent with what configure wrote.
+ *
+ * Transport is a type with static read and write functions matching
+ * ltr390_com_fptr_t, and optionally static delay_us and xfer functions
+ * (ltr390_xfer_fptr_t, called with a null context).
+ */
+
+#ifndef LTR390_HPP_
+#define LTR390_HPP_
+
+/********************************************************/
+/* header includes */
+extern "C" {
+#include "ltr390uv.h"
+}
+
+namespace ltr390 {
+
+
+/********************************************************/
+/*                   Configuration                      */
+/********************************************************/
+
+template <uint8_t Mode,
+	uint8_t Rate = LTR390_VAL_MEAS_RATE_100_MS,
+	uint8_t Resolution = LTR390_VAL_RES_18_BIT,
+	uint8_t GainRange = LTR390_VAL_GAIN_RANGE_3,
+	bool IntEnabled = false,
+	uint8_t IntSrc = LTR390_VAL_LS_INT_SEL_ALS,
+	uint8_t IntPers = LTR390_VAL_ALS_UVS_TRIG_INT_ALL,
+	uint32_t ThreshLow = LTR390_DEF_ALS_UVS_THRES_LOW,
+	uint32_t ThreshUp = LTR390_DEF_ALS_UVS_THRES_UP,
+	uint8_t WFac = LTR390_UVS_WFAC_NO_WINDOW,
+	uint16_t UvSensitivity = LTR390_UVS_SENSITIVITY>
+struct Config {
+	static constexpr uint8_t mode = Mode;
+	static constexpr uint8_t rate = Rate;
+	static constexpr uint8_t resolution = Resolution;
+	static constexpr uint8_t gain_range = GainRange;
+	static constexpr bool int_enabled = IntEnabled;
+	static constexpr uint8_t int_src = IntSrc;
+	static constexpr uint8_t int_pers = IntPers;
+	static constexpr uint32_t int_thresh_low = ThreshLow;
+	static constexpr uint32_t int_thresh_up = ThreshUp;
+	static constexpr uint8_t w_fac = WFac;
+	static constexpr uint16_t uv_sensitivity = UvSensitivity;
+
+	static_assert(Mode <= LTR390_VAL_UVS_MODE_UVS, "invalid mode");
+	static_assert(Rate <= LTR390_VAL_MEAS_RATE_2000_MS, "invalid measurement rate");
+	static_assert(Resolution <= LTR390_VAL_RES_13_BIT, "invalid resolution");
+	static_assert(GainRange <= LTR390_VAL_GAIN_RANGE_18, "invalid gain range");
+	/* What ltr390_configure would force in UVS mode */
+	static_assert((Mode != LTR390_VAL_UVS_MODE_UVS) ||
+		((Resolution == LTR390_VAL_RES_20_BIT) && (GainRange == LTR390_VAL_GAIN_RANGE_18) &&
+		(Rate >= LTR390_VAL_MEAS_RATE_500_MS)),
+		"UVS mode needs 20-bit resolution, gain 18 and a rate of 500 ms or more");
+	static_assert((IntSrc == LTR390_VAL_LS_INT_SEL_ALS) || (IntSrc == LTR390_VAL_LS_INT_SEL_UVS),
+		"invalid interrupt source");
+	static_assert(IntPers <= LTR390_VAL_ALS_UVS_TRIG_INT_16_CONS, "invalid interrupt persist");
+	static_assert((ThreshUp <= 0xFFFFF) && (ThreshLow <= ThreshUp), "invalid interrupt thresholds");
+	static_assert((WFac != 0) && (UvSensitivity != 0), "invalid conversion factors");
+};
+
+/* UVS mode with the settings it requires */
+template <uint8_t Rate = LTR390_VAL_MEAS_RATE_500_MS,
+	bool IntEnabled = false,
+	uint8_t IntPers = LTR390_VAL_ALS_UVS_TRIG_INT_ALL,
+	uint32_t ThreshLow = LTR390_DEF_ALS_UVS_THRES_LOW,
+	uint32_t ThreshUp = LTR390_DEF_ALS_UVS_THRES_UP,
+	uint8_t WFac = LTR390_UVS_WFAC_NO_WINDOW,
+	uint16_t UvSensitivity = LTR390_UVS_SENSITIVITY>
+using UvsConfig = Config<LTR390_VAL_UVS_MODE_UVS, Rate, LTR390_VAL_RES_20_BIT,
+	LTR390_VAL_GAIN_RANGE_18, IntEnabled, LTR390_VAL_LS_INT_SEL_UVS, IntPers,
+	ThreshLow, ThreshUp, WFac, UvSensitivity>;
+
+
+/********************************************************/
+/*                  Derived constants                   */
+/********************************************************/
+
+template <class Config>
+struct Traits {
+	/* Register image, same layout as struct ltr390_shadow */
+	static constexpr uint8_t main_ctrl =
+		LTR390_SET_BITS(LTR390_SET_BITS(LTR390_DEF_MAIN_CTRL, LTR390_POS_UVS_MODE,
+			LTR390_MASK_UVS_MODE, Config::mode),
+			LTR390_POS_ALS_UVS_EN, LTR390_MASK_ALS_UVS_EN, LTR390_VAL_ALS_UVS_ACTIVE);
+
+	static constexpr uint8_t meas_rate =
+		LTR390_SET_BITS(LTR390_SET_BITS(LTR390_DEF_ALS_UVS_MEAS_RATE, LTR390_POS_ALS_UVS_MEAS_RATE,
+			LTR390_MASK_ALS_UVS_MEAS_RATE, Config::rate),
+			LTR390_POS_ALS_UVS_RES, LTR390_MASK_ALS_UVS_RES, Config::resolution);
+
+	static constexpr uint8_t gain =
+		LTR390_SET_BITS(LTR390_DEF_ALS_UVS_GAIN, LTR390_POS_ALS_UVS_GAIN_RANGE,
+			LTR390_MASK_ALS_UVS_GAIN_RANGE, Config::gain_range);
+
+	/* Source, persist and thresholds keep their power-on values when disabled */
+	static constexpr uint8_t int_cfg = Config::int_enabled ?
+		LTR390_SET_BITS(LTR390_SET_BITS(LTR390_DEF_INT_CFG, LTR390_POS_LS_INT_SEL,
+			LTR390_MASK_LS_INT_SEL, Config::int_src),
+			LTR390_POS_LS_INT_EN, LTR390_MASK_LS_INT_EN, LTR390_VAL_LS_INT_EN) :
+		LTR390_SET_BITS(LTR390_DEF_INT_CFG, LTR390_POS_LS_INT_EN,
+			LTR390_MASK_LS_INT_EN, LTR390_VAL_LS_INT_DIS);
+
+	static constexpr uint8_t int_pst = Config::int_enabled ?
+		LTR390_SET_BITS(LTR390_DEF_INT_PST, LTR390_POS_ALS_UVS_PERSIST,
+			LTR390_MASK_ALS_UVS_PERSIST, Config::int_pers) :
+		LTR390_DEF_INT_PST;
+
+	static constexpr uint32_t thresh_up = Config::int_enabled ?
+		Config::int_thresh_up : LTR390_DEF_ALS_UVS_THRES_UP;
+
+	static constexpr uint32_t thresh_low = Config::int_enabled ?
+		Config::int_thresh_low : LTR390_DEF_ALS_UVS_THRES_LOW;
+
+	/* Data registers of the active channel, 2 bytes cover 16-bit and 13-bit */
+	static constexpr uint8_t data_reg = (Config::mode == LTR390_VAL_UVS_MODE_UVS) ?
+		LTR390_REG_UVS_DATA_0 : LTR390_REG_ALS_DATA_0;
+
+	static constexpr uint8_t data_len = (Config::resolution >= LTR390_VAL_RES_16_BIT) ? 2 : 3;
+
+	static constexpr uint32_t data_mask = UINT32_C(0xFFFFF) >>
+		((Config::resolution == LTR390_VAL_RES_13_BIT) ? 7 : Config::resolution);
+
+	/* Conversion as num / den per count, see ltr390_fixp_prepare */
+	static constexpr uint8_t gain_factor(uint8_t gain_range)
+	{
+		return (gain_range == LTR390_VAL_GAIN_RANGE_1) ? 1 :
+			(gain_range == LTR390_VAL_GAIN_RANGE_3) ? 3 :
+			(gain_range == LTR390_VAL_GAIN_RANGE_6) ? 6 :
+			(gain_range == LTR390_VAL_GAIN_RANGE_9) ? 9 : 18;
+	}
+
+	static constexpr uint8_t int_x8 = UINT8_C(32) >> Config::resolution;
+
+	static constexpr uint64_t num = (Config::mode == LTR390_VAL_UVS_MODE_UVS) ?
+		(uint64_t)LTR390_FIXP_UNIT * 18 * 32 * Config::w_fac :
+		(uint64_t)LTR390_FIXP_UNIT * 6 * 8 * Config::w_fac;
+
+	static constexpr uint64_t den = (Config::mode == LTR390_VAL_UVS_MODE_UVS) ?
+		(uint64_t)Config::uv_sensitivity * gain_factor(Config::gain_range) * int_x8 :
+		(uint64_t)10 * gain_factor(Config::gain_range) * int_x8;
+
+	/* Lux or UVI per count */
+	static constexpr double scale = (double)num / ((double)den * LTR390_FIXP_UNIT);
+
+	static constexpr uint8_t fixp_shift_for(uint8_t shift)
+	{
+		while ((shift > 1) && (((num << shift) + den / 2) / den > UINT32_MAX))
+			shift--;
+
+		return shift;
+	}
+
+	/* milli-lux or milli-UVI per count in Q(fixp_shift) */
+	static constexpr uint8_t fixp_shift = fixp_shift_for(LTR390_FIXP_MAX_SHIFT);
+
+	static constexpr uint32_t fixp_scale = (uint32_t)(((num << fixp_shift) + den / 2) / den);
+
+	static constexpr uint32_t fixp_round = UINT32_C(1) << (fixp_shift - 1);
+};
+
+
+/********************************************************/
+/*                        Sensor                        */
+/********************************************************/
+
+template <class Transport, class Config>
+class Sensor {
+public:
+	typedef Traits<Config> traits;
+
+	explicit Sensor(uint8_t dev_id = LTR390_I2C_ADDR_BASE)
+		: dev_()
+	{
+		dev_.dev_id = dev_id;
+		dev_.read = Transport::read;
+		dev_.write = Transport::write;
+		dev_.delay_us = delay_hook<Transport>(0);
+		dev_.xfer = xfer_hook<Transport>(0);
+		dev_.settings.mode = Config::mode;
+		dev_.settings.rate = Config::rate;
+		dev_.settings.resolution = Config::resolution;
+		dev_.settings.gain_range = Config::gain_range;
+		dev_.settings.int_enabled = Config::int_enabled ? TRUE : FALSE;
+		dev_.settings.int_src = Config::int_src;
+		dev_.settings.int_pers = Config::int_pers;
+		dev_.settings.int_thresh_low = Config::int_thresh_low;
+		dev_.settings.int_thresh_up = Config::int_thresh_up;
+		dev_.settings.w_fac = Config::w_fac;
+		dev_.settings.uv_sensitivity = Config::uv_sensitivity;
+	}
+
+	/* Part id check and soft reset */
+	int8_t init()
+	{
+		return ltr390_init(&dev_);
+	}
+
+	/* Same bursts and order as ltr390_configure, sensor enabled last */
+	int8_t configure()
+	{
+		int8_t rslt;
+		uint8_t reg;
+		uint8_t meas[2] = {traits::meas_rate, traits::gain};
+		uint8_t intr[2] = {traits::int_cfg, traits::int_pst};
+		uint8_t thres[6] = {
+			LTR390_GET_LSB(traits::thresh_up), LTR390_GET_MID(traits::thresh_up),
+			LTR390_GET_MSB(traits::thresh_up), LTR390_GET_LSB(traits::thresh_low),
+			LTR390_GET_MID(traits::thresh_low), LTR390_GET_MSB(traits::thresh_low)};
+		uint8_t main_ctrl = traits::main_ctrl;
+
+		dev_.shadow.valid = FALSE;
+
+		reg = LTR390_REG_ALS_UVS_MEAS_RATE;
+		rslt = ltr390_set_regs(&reg, meas, 2, &dev_);
+		if (rslt == LTR390_OK) {
+			reg = LTR390_REG_INT_CFG;
+			rslt = ltr390_set_regs(&reg, intr, 2, &dev_);
+		}
+		if (rslt == LTR390_OK) {
+			reg = LTR390_REG_ALS_UVS_THRES_UP_0;
+			rslt = ltr390_set_regs(&reg, thres, 6, &dev_);
+		}
+		if (rslt == LTR390_OK) {
+			reg = LTR390_REG_MAIN_CTRL;
+			rslt = ltr390_set_regs(&reg, &main_ctrl, 1, &dev_);
+		}
+
+		/* Keep the C API view of the registers in step */
+		if (rslt == LTR390_OK) {
+			dev_.shadow.main_ctrl = main_ctrl;
+			dev_.shadow.meas[0] = meas[0];
+			dev_.shadow.meas[1] = meas[1];
+			dev_.shadow.intr[0] = intr[0];
+			dev_.shadow.intr[1] = intr[1];
+			for (uint8_t i = 0; i < 6; i++)
+				dev_.shadow.thres[i] = thres[i];
+			dev_.shadow.valid = TRUE;
+		}
+
+		return rslt;
+	}
+
+	/* Active channel counts, without checking for a new conversion */
+	int8_t read_raw(uint32_t &raw)
+	{
+		uint8_t reg_data[3] = {0, 0, 0};
+		int8_t rslt;
+
+		rslt = ltr390_get_regs(traits::data_reg, reg_data, traits::data_len, &dev_);
+		raw = LTR390_CONCAT_BYTES(reg_data[2], reg_data[1], reg_data[0]) & traits::data_mask;
+
+		return rslt;
+	}
+
+	/* Lux or UVI */
+	int8_t read(double &value)
+	{
+		uint32_t raw;
+		int8_t rslt;
+
+		rslt = read_raw(raw);
+		value = (double)raw * traits::scale;
+
+		return rslt;
+	}
+
+	/* milli-lux or milli-UVI, rounded, integer only */
+	int8_t read_milli(uint32_t &value)
+	{
+		static constexpr struct ltr390_fixp fp = {traits::fixp_scale, traits::fixp_round, traits::fixp_shift};
+		uint32_t raw;
+		int8_t rslt;
+
+		rslt = read_raw(raw);
+		value = (uint32_t)LTR390_FIXP_APPLY(raw, &fp);
+
+		return rslt;
+	}
+
+	/* Underlying device for the C API */
+	struct ltr390_dev *dev()
+	{
+		return &dev_;
+	}
+
+private:
+	/* Transport::delay_us if it exists */
+	template <class T>
+	static constexpr auto delay_hook(int) -> decltype(&T::delay_us)
+	{
+		return &T::delay_us;
+	}
+
+	template <class T>
+	static constexpr ltr390_delay_fptr_t delay_hook(long)
+	{
+		return nullptr;
+	}
+
+	/* Transport::xfer if it exists */
+	template <class T>
+	static constexpr auto xfer_hook(int) -> decltype(&T::xfer)
+	{
+		return &T::xfer;
+	}
+
+	template <class T>
+	static constexpr ltr390_xfer_fptr_t xfer_hook(long)
+	{
+		return nullptr;
+	}
+
+	struct ltr390_dev dev_;
+};
+
+} /* namespace ltr390 */
+
+#endif /* LTR390_HPP_ */
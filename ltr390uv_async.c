@@ -0,0 +1,400 @@
+/*
+ * This file is part of the LTR-390-UV-01 library (https://github.com/Cplaton/ltr390).
+ * Copyright (c) 2021 Clement Platon.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/********************************************************/
+/* header includes */
+#include "ltr390uv_async.h"
+#include "ltr390uv.h"
+
+/* Init steps */
+#define ASYNC_INIT_PART_ID                      0x00
+#define ASYNC_INIT_SOFT_RST                     0x01
+#define ASYNC_INIT_STATUS                       0x02
+
+/* Read steps, replay steps follow the frame one block at a time */
+#define ASYNC_READ_FRAME                        0x00
+#define ASYNC_READ_REPLAY                       0x01
+
+static int8_t async_submit(struct ltr390_async_dev *adev, uint8_t dir, uint8_t reg_addr, uint8_t len);
+
+static int8_t async_advance(struct ltr390_async_dev *adev);
+
+static int8_t async_init_step(struct ltr390_async_dev *adev);
+
+static int8_t async_configure_next(struct ltr390_async_dev *adev);
+
+static int8_t async_configure_step(struct ltr390_async_dev *adev);
+
+static int8_t async_read_step(struct ltr390_async_dev *adev);
+
+static int8_t async_replay_next(struct ltr390_async_dev *adev);
+
+/********************************************************/
+
+
+void ltr390_async_loop_init(struct ltr390_async_loop *loop, ltr390_async_submit_fptr_t submit, void *ctx)
+{
+	loop->submit = submit;
+	loop->submit_ctx = ctx;
+	loop->done_head = NULL;
+	loop->done_tail = NULL;
+	loop->pending = 0;
+}
+
+
+int8_t ltr390_async_attach(struct ltr390_async_dev *adev, struct ltr390_dev *dev, struct ltr390_async_loop *loop, ltr390_async_done_fptr_t done, void *ctx)
+{
+	if ((adev == NULL) || (dev == NULL) || (loop == NULL) || (loop->submit == NULL))
+		return LTR390_E_NULL_PTR;
+
+	adev->dev = dev;
+	adev->loop = loop;
+	adev->op = LTR390_ASYNC_OP_NONE;
+	adev->done = done;
+	adev->done_ctx = ctx;
+	adev->sample = NULL;
+
+	return LTR390_OK;
+}
+
+
+int8_t ltr390_async_init(struct ltr390_async_dev *adev)
+{
+	int8_t rslt;
+
+	if ((adev == NULL) || (adev->dev == NULL))
+		return LTR390_E_NULL_PTR;
+	if (adev->op != LTR390_ASYNC_OP_NONE)
+		return LTR390_E_INVALID_VAL;
+
+	adev->op = LTR390_ASYNC_OP_INIT;
+	adev->step = ASYNC_INIT_PART_ID;
+	adev->tries = LTR390_ASYNC_INIT_TRIES;
+	rslt = async_submit(adev, LTR390_ASYNC_READ, LTR390_REG_PART_ID, 1);
+	if (rslt != LTR390_W_PENDING)
+		adev->op = LTR390_ASYNC_OP_NONE;
+
+	return rslt;
+}
+
+
+int8_t ltr390_async_configure(struct ltr390_async_dev *adev)
+{
+	int8_t rslt;
+
+	if ((adev == NULL) || (adev->dev == NULL))
+		return LTR390_E_NULL_PTR;
+	if (adev->op != LTR390_ASYNC_OP_NONE)
+		return LTR390_E_INVALID_VAL;
+
+	/* Same register image as ltr390_configure */
+	rslt = ltr390_prepare_image(&adev->image, adev->dev);
+	if (rslt != LTR390_OK)
+		return rslt;
+
+	adev->op = LTR390_ASYNC_OP_CONFIGURE;
+	adev->step = LTR390_CFG_BLK_MEAS;
+	adev->rslt = LTR390_OK;
+	/* Completes at once if the sensor already holds the image */
+	rslt = async_configure_next(adev);
+	if (rslt != LTR390_W_PENDING)
+		adev->op = LTR390_ASYNC_OP_NONE;
+
+	return rslt;
+}
+
+
+int8_t ltr390_async_read(struct ltr390_async_dev *adev, struct ltr390_sample *sample)
+{
+	int8_t rslt;
+
+	if ((adev == NULL) || (adev->dev == NULL) || (sample == NULL))
+		return LTR390_E_NULL_PTR;
+	if (adev->op != LTR390_ASYNC_OP_NONE)
+		return LTR390_E_INVALID_VAL;
+
+	/* Status and both channels in one request, as ltr390_get_frame */
+	adev->op = LTR390_ASYNC_OP_READ;
+	adev->step = ASYNC_READ_FRAME;
+	adev->sample = sample;
+	rslt = async_submit(adev, LTR390_ASYNC_READ, LTR390_REG_MAIN_STATUS, LTR390_FRAME_LEN);
+	if (rslt != LTR390_W_PENDING)
+		adev->op = LTR390_ASYNC_OP_NONE;
+
+	return rslt;
+}
+
+
+void ltr390_async_complete(struct ltr390_async_loop *loop, struct ltr390_async_req *req, int8_t rslt)
+{
+	/* Queued only, processed by ltr390_async_run on the loop thread */
+	req->rslt = rslt;
+	req->next = NULL;
+	if (loop->done_tail != NULL)
+		loop->done_tail->next = req;
+	else
+		loop->done_head = req;
+	loop->done_tail = req;
+	loop->pending--;
+}
+
+
+uint32_t ltr390_async_run(struct ltr390_async_loop *loop)
+{
+	struct ltr390_async_req *req;
+	struct ltr390_async_dev *adev;
+	uint32_t count = 0;
+	uint8_t op;
+	int8_t rslt;
+
+	while (loop->done_head != NULL) {
+		req = loop->done_head;
+		loop->done_head = req->next;
+		if (loop->done_head == NULL)
+			loop->done_tail = NULL;
+		count++;
+
+		/* The request is the first member of its device */
+		adev = (struct ltr390_async_dev *)req;
+		/* Close the time slice spent in the enable state the write replaced */
+		if ((req->dir == LTR390_ASYNC_WRITE) && (req->reg_addr == LTR390_REG_MAIN_CTRL))
+			ltr390_power_account(adev->dev);
+		rslt = async_advance(adev);
+		if (rslt != LTR390_W_PENDING) {
+			op = adev->op;
+			adev->op = LTR390_ASYNC_OP_NONE;
+			if (adev->done != NULL)
+				adev->done(adev, op, rslt, adev->done_ctx);
+		}
+	}
+
+	return count;
+}
+
+
+static int8_t async_submit(struct ltr390_async_dev *adev, uint8_t dir, uint8_t reg_addr, uint8_t len)
+{
+	struct ltr390_async_loop *loop = adev->loop;
+
+	/* Same address convention as ltr390_get_regs/ltr390_set_regs */
+	if (dir == LTR390_ASYNC_READ)
+		adev->req.dev_id = (uint8_t)((adev->dev->dev_id << 1) | 0x01);
+	else
+		adev->req.dev_id = (uint8_t)(adev->dev->dev_id << 1);
+	adev->req.reg_addr = reg_addr;
+	adev->req.dir = dir;
+	adev->req.data = adev->buf;
+	adev->req.len = len;
+	adev->req.next = NULL;
+
+	loop->pending++;
+	if (loop->submit(&adev->req, loop->submit_ctx) != LTR390_OK) {
+		loop->pending--;
+		return LTR390_E_COMM_FAIL;
+	}
+
+	return LTR390_W_PENDING;
+}
+
+static int8_t async_advance(struct ltr390_async_dev *adev)
+{
+	int8_t rslt;
+
+	switch (adev->op)
+	{
+		case LTR390_ASYNC_OP_INIT:
+			rslt = async_init_step(adev);
+			break;
+		case LTR390_ASYNC_OP_CONFIGURE:
+			rslt = async_configure_step(adev);
+			break;
+		case LTR390_ASYNC_OP_READ:
+			rslt = async_read_step(adev);
+			break;
+		default:
+			rslt = LTR390_E_INVALID_VAL;
+			break;
+	}
+
+	return rslt;
+}
+
+static int8_t async_init_step(struct ltr390_async_dev *adev)
+{
+	struct ltr390_dev *dev = adev->dev;
+	uint8_t reg_data = LTR390_DEF_MAIN_CTRL;
+
+	if (adev->step == ASYNC_INIT_PART_ID) {
+		if ((adev->req.rslt == LTR390_OK) &&
+			(LTR390_GET_BITS(adev->buf[0], LTR390_POS_PART_ID, LTR390_MASK_PART_ID) == LTR390_PART_ID)) {
+			dev->part_id = adev->buf[0];
+			ltr390_reset_dual(dev);
+			/* Soft reset, keeping the known MAIN_CTRL bits */
+			if (dev->shadow.valid == TRUE)
+				reg_data = dev->shadow.main_ctrl;
+			adev->buf[0] = LTR390_SET_BITS(reg_data, LTR390_POS_SOFT_RST,
+										LTR390_MASK_SOFT_RST, LTR390_VAL_SOFT_RST_EN);
+			adev->step = ASYNC_INIT_SOFT_RST;
+			return async_submit(adev, LTR390_ASYNC_WRITE, LTR390_REG_MAIN_CTRL, 1);
+		}
+		/* Read failed or wrong part, try again */
+		if (--adev->tries == 0)
+			return LTR390_E_DEV_NOT_FOUND;
+		return async_submit(adev, LTR390_ASYNC_READ, LTR390_REG_PART_ID, 1);
+	}
+
+	if (adev->step == ASYNC_INIT_SOFT_RST) {
+		if (adev->req.rslt != LTR390_OK) {
+			/* Reset state unknown, resync on next access */
+			dev->shadow.valid = FALSE;
+			return LTR390_E_COMM_FAIL;
+		}
+		ltr390_reset_shadow(dev);
+		/* Consume the power-on flag, later ones are brownouts */
+		adev->step = ASYNC_INIT_STATUS;
+		return async_submit(adev, LTR390_ASYNC_READ, LTR390_REG_MAIN_STATUS, 1);
+	}
+
+	return (adev->req.rslt == LTR390_OK) ? LTR390_OK : LTR390_E_COMM_FAIL;
+}
+
+static int8_t async_configure_next(struct ltr390_async_dev *adev)
+{
+	struct ltr390_dev *dev = adev->dev;
+	uint8_t reg_addr;
+	uint8_t *shadow_reg;
+	uint8_t *image_reg;
+	uint8_t len;
+	uint8_t i;
+
+	/* Next block to write, skipping the ones the sensor already holds */
+	for (; adev->step < LTR390_CFG_BLK_COUNT; adev->step++) {
+		shadow_reg = ltr390_cfg_block(&dev->shadow, adev->step, &reg_addr, &len);
+		image_reg = ltr390_cfg_block(&adev->image, adev->step, NULL, NULL);
+		if (ltr390_shadow_dirty(shadow_reg, image_reg, len, dev) == TRUE) {
+			for (i = 0; i < len; i++)
+				adev->buf[i] = image_reg[i];
+			dev->cfg_rslt[adev->step] = async_submit(adev, LTR390_ASYNC_WRITE, reg_addr, len);
+			if (dev->cfg_rslt[adev->step] == LTR390_W_PENDING)
+				return LTR390_W_PENDING;
+			if (adev->rslt == LTR390_OK)
+				adev->rslt = dev->cfg_rslt[adev->step];
+		} else {
+			dev->cfg_rslt[adev->step] = LTR390_OK;
+		}
+	}
+
+	/* The shadow is only trusted if all blocks succeeded */
+	dev->shadow.valid = (adev->rslt == LTR390_OK) ? TRUE : FALSE;
+
+	return adev->rslt;
+}
+
+static int8_t async_configure_step(struct ltr390_async_dev *adev)
+{
+	struct ltr390_dev *dev = adev->dev;
+	uint8_t *shadow_reg;
+	uint8_t *image_reg;
+	uint8_t len;
+	uint8_t i;
+
+	shadow_reg = ltr390_cfg_block(&dev->shadow, adev->step, NULL, &len);
+	image_reg = ltr390_cfg_block(&adev->image, adev->step, NULL, NULL);
+	if (adev->req.rslt == LTR390_OK) {
+		for (i = 0; i < len; i++)
+			shadow_reg[i] = image_reg[i];
+		dev->cfg_rslt[adev->step] = LTR390_OK;
+	} else {
+		/* Keep going, every block gets its result as with ltr390_configure */
+		dev->cfg_rslt[adev->step] = LTR390_E_COMM_FAIL;
+		if (adev->rslt == LTR390_OK)
+			adev->rslt = LTR390_E_COMM_FAIL;
+	}
+	adev->step++;
+
+	return async_configure_next(adev);
+}
+
+static int8_t async_read_step(struct ltr390_async_dev *adev)
+{
+	struct ltr390_dev *dev = adev->dev;
+	struct ltr390_frame frame;
+
+	if (adev->step >= ASYNC_READ_REPLAY) {
+		/* Replay write completed */
+		if (adev->req.rslt != LTR390_OK) {
+			dev->shadow.valid = FALSE;
+			LTR390_POR_ADD(dev, failed, 1);
+			return LTR390_E_COMM_FAIL;
+		}
+		adev->step++;
+		return async_replay_next(adev);
+	}
+
+	if (adev->req.rslt != LTR390_OK)
+		return LTR390_E_COMM_FAIL;
+
+	ltr390_decode_frame(&frame, adev->buf, dev);
+	*adev->sample = frame.sample;
+	adev->rslt = (frame.sample.flags & LTR390_SAMPLE_FRESH) ? LTR390_OK : LTR390_W_NO_NEW_DATA;
+
+	/* Brownout: replay the shadow before reporting the sample */
+	if (frame.sample.flags & LTR390_SAMPLE_PWR_ON) {
+		LTR390_POR_ADD(dev, events, 1);
+		if (dev->shadow.valid == TRUE) {
+			ltr390_default_image(&adev->image);
+			adev->step = ASYNC_READ_REPLAY;
+			return async_replay_next(adev);
+		}
+	}
+
+	return adev->rslt;
+}
+
+static int8_t async_replay_next(struct ltr390_async_dev *adev)
+{
+	struct ltr390_dev *dev = adev->dev;
+	uint8_t reg_addr;
+	uint8_t *shadow_reg;
+	uint8_t *default_reg;
+	uint8_t len;
+	uint8_t i;
+
+	/* Same blocks and order as ltr390_restore, image holds the defaults */
+	for (; adev->step < ASYNC_READ_REPLAY + LTR390_CFG_BLK_COUNT; adev->step++) {
+		shadow_reg = ltr390_cfg_block(&dev->shadow, adev->step - ASYNC_READ_REPLAY, &reg_addr, &len);
+		default_reg = ltr390_cfg_block(&adev->image, adev->step - ASYNC_READ_REPLAY, NULL, NULL);
+		for (i = 0; i < len; i++) {
+			if (shadow_reg[i] != default_reg[i])
+				break;
+		}
+		if (i < len) {
+			for (i = 0; i < len; i++)
+				adev->buf[i] = shadow_reg[i];
+			LTR390_POR_ADD(dev, writes, 1);
+			if (async_submit(adev, LTR390_ASYNC_WRITE, reg_addr, len) != LTR390_W_PENDING) {
+				dev->shadow.valid = FALSE;
+				LTR390_POR_ADD(dev, failed, 1);
+				return LTR390_E_COMM_FAIL;
+			}
+			return LTR390_W_PENDING;
+		}
+	}
+	LTR390_POR_ADD(dev, restored, 1);
+
+	return adev->rslt;
+}
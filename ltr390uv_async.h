@@ -0,0 +1,142 @@
+/*
+ * This file is part of the LTR-390-UV-01 library (https://github.com/Cplaton/ltr390).
+ * Copyright (c) 2021 Clement Platon.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Non-blocking driver API.
+ *
+ * Init, configure and read run as state machines. Each step submits one
+ * bus request to the transport and returns LTR390_W_PENDING. The
+ * transport reports completion with ltr390_async_complete, from the loop
+ * thread, and ltr390_async_run advances every device whose request has
+ * completed. One thread can this way keep requests in flight on many
+ * sensors. The operations follow their blocking counterparts (retries,
+ * register order, shadow updates), and the result is delivered through
+ * the device done callback.
+ */
+
+#ifndef LTR390_ASYNC_H_
+#define LTR390_ASYNC_H_
+
+/********************************************************/
+/* header includes */
+#include "ltr390uv_defs.h"
+
+
+/********************************************************/
+/*                      Consts                          */
+/********************************************************/
+
+/* Request directions */
+#define LTR390_ASYNC_READ                       0x00
+#define LTR390_ASYNC_WRITE                      0x01
+
+/* Operations */
+#define LTR390_ASYNC_OP_NONE                    0x00
+#define LTR390_ASYNC_OP_INIT                    0x01
+#define LTR390_ASYNC_OP_CONFIGURE               0x02
+#define LTR390_ASYNC_OP_READ                    0x03
+
+/* Part id read attempts, as ltr390_init */
+#define LTR390_ASYNC_INIT_TRIES                 5
+
+
+struct ltr390_async_req;
+struct ltr390_async_dev;
+
+/* Type definitions */
+typedef int8_t (*ltr390_async_submit_fptr_t)(struct ltr390_async_req *req, void *ctx);
+
+typedef void (*ltr390_async_done_fptr_t)(struct ltr390_async_dev *adev, uint8_t op, int8_t rslt, void *ctx);
+
+
+/* ltr390 bus request */
+struct ltr390_async_req {
+    /* Device address with the R/W bit, as passed to ltr390_com_fptr_t */
+    uint8_t dev_id;
+    /* Register address */
+    uint8_t reg_addr;
+    /* LTR390_ASYNC_READ or LTR390_ASYNC_WRITE */
+    uint8_t dir;
+    /* Data buffer */
+    uint8_t *data;
+    /* Data length */
+    uint16_t len;
+    /* Transfer result, set on completion */
+    int8_t rslt;
+    /* Completion queue link */
+    struct ltr390_async_req *next;
+};
+
+/* ltr390 completion-driven loop */
+struct ltr390_async_loop {
+    /* Transport submit function */
+    ltr390_async_submit_fptr_t submit;
+    /* Transport context */
+    void *submit_ctx;
+    /* Completed requests waiting to be processed */
+    struct ltr390_async_req *done_head;
+    struct ltr390_async_req *done_tail;
+    /* Requests in flight */
+    uint32_t pending;
+};
+
+/* ltr390 non-blocking device */
+struct ltr390_async_dev {
+    /* Request, first member so a completed request leads back here */
+    struct ltr390_async_req req;
+    /* Sensor settings and shadow */
+    struct ltr390_dev *dev;
+    /* Driving loop */
+    struct ltr390_async_loop *loop;
+    /* Running operation (LTR390_ASYNC_OP_xxx) */
+    uint8_t op;
+    /* Step within the operation */
+    uint8_t step;
+    /* Attempts left */
+    uint8_t tries;
+    /* Result of the operation so far */
+    int8_t rslt;
+    /* Register image written by configure, defaults during a replay */
+    struct ltr390_shadow image;
+    /* Transfer buffer */
+    uint8_t buf[LTR390_FRAME_LEN];
+    /* Read destination */
+    struct ltr390_sample *sample;
+    /* Completion callback */
+    ltr390_async_done_fptr_t done;
+    /* Completion callback context */
+    void *done_ctx;
+};
+
+
+/********************************************************/
+
+void ltr390_async_loop_init(struct ltr390_async_loop *loop, ltr390_async_submit_fptr_t submit, void *ctx);
+
+int8_t ltr390_async_attach(struct ltr390_async_dev *adev, struct ltr390_dev *dev, struct ltr390_async_loop *loop, ltr390_async_done_fptr_t done, void *ctx);
+
+int8_t ltr390_async_init(struct ltr390_async_dev *adev);
+
+int8_t ltr390_async_configure(struct ltr390_async_dev *adev);
+
+int8_t ltr390_async_read(struct ltr390_async_dev *adev, struct ltr390_sample *sample);
+
+void ltr390_async_complete(struct ltr390_async_loop *loop, struct ltr390_async_req *req, int8_t rslt);
+
+uint32_t ltr390_async_run(struct ltr390_async_loop *loop);
+
+#endif /* LTR390_ASYNC_H_ */
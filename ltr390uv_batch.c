@@ -0,0 +1,327 @@
+/*
+ * This file is part of the LTR-390-UV-01 library (https://github.com/Cplaton/ltr390).
+ * Copyright (c) 2021 Clement Platon.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/********************************************************/
+/* header includes */
+#include "ltr390uv_batch.h"
+#include "ltr390uv.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BATCH_HAVE_AVX2
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON)
+#define BATCH_HAVE_NEON
+#include <arm_neon.h>
+#endif
+
+/* Detected on first use */
+#define BATCH_ISA_UNKNOWN                       0xFF
+
+/*
+ * Detection is idempotent, so threads racing on first use store the same
+ * value. Atomic accesses only keep the concurrent load and store defined.
+ */
+#if defined(__GNUC__)
+#define BATCH_ISA_LOAD()                        __atomic_load_n(&batch_isa, __ATOMIC_RELAXED)
+#define BATCH_ISA_STORE(isa)                    __atomic_store_n(&batch_isa, (isa), __ATOMIC_RELAXED)
+#else
+#define BATCH_ISA_LOAD()                        (batch_isa)
+#define BATCH_ISA_STORE(isa)                    (batch_isa = (isa))
+#endif
+
+static uint8_t batch_isa = BATCH_ISA_UNKNOWN;
+
+static void batch_convert_scalar(const uint32_t *raw, float *out, size_t count, float scale);
+
+static void batch_tagged_scalar(const uint32_t *raw, const uint8_t *tags, const float *scales, float *out, size_t count);
+
+static void batch_decode_scalar(const uint8_t *reg_data, uint32_t *out, size_t count, uint8_t resolution);
+
+#ifdef BATCH_HAVE_AVX2
+static void batch_convert_avx2(const uint32_t *raw, float *out, size_t count, float scale);
+
+static void batch_tagged_avx2(const uint32_t *raw, const uint8_t *tags, const float *scales, float *out, size_t count);
+
+static void batch_decode_avx2(const uint8_t *reg_data, uint32_t *out, size_t count, uint8_t resolution);
+#endif
+
+#ifdef BATCH_HAVE_NEON
+static void batch_convert_neon(const uint32_t *raw, float *out, size_t count, float scale);
+
+static void batch_tagged_neon(const uint32_t *raw, const uint8_t *tags, const float *scales, float *out, size_t count);
+
+static void batch_decode_neon(const uint8_t *reg_data, uint32_t *out, size_t count, uint8_t resolution);
+#endif
+
+/********************************************************/
+
+
+int8_t ltr390_batch_prepare(float *scale, const struct ltr390_sample *cfg,  struct ltr390_dev *dev)
+{
+	int8_t rslt;
+	struct ltr390_sample unit;
+	double per_count;
+
+	if ((scale == NULL) || (cfg == NULL))
+		return LTR390_E_NULL_PTR;
+
+	/* Conversion is linear, the value of one count is the scale */
+	unit = *cfg;
+	unit.raw = 1;
+	rslt = ltr390_computed_sample(&unit, &per_count, dev);
+	if (rslt == LTR390_OK)
+		*scale = (float)per_count;
+
+	return rslt;
+}
+
+
+void ltr390_batch_convert(const uint32_t *raw, float *out, size_t count, float scale)
+{
+	switch (ltr390_batch_isa())
+	{
+#ifdef BATCH_HAVE_AVX2
+		case LTR390_BATCH_ISA_AVX2:
+			batch_convert_avx2(raw, out, count, scale);
+			break;
+#endif
+#ifdef BATCH_HAVE_NEON
+		case LTR390_BATCH_ISA_NEON:
+			batch_convert_neon(raw, out, count, scale);
+			break;
+#endif
+		default:
+			batch_convert_scalar(raw, out, count, scale);
+			break;
+	}
+}
+
+
+void ltr390_batch_convert_tagged(const uint32_t *raw, const uint8_t *tags, const float *scales, float *out, size_t count)
+{
+	switch (ltr390_batch_isa())
+	{
+#ifdef BATCH_HAVE_AVX2
+		case LTR390_BATCH_ISA_AVX2:
+			batch_tagged_avx2(raw, tags, scales, out, count);
+			break;
+#endif
+#ifdef BATCH_HAVE_NEON
+		case LTR390_BATCH_ISA_NEON:
+			batch_tagged_neon(raw, tags, scales, out, count);
+			break;
+#endif
+		default:
+			batch_tagged_scalar(raw, tags, scales, out, count);
+			break;
+	}
+}
+
+
+void ltr390_batch_decode(const uint8_t *reg_data, uint32_t *out, size_t count, uint8_t resolution)
+{
+	switch (ltr390_batch_isa())
+	{
+#ifdef BATCH_HAVE_AVX2
+		case LTR390_BATCH_ISA_AVX2:
+			batch_decode_avx2(reg_data, out, count, resolution);
+			break;
+#endif
+#ifdef BATCH_HAVE_NEON
+		case LTR390_BATCH_ISA_NEON:
+			batch_decode_neon(reg_data, out, count, resolution);
+			break;
+#endif
+		default:
+			batch_decode_scalar(reg_data, out, count, resolution);
+			break;
+	}
+}
+
+
+uint8_t ltr390_batch_isa(void)
+{
+	uint8_t isa = BATCH_ISA_LOAD();
+
+	if (isa == BATCH_ISA_UNKNOWN) {
+		isa = LTR390_BATCH_ISA_SCALAR;
+#if defined(BATCH_HAVE_AVX2)
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2"))
+			isa = LTR390_BATCH_ISA_AVX2;
+#elif defined(BATCH_HAVE_NEON)
+		isa = LTR390_BATCH_ISA_NEON;
+#endif
+		BATCH_ISA_STORE(isa);
+	}
+
+	return isa;
+}
+
+
+void ltr390_batch_force_isa(uint8_t isa)
+{
+	/* Only kernels built in and supported by the CPU can be forced */
+	if ((isa == LTR390_BATCH_ISA_SCALAR) ||
+		((isa != BATCH_ISA_UNKNOWN) && (isa == ltr390_batch_isa())))
+		BATCH_ISA_STORE(isa);
+	else
+		BATCH_ISA_STORE(BATCH_ISA_UNKNOWN);
+}
+
+
+static void batch_convert_scalar(const uint32_t *raw, float *out, size_t count, float scale)
+{
+	size_t i;
+
+	for (i = 0; i < count; i++)
+		out[i] = (float)(raw[i] & LTR390_BATCH_RAW_MASK) * scale;
+}
+
+static void batch_tagged_scalar(const uint32_t *raw, const uint8_t *tags, const float *scales, float *out, size_t count)
+{
+	size_t i;
+
+	for (i = 0; i < count; i++)
+		out[i] = (float)(raw[i] & LTR390_BATCH_RAW_MASK) * scales[tags[i]];
+}
+
+static void batch_decode_scalar(const uint8_t *reg_data, uint32_t *out, size_t count, uint8_t resolution)
+{
+	const uint32_t mask = ltr390_data_mask(resolution);
+	size_t i;
+
+	for (i = 0; i < count; i++)
+		out[i] = LTR390_DECODE_DATA(&reg_data[i * 3], mask);
+}
+
+#ifdef BATCH_HAVE_AVX2
+__attribute__((target("avx2")))
+static void batch_convert_avx2(const uint32_t *raw, float *out, size_t count, float scale)
+{
+	const __m256 vscale = _mm256_set1_ps(scale);
+	const __m256i vmask = _mm256_set1_epi32(LTR390_BATCH_RAW_MASK);
+	__m256i vraw;
+	size_t i;
+
+	/* Masked to 20 bits, the signed conversion matches the unsigned scalar one */
+	for (i = 0; i + 8 <= count; i += 8) {
+		vraw = _mm256_and_si256(_mm256_loadu_si256((const __m256i *)&raw[i]), vmask);
+		_mm256_storeu_ps(&out[i], _mm256_mul_ps(_mm256_cvtepi32_ps(vraw), vscale));
+	}
+	batch_convert_scalar(&raw[i], &out[i], count - i, scale);
+}
+
+__attribute__((target("avx2")))
+static void batch_tagged_avx2(const uint32_t *raw, const uint8_t *tags, const float *scales, float *out, size_t count)
+{
+	const __m256i vmask = _mm256_set1_epi32(LTR390_BATCH_RAW_MASK);
+	__m256i vraw;
+	__m256i vtag;
+	__m256 vscale;
+	size_t i;
+
+	for (i = 0; i + 8 <= count; i += 8) {
+		vraw = _mm256_and_si256(_mm256_loadu_si256((const __m256i *)&raw[i]), vmask);
+		/* 8 tags widened to 32-bit indexes into the scale table */
+		vtag = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)&tags[i]));
+		vscale = _mm256_i32gather_ps(scales, vtag, 4);
+		_mm256_storeu_ps(&out[i], _mm256_mul_ps(_mm256_cvtepi32_ps(vraw), vscale));
+	}
+	batch_tagged_scalar(&raw[i], &tags[i], scales, &out[i], count - i);
+}
+
+__attribute__((target("avx2")))
+static void batch_decode_avx2(const uint8_t *reg_data, uint32_t *out, size_t count, uint8_t resolution)
+{
+	/* Per 128-bit lane: 4 triplets, each widened with a zero high byte */
+	const __m256i shuf = _mm256_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+										0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+	const __m256i vmask = _mm256_set1_epi32((int)ltr390_data_mask(resolution));
+	__m256i vreg;
+	size_t i;
+
+	/* Each lane loads 16 bytes for 12, the last load must stay in the buffer */
+	for (i = 0; i + 10 <= count; i += 8) {
+		vreg = _mm256_inserti128_si256(
+				_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)&reg_data[i * 3])),
+				_mm_loadu_si128((const __m128i *)&reg_data[i * 3 + 12]), 1);
+		vreg = _mm256_and_si256(_mm256_shuffle_epi8(vreg, shuf), vmask);
+		_mm256_storeu_si256((__m256i *)&out[i], vreg);
+	}
+	batch_decode_scalar(&reg_data[i * 3], &out[i], count - i, resolution);
+}
+#endif
+
+#ifdef BATCH_HAVE_NEON
+static void batch_convert_neon(const uint32_t *raw, float *out, size_t count, float scale)
+{
+	const uint32x4_t vmask = vdupq_n_u32(LTR390_BATCH_RAW_MASK);
+	size_t i;
+
+	for (i = 0; i + 4 <= count; i += 4)
+		vst1q_f32(&out[i], vmulq_n_f32(vcvtq_f32_u32(vandq_u32(vld1q_u32(&raw[i]), vmask)), scale));
+	batch_convert_scalar(&raw[i], &out[i], count - i, scale);
+}
+
+static void batch_tagged_neon(const uint32_t *raw, const uint8_t *tags, const float *scales, float *out, size_t count)
+{
+	const uint32x4_t vmask = vdupq_n_u32(LTR390_BATCH_RAW_MASK);
+	float32x4_t vscale;
+	size_t i;
+
+	/* No gather on NEON, the table lookup stays scalar */
+	for (i = 0; i + 4 <= count; i += 4) {
+		vscale = vdupq_n_f32(scales[tags[i]]);
+		vscale = vsetq_lane_f32(scales[tags[i + 1]], vscale, 1);
+		vscale = vsetq_lane_f32(scales[tags[i + 2]], vscale, 2);
+		vscale = vsetq_lane_f32(scales[tags[i + 3]], vscale, 3);
+		vst1q_f32(&out[i], vmulq_f32(vcvtq_f32_u32(vandq_u32(vld1q_u32(&raw[i]), vmask)), vscale));
+	}
+	batch_tagged_scalar(&raw[i], &tags[i], scales, &out[i], count - i);
+}
+
+static void batch_decode_neon(const uint8_t *reg_data, uint32_t *out, size_t count, uint8_t resolution)
+{
+	const uint32x4_t vmask = vdupq_n_u32(ltr390_data_mask(resolution));
+	uint8x16x3_t vreg;
+	uint16x8_t low;
+	uint16x8_t high;
+	uint16x8_t msb;
+	size_t i;
+
+	/* De-interleaving load, one vector per register byte of 16 triplets */
+	for (i = 0; i + 16 <= count; i += 16) {
+		vreg = vld3q_u8(&reg_data[i * 3]);
+		low = vorrq_u16(vmovl_u8(vget_low_u8(vreg.val[0])), vshll_n_u8(vget_low_u8(vreg.val[1]), 8));
+		high = vorrq_u16(vmovl_u8(vget_high_u8(vreg.val[0])), vshll_n_u8(vget_high_u8(vreg.val[1]), 8));
+		msb = vmovl_u8(vget_low_u8(vreg.val[2]));
+		vst1q_u32(&out[i], vandq_u32(vorrq_u32(vmovl_u16(vget_low_u16(low)),
+								vshll_n_u16(vget_low_u16(msb), 16)), vmask));
+		vst1q_u32(&out[i + 4], vandq_u32(vorrq_u32(vmovl_u16(vget_high_u16(low)),
+								vshll_n_u16(vget_high_u16(msb), 16)), vmask));
+		msb = vmovl_u8(vget_high_u8(vreg.val[2]));
+		vst1q_u32(&out[i + 8], vandq_u32(vorrq_u32(vmovl_u16(vget_low_u16(high)),
+								vshll_n_u16(vget_low_u16(msb), 16)), vmask));
+		vst1q_u32(&out[i + 12], vandq_u32(vorrq_u32(vmovl_u16(vget_high_u16(high)),
+								vshll_n_u16(vget_high_u16(msb), 16)), vmask));
+	}
+	batch_decode_scalar(&reg_data[i * 3], &out[i], count - i, resolution);
+}
+#endif
@@ -0,0 +1,67 @@
+/*
+ * This file is part of the LTR-390-UV-01 library (https://github.com/Cplaton/ltr390).
+ * Copyright (c) 2021 Clement Platon.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Batch conversion of logged raw samples.
+ *
+ * Lux and UVI are linear in the raw counts, so a configuration reduces
+ * to one float scale factor (ltr390_batch_prepare). Arrays are then
+ * converted with AVX2 or NEON kernels, picked at runtime, with a scalar
+ * fallback. Raw counts are masked to the 20 bits of the widest data
+ * register first, so every kernel gives the same result for any input.
+ *
+ * Register dumps captured in bulk, packed 3-byte DATA_0..DATA_2 triplets,
+ * are decoded with the same kernels: byte shuffles widen each triplet to
+ * 32 bits, then the resolution mask of ltr390_data_mask is applied.
+ */
+
+#ifndef LTR390_BATCH_H_
+#define LTR390_BATCH_H_
+
+/********************************************************/
+/* header includes */
+#include "ltr390uv_defs.h"
+
+
+/********************************************************/
+/*                      Consts                          */
+/********************************************************/
+
+/* Kernels */
+#define LTR390_BATCH_ISA_SCALAR                 0x00
+#define LTR390_BATCH_ISA_AVX2                   0x01
+#define LTR390_BATCH_ISA_NEON                   0x02
+
+/* Bits of a raw count used by the conversions */
+#define LTR390_BATCH_RAW_MASK                   0xFFFFF
+
+
+/********************************************************/
+
+int8_t ltr390_batch_prepare(float *scale, const struct ltr390_sample *cfg,  struct ltr390_dev *dev);
+
+void ltr390_batch_convert(const uint32_t *raw, float *out, size_t count, float scale);
+
+void ltr390_batch_convert_tagged(const uint32_t *raw, const uint8_t *tags, const float *scales, float *out, size_t count);
+
+void ltr390_batch_decode(const uint8_t *reg_data, uint32_t *out, size_t count, uint8_t resolution);
+
+uint8_t ltr390_batch_isa(void);
+
+void ltr390_batch_force_isa(uint8_t isa);
+
+#endif /* LTR390_BATCH_H_ */
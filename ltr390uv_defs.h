@@ -63,6 +63,21 @@
 #define LTR390_GET_BITS(reg_data,pos,mask) \
         ((reg_data & mask)) >> pos
 
+#define LTR390_FIXP_APPLY(raw,fp) \
+        ((((uint64_t)(raw) * (fp)->scale) + (fp)->round) >> (fp)->shift)
+
+/* Full-scale table index of a resolution, out of range ones decode as 20-bit */
+#define LTR390_RES_INDEX(res) \
+        (((res) <= LTR390_VAL_RES_13_BIT) ? (res) : LTR390_VAL_RES_20_BIT)
+
+/* Little-endian data register triplet, bits above the mask cleared */
+#define LTR390_DECODE_DATA(reg_data,mask) \
+        (LTR390_CONCAT_BYTES((reg_data)[2], (reg_data)[1], (reg_data)[0]) & (mask))
+
+/* Power-on recovery counters */
+#define LTR390_POR_ADD(dev,field,count) \
+        ((dev)->por.field += (count))
+
 
 /********************************************************/
 /*                      Consts                          */
@@ -77,7 +92,16 @@
 #define LTR390_E_INVALID_LEN		        INT8_C(-3)
 #define LTR390_E_COMM_FAIL			INT8_C(-4)
 #define LTR390_E_INVALID_VAL			INT8_C(-5)
+#define LTR390_E_TIMEOUT			INT8_C(-6)
 
+/**\name API warning codes */
+#define LTR390_W_NO_NEW_DATA			INT8_C(1)
+#define LTR390_W_OVERFLOW			INT8_C(2)
+#define LTR390_W_PENDING			INT8_C(3)
+
+
+/* Longest register block written in one transaction (thresholds) */
+#define LTR390_MAX_BURST_LEN                    6
 
 #define LTR390_PART_ID                          0x0B
 
@@ -150,9 +174,9 @@
 
 
 /* Masks */
-#define LTR390_MASK_ALS_UVS_EN                  0x01
-#define LTR390_MASK_UVS_MODE                    0x04
-#define LTR390_MASK_SOFT_RST                    0x08
+#define LTR390_MASK_ALS_UVS_EN                  0x02
+#define LTR390_MASK_UVS_MODE                    0x08
+#define LTR390_MASK_SOFT_RST                    0x10
 
 #define LTR390_MASK_ALS_UVS_MEAS_RATE           0x07
 #define LTR390_MASK_ALS_UVS_RES                 0x70
@@ -162,9 +186,9 @@
 #define LTR390_MASK_REV_ID                  	0x0F
 #define LTR390_MASK_PART_ID                 	0xF0
 
-#define LTR390_MASK_ALS_UVS_DATA_STAT       	0x04
-#define LTR390_MASK_ALS_UVS_INT_STAT        	0x08
-#define LTR390_MASK_ALS_UVS_PWR_ON_STAT     	0x10
+#define LTR390_MASK_ALS_UVS_DATA_STAT       	0x08
+#define LTR390_MASK_ALS_UVS_INT_STAT        	0x10
+#define LTR390_MASK_ALS_UVS_PWR_ON_STAT     	0x20
 
 #define LTR390_MASK_ALS_DATA_0              	0xFF
 #define LTR390_MASK_ALS_DATA_1              	0xFF
@@ -174,7 +198,7 @@
 #define LTR390_MASK_UVS_DATA_1              	0xFF
 #define LTR390_MASK_UVS_DATA_2              	0x0F
 
-#define LTR390_MASK_LS_INT_EN               	0x02
+#define LTR390_MASK_LS_INT_EN               	0x04
 #define LTR390_MASK_LS_INT_SEL              	0x30
 
 #define LTR390_MASK_ALS_UVS_PERSIST         	0xF0
@@ -189,6 +213,17 @@
 
 
 
+/* Power-on default values of the writable registers */
+#define LTR390_DEF_MAIN_CTRL                    0x00
+#define LTR390_DEF_ALS_UVS_MEAS_RATE            0x22
+#define LTR390_DEF_ALS_UVS_GAIN                 0x01
+#define LTR390_DEF_INT_CFG                      0x10
+#define LTR390_DEF_INT_PST                      0x00
+#define LTR390_DEF_ALS_UVS_THRES_UP             0xFFFFF
+#define LTR390_DEF_ALS_UVS_THRES_LOW            0x00000
+
+
+
 /* Values */
 #define LTR390_VAL_ALS_UVS_STANDBY          	0x00
 #define LTR390_VAL_ALS_UVS_ACTIVE           	0x01
@@ -253,20 +288,82 @@
 #define LTR390_VAL_ALS_UVS_TRIG_INT_16_CONS 	0x0F
 
 
+#define LTR390_SHADOW_WRITE_ALWAYS              0x00
+#define LTR390_SHADOW_WRITE_CHANGED             0x01
+
+/* Register blocks written by ltr390_configure */
+#define LTR390_CFG_BLK_MEAS                     0x00
+#define LTR390_CFG_BLK_INT                      0x01
+#define LTR390_CFG_BLK_THRES                    0x02
+#define LTR390_CFG_BLK_MAIN_CTRL                0x03
+#define LTR390_CFG_BLK_COUNT                    4
+
+/* Bus operation directions, same values as LTR390_TRACE_READ/WRITE */
+#define LTR390_BUS_READ                         0x00
+#define LTR390_BUS_WRITE                        0x01
+
+/* Most operations the driver puts in one transport job */
+#define LTR390_BUS_MAX_OPS                      4
+
+/* Sample flags */
+#define LTR390_SAMPLE_FRESH                     0x01
+#define LTR390_SAMPLE_INT_TRIG                  0x02
+#define LTR390_SAMPLE_PWR_ON                    0x04
+#define LTR390_SAMPLE_SATURATED                 0x08
+
+/* Auto-range default switching thresholds, in percent of full scale */
+#define LTR390_AUTORANGE_HIGH_PCT               90
+#define LTR390_AUTORANGE_LOW_PCT                10
+
+/* MAIN_STATUS to UVS_DATA_2 window length */
+#define LTR390_FRAME_LEN                        (LTR390_REG_UVS_DATA_2 - LTR390_REG_MAIN_STATUS + 1)
+
+/* Data-ready polling interval as a fraction of the conversion time */
+#define LTR390_DATA_POLL_DIV                    4
+
 #define LTR390_INT_SRC_ALS                      0x00
 #define LTR390_INT_SRC_UVS                      0x01
 
-#define LTR390_UVS_SENSITIVITY                  UINT8_C(2300)
-#define LTR390_UVS_WFAC_NO_WINDOW               UINT8_C(0)
+#define LTR390_UVS_SENSITIVITY                  UINT16_C(2300)
+#define LTR390_UVS_WFAC_NO_WINDOW               UINT8_C(1)
+
+/* Power model defaults, typical supply currents in uA */
+#define LTR390_POWER_ACTIVE_UA                  100
+#define LTR390_POWER_STANDBY_UA                 1
+
+/* Instrumentation, compiled in with LTR390_ENABLE_STATS */
+/* Error counters, indexed by -code - 1 (LTR390_E_NULL_PTR..LTR390_E_TIMEOUT) */
+#define LTR390_STATS_ERR_COUNT                  6
+/* Latency histogram: <16us, then x4 per bin, last bin open-ended */
+#define LTR390_STATS_HIST_BINS                  8
+#define LTR390_STATS_HIST_BASE_SHIFT            4
 
-uint8_t a_gain[5] = {1,3,6,9,18};
+/* Trace events and directions */
+#define LTR390_TRACE_BEGIN                      0x00
+#define LTR390_TRACE_END                        0x01
+#define LTR390_TRACE_READ                       0x00
+#define LTR390_TRACE_WRITE                      0x01
 
-double a_int[6] = {4.,2.,1.,0.5,0.25,0.25};
+/* Fixed-point conversion outputs milli-lux / milli-UVI */
+#define LTR390_FIXP_UNIT                        1000
+/* Largest fraction width of the fixed-point scale factor */
+#define LTR390_FIXP_MAX_SHIFT                   32
 
 /* Type definitions */
 typedef int8_t (*ltr390_com_fptr_t)(uint8_t dev_id, uint8_t reg_addr, 
         uint8_t *data, uint16_t len);
 
+typedef void (*ltr390_delay_fptr_t)(uint32_t period_us);
+
+typedef uint32_t (*ltr390_clock_fptr_t)(void);
+
+typedef void (*ltr390_trace_fptr_t)(uint8_t dev_id, uint8_t event, uint8_t dir,
+        uint8_t reg_addr, uint8_t len, int8_t rslt, void *ctx);
+
+struct ltr390_bus_op;
+
+typedef int8_t (*ltr390_xfer_fptr_t)(struct ltr390_bus_op *ops, uint8_t count, void *ctx);
+
 
 /* ltr390 settings structure */
 struct ltr390_settings {
@@ -288,12 +385,186 @@ struct ltr390_settings {
     uint32_t int_thresh_low;
     /* Interrupt threshold up */
     uint32_t int_thresh_up;
-    /* Interrupt source */
-    uint8_t uv_sensitivity;
-    /* Interrupt persist */
+    /* UV sensitivity in counts per UVI at gain 18x and 20-bit */
+    uint16_t uv_sensitivity;
+    /* Window factor */
     uint8_t w_fac;
 };
 
+/* ltr390 bus operation, one register access of a transport job */
+struct ltr390_bus_op {
+    /* Device address with the R/W bit, as passed to ltr390_com_fptr_t */
+    uint8_t addr;
+    /* Register address */
+    uint8_t reg_addr;
+    /* LTR390_BUS_READ or LTR390_BUS_WRITE */
+    uint8_t dir;
+    /* Data buffer */
+    uint8_t *buf;
+    /* Data length */
+    uint16_t len;
+    /* Result, LTR390_E_COMM_FAIL until the transport completes the operation */
+    int8_t rslt;
+};
+
+/* ltr390 shadow copy of the writable registers (register image) */
+struct ltr390_shadow {
+    /* MAIN_CTRL register */
+    uint8_t main_ctrl;
+    /* ALS_UVS_MEAS_RATE and ALS_UVS_GAIN registers (0x04-0x05) */
+    uint8_t meas[2];
+    /* INT_CFG and INT_PST registers (0x19-0x1A) */
+    uint8_t intr[2];
+    /* ALS_UVS_THRES_UP_0..2 and ALS_UVS_THRES_LOW_0..2 registers (0x21-0x26) */
+    uint8_t thres[6];
+    /* Shadow matches the sensor registers */
+    uint8_t valid;
+};
+
+/* ltr390 sample structure */
+struct ltr390_sample {
+    /* Raw ALS/UVS counts */
+    uint32_t raw;
+    /* ALS/UVS mode of the conversion */
+    uint8_t mode;
+    /* Gain range of the conversion */
+    uint8_t gain_range;
+    /* Resolution of the conversion */
+    uint8_t resolution;
+    /* Sample flags (LTR390_SAMPLE_xxx) */
+    uint8_t flags;
+};
+
+/* ltr390 status and data registers read in one transaction */
+struct ltr390_frame {
+    /* MAIN_STATUS register */
+    uint8_t status;
+    /* ALS channel counts */
+    uint32_t als;
+    /* UVS channel counts */
+    uint32_t uvs;
+    /* Active channel sample */
+    struct ltr390_sample sample;
+};
+
+/* ltr390 automatic gain/resolution ranging */
+struct ltr390_autorange {
+    /* Lowest gain range allowed */
+    uint8_t gain_min;
+    /* Highest gain range allowed */
+    uint8_t gain_max;
+    /* Resolution used while the gain can absorb the light level */
+    uint8_t res_base;
+    /* Finest resolution used in dim light (code <= res_base) */
+    uint8_t res_max;
+    /* Coarsest resolution used in bright light at gain_min (code >= res_base) */
+    uint8_t res_min;
+    /* Step down above this percentage of full scale */
+    uint8_t high_pct;
+    /* Step up below this percentage of full scale */
+    uint8_t low_pct;
+    /* Configuration switches applied */
+    uint32_t switches;
+    /* Saturated conversions seen */
+    uint32_t saturated;
+};
+
+/* ltr390 fixed-point conversion factor, one per configuration */
+struct ltr390_fixp {
+    /* milli-lux or milli-UVI per count, Q(shift) */
+    uint32_t scale;
+    /* Rounding term, half an output unit in Q(shift) */
+    uint32_t round;
+    /* Fraction width of scale */
+    uint8_t shift;
+};
+
+/* ltr390 per-channel setup for the alternating ALS/UVS mode */
+struct ltr390_chan_cfg {
+    /* Gain Range */
+    uint8_t gain_range;
+    /* Measures resolution */
+    uint8_t resolution;
+};
+
+/* ltr390 paired ALS and UVS samples */
+struct ltr390_pair {
+    /* ALS channel sample */
+    struct ltr390_sample als;
+    /* UVS channel sample */
+    struct ltr390_sample uvs;
+};
+
+/* ltr390 power-on (brownout) recovery counters */
+struct ltr390_por_stats {
+    /* Power-on events seen in MAIN_STATUS */
+    uint32_t events;
+    /* Events recovered by replaying the shadow */
+    uint32_t restored;
+    /* Replays that failed, the shadow is then invalidated */
+    uint32_t failed;
+    /* Register bursts written by the replays */
+    uint32_t writes;
+};
+
+/* ltr390 report-on-change threshold window */
+struct ltr390_change {
+    /* Window half width in percent of the centre value */
+    uint8_t pct;
+    /* Smallest window half width, in counts */
+    uint32_t min_counts;
+    /* Last accepted value, centre of the window */
+    uint32_t centre;
+    /* Windows programmed */
+    uint32_t recentres;
+};
+
+/* ltr390 power accounting, see ltr390_power_init */
+struct ltr390_power {
+    /* Supply current while active, in uA */
+    uint16_t active_ua;
+    /* Supply current in standby, in uA */
+    uint16_t standby_ua;
+    /* Time spent active, in us */
+    uint64_t active_us;
+    /* Time spent in standby, in us */
+    uint64_t standby_us;
+    /* Clock at the last accounting, in us */
+    uint32_t last_us;
+    /* Wake-ups from standby */
+    uint32_t wakeups;
+    /* Accounting started */
+    uint8_t running;
+};
+
+#ifdef LTR390_ENABLE_STATS
+/* ltr390 instrumentation counters */
+struct ltr390_stats {
+    /* Read and write transactions */
+    uint32_t reads;
+    uint32_t writes;
+    /* Bytes transferred */
+    uint32_t bytes_read;
+    uint32_t bytes_written;
+    /* Errors by code, see LTR390_STATS_ERR_COUNT */
+    uint32_t errors[LTR390_STATS_ERR_COUNT];
+    /* Part id read retries */
+    uint32_t retries;
+    /* Status reads without new data */
+    uint32_t stale;
+    /* Transport latency, needs get_time_us */
+    uint32_t lat_count;
+    uint32_t lat_min_us;
+    uint32_t lat_max_us;
+    uint64_t lat_sum_us;
+    uint32_t lat_hist[LTR390_STATS_HIST_BINS];
+    /* Called around each transaction (optional) */
+    ltr390_trace_fptr_t trace;
+    /* Trace callback context */
+    void *trace_ctx;
+};
+#endif
+
 /* ltr390 device structure */
 struct ltr390_dev {
     /* device Id (base adress) */    
@@ -304,8 +575,32 @@ struct ltr390_dev {
     ltr390_com_fptr_t read;
     /* Write function pointer */
     ltr390_com_fptr_t write;
+    /* Job transport (optional), replaces read/write when set */
+    ltr390_xfer_fptr_t xfer;
+    /* Job transport context */
+    void *xfer_ctx;
+    /* Delay function pointer (optional, needed by blocking calls) */
+    ltr390_delay_fptr_t delay_us;
+    /* Monotonic microsecond clock (optional) */
+    ltr390_clock_fptr_t get_time_us;
     /* Sensor settings */
     struct ltr390_settings settings;
+    /* Shadow registers write policy (LTR390_SHADOW_WRITE_xxx) */
+    uint8_t write_mode;
+    /* Shadow copy of the writable registers */
+    struct ltr390_shadow shadow;
+    /* Result of each register block written by the last configure */
+    int8_t cfg_rslt[LTR390_CFG_BLK_COUNT];
+    /* Alternating mode setup, indexed by LTR390_VAL_UVS_MODE_xxx */
+    struct ltr390_chan_cfg dual[2];
+    /* Power-on recovery counters */
+    struct ltr390_por_stats por;
+    /* Active/standby time accounting */
+    struct ltr390_power power;
+#ifdef LTR390_ENABLE_STATS
+    /* Instrumentation counters */
+    struct ltr390_stats stats;
+#endif
 };
 
 #endif /* LTR390_DEFS_H_ */
\ No newline at end of file
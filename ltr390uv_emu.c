@@ -0,0 +1,493 @@
+/*
+ * This file is part of the LTR-390-UV-01 library (https://github.com/Cplaton/ltr390).
+ * Copyright (c) 2021 Clement Platon.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/********************************************************/
+/* header includes */
+#include "ltr390uv_emu.h"
+
+/* Datasheet values, kept apart from the driver tables on purpose */
+
+/* Measurement rate in us, indexed by the MEAS_RATE field (6 and 7 are 2000ms) */
+static const uint32_t emu_rate_us[8] = {25000, 50000, 100000, 200000, 500000, 1000000, 2000000, 2000000};
+
+/* Conversion time in us, indexed by the resolution field (6 and 7 reserved) */
+static const uint32_t emu_conv_us[8] = {400000, 200000, 100000, 50000, 25000, 12500, 100000, 100000};
+
+/* Resolution in bits, indexed by the resolution field */
+static const uint8_t emu_res_bits[8] = {20, 19, 18, 17, 16, 13, 18, 18};
+
+/* Integration time relative to 100ms, indexed by the resolution field */
+static const double emu_int_factor[8] = {4., 2., 1., 0.5, 0.25, 0.125, 1., 1.};
+
+/* Gain factor, indexed by the gain field (5 to 7 reserved) */
+static const double emu_gain[8] = {1., 3., 6., 9., 18., 1., 1., 1.};
+
+/* UV counts per UVI at gain 18x and 20-bit */
+#define EMU_UVS_SENSITIVITY                     2300.
+
+static struct ltr390_emu *emu_devs[LTR390_EMU_MAX_DEV];
+
+static uint64_t emu_time_us;
+
+static struct ltr390_emu *emu_find(uint8_t addr);
+
+static void emu_load_defaults(struct ltr390_emu *emu);
+
+static void emu_update(struct ltr390_emu *emu);
+
+static void emu_convert(struct ltr390_emu *emu, uint64_t time_us);
+
+static void emu_restart(struct ltr390_emu *emu);
+
+static uint32_t emu_period_us(const struct ltr390_emu *emu);
+
+static uint32_t emu_skew_us(const struct ltr390_emu *emu, uint32_t period_us);
+
+/********************************************************/
+
+
+int8_t ltr390_emu_attach(struct ltr390_emu *emu, uint8_t dev_id)
+{
+	uint8_t i;
+	int8_t slot = -1;
+
+	if (emu == NULL)
+		return LTR390_E_NULL_PTR;
+
+	for (i = 0; i < LTR390_EMU_MAX_DEV; i++) {
+		/* One sensor per handle */
+		if ((emu_devs[i] != NULL) && (emu_devs[i]->dev_id == dev_id))
+			return LTR390_E_INVALID_VAL;
+		if ((emu_devs[i] == NULL) && (slot < 0))
+			slot = (int8_t)i;
+	}
+	if (slot < 0)
+		return LTR390_E_INVALID_LEN;
+
+	emu->dev_id = dev_id;
+	emu->input = NULL;
+	emu->input_ctx = NULL;
+	emu->int_pin = NULL;
+	emu->int_ctx = NULL;
+	emu->fail_next = 0;
+	emu->clock_ppm = 0;
+	ltr390_emu_reset_stats(emu);
+	ltr390_emu_power_on(emu);
+	emu_devs[slot] = emu;
+
+	return LTR390_OK;
+}
+
+
+void ltr390_emu_detach(struct ltr390_emu *emu)
+{
+	uint8_t i;
+
+	for (i = 0; i < LTR390_EMU_MAX_DEV; i++) {
+		if (emu_devs[i] == emu)
+			emu_devs[i] = NULL;
+	}
+}
+
+
+void ltr390_emu_power_on(struct ltr390_emu *emu)
+{
+	/* Registers back to defaults, power-on event flagged */
+	emu_load_defaults(emu);
+	emu->regs[LTR390_REG_MAIN_STATUS] = LTR390_MASK_ALS_UVS_PWR_ON_STAT;
+}
+
+
+void ltr390_emu_set_input(struct ltr390_emu *emu, double lux, double uvi)
+{
+	emu->lux = lux;
+	emu->uvi = uvi;
+}
+
+
+void ltr390_emu_set_input_fn(struct ltr390_emu *emu, ltr390_emu_input_fptr_t input, void *ctx)
+{
+	emu->input = input;
+	emu->input_ctx = ctx;
+}
+
+
+void ltr390_emu_set_int_fn(struct ltr390_emu *emu, ltr390_emu_int_fptr_t int_pin, void *ctx)
+{
+	emu->int_pin = int_pin;
+	emu->int_ctx = ctx;
+}
+
+
+void ltr390_emu_reset_stats(struct ltr390_emu *emu)
+{
+	emu->stats.read_count = 0;
+	emu->stats.write_count = 0;
+	emu->stats.bytes_read = 0;
+	emu->stats.bytes_written = 0;
+	emu->stats.fail_count = 0;
+	emu->stats.conv_count = 0;
+	emu->stats.bus_bits = 0;
+}
+
+
+int8_t ltr390_emu_read(uint8_t dev_id, uint8_t reg_addr, uint8_t *data, uint16_t len)
+{
+	struct ltr390_emu *emu;
+	uint16_t i;
+	uint8_t reg;
+
+	emu = emu_find(dev_id);
+	if ((emu == NULL) || (data == NULL))
+		return LTR390_E_COMM_FAIL;
+
+	emu->stats.read_count++;
+	emu->stats.bus_bits += LTR390_EMU_READ_OVERHEAD_BITS + (uint32_t)len * LTR390_EMU_BYTE_BITS;
+	if (emu->fail_next) {
+		emu->fail_next--;
+		emu->stats.fail_count++;
+		return LTR390_E_COMM_FAIL;
+	}
+
+	emu_update(emu);
+	for (i = 0; i < len; i++) {
+		/* Register address auto-increments */
+		reg = (uint8_t)(reg_addr + i);
+		if (reg == LTR390_REG_PART_ID)
+			data[i] = LTR390_EMU_PART_ID_REG;
+		else if (reg < LTR390_EMU_REG_COUNT)
+			data[i] = emu->regs[reg];
+		else
+			data[i] = 0;
+	}
+	emu->stats.bytes_read += len;
+
+	/* Status flags are cleared once read */
+	if ((reg_addr <= LTR390_REG_MAIN_STATUS) && ((uint16_t)(reg_addr + len) > LTR390_REG_MAIN_STATUS))
+		emu->regs[LTR390_REG_MAIN_STATUS] = 0;
+
+	return LTR390_OK;
+}
+
+
+int8_t ltr390_emu_write(uint8_t dev_id, uint8_t reg_addr, uint8_t *data, uint16_t len)
+{
+	struct ltr390_emu *emu;
+	uint16_t i;
+	uint8_t reg;
+	uint8_t main_ctrl;
+	uint8_t meas_rate;
+
+	emu = emu_find(dev_id);
+	if ((emu == NULL) || (data == NULL))
+		return LTR390_E_COMM_FAIL;
+
+	emu->stats.write_count++;
+	emu->stats.bus_bits += LTR390_EMU_WRITE_OVERHEAD_BITS + (uint32_t)len * LTR390_EMU_BYTE_BITS;
+	if (emu->fail_next) {
+		emu->fail_next--;
+		emu->stats.fail_count++;
+		return LTR390_E_COMM_FAIL;
+	}
+
+	emu_update(emu);
+	main_ctrl = emu->regs[LTR390_REG_MAIN_CTRL];
+	meas_rate = emu->regs[LTR390_REG_ALS_UVS_MEAS_RATE];
+
+	for (i = 0; i < len; i++) {
+		reg = (uint8_t)(reg_addr + i);
+		switch (reg) {
+			case LTR390_REG_MAIN_CTRL:
+				if (data[i] & LTR390_MASK_SOFT_RST) {
+					/* Soft reset, every register back to default */
+					emu_load_defaults(emu);
+					main_ctrl = emu->regs[LTR390_REG_MAIN_CTRL];
+					meas_rate = emu->regs[LTR390_REG_ALS_UVS_MEAS_RATE];
+				} else {
+					emu->regs[reg] = data[i] & (LTR390_MASK_ALS_UVS_EN | LTR390_MASK_UVS_MODE);
+				}
+				break;
+			case LTR390_REG_ALS_UVS_MEAS_RATE:
+				emu->regs[reg] = data[i] & (LTR390_MASK_ALS_UVS_RES | LTR390_MASK_ALS_UVS_MEAS_RATE);
+				break;
+			case LTR390_REG_ALS_UVS_GAIN:
+				emu->regs[reg] = data[i] & LTR390_MASK_ALS_UVS_GAIN_RANGE;
+				break;
+			case LTR390_REG_INT_CFG:
+				emu->regs[reg] = data[i] & (LTR390_MASK_LS_INT_SEL | LTR390_MASK_LS_INT_EN);
+				break;
+			case LTR390_REG_INT_PST:
+				emu->regs[reg] = data[i] & LTR390_MASK_ALS_UVS_PERSIST;
+				break;
+			case LTR390_REG_ALS_UVS_THRES_UP_0:
+			case LTR390_REG_ALS_UVS_THRES_UP_1:
+			case LTR390_REG_ALS_UVS_THRES_LOW_0:
+			case LTR390_REG_ALS_UVS_THRES_LOW_1:
+				emu->regs[reg] = data[i];
+				break;
+			case LTR390_REG_ALS_UVS_THRES_UP_2:
+			case LTR390_REG_ALS_UVS_THRES_LOW_2:
+				emu->regs[reg] = data[i] & 0x0F;
+				break;
+			default:
+				/* Read-only or reserved register, ignored */
+				break;
+		}
+	}
+	emu->stats.bytes_written += len;
+
+	/* Enabling, switching channel or changing the timing starts a new conversion */
+	if ((emu->regs[LTR390_REG_MAIN_CTRL] != main_ctrl) ||
+		(emu->regs[LTR390_REG_ALS_UVS_MEAS_RATE] != meas_rate))
+		emu_restart(emu);
+
+	return LTR390_OK;
+}
+
+
+int8_t ltr390_emu_xfer(struct ltr390_bus_op *ops, uint8_t count, void *ctx)
+{
+	struct ltr390_emu_rec *rec = (struct ltr390_emu_rec *)ctx;
+	struct ltr390_emu_rec_job *job;
+	int8_t rslt = LTR390_OK;
+	uint8_t i;
+
+	if (ops == NULL)
+		return LTR390_E_COMM_FAIL;
+
+	if (rec != NULL) {
+		job = &rec->log[rec->jobs % LTR390_EMU_REC_DEPTH];
+		job->count = count;
+		for (i = 0; (i < count) && (i < LTR390_BUS_MAX_OPS); i++) {
+			job->ops[i].addr = ops[i].addr;
+			job->ops[i].reg_addr = ops[i].reg_addr;
+			job->ops[i].dir = ops[i].dir;
+			job->ops[i].len = ops[i].len;
+		}
+		rec->jobs++;
+		rec->ops += count;
+		if (count > rec->max_ops)
+			rec->max_ops = count;
+	}
+
+	/* In order, the job stops at the first failure like a controller queue */
+	for (i = 0; (i < count) && (rslt == LTR390_OK); i++) {
+		if (ops[i].dir == LTR390_BUS_READ)
+			rslt = ltr390_emu_read(ops[i].addr, ops[i].reg_addr, ops[i].buf, ops[i].len);
+		else
+			rslt = ltr390_emu_write(ops[i].addr, ops[i].reg_addr, ops[i].buf, ops[i].len);
+		if (rslt == LTR390_OK)
+			ops[i].rslt = LTR390_OK;
+	}
+
+	return rslt;
+}
+
+
+void ltr390_emu_rec_reset(struct ltr390_emu_rec *rec)
+{
+	rec->jobs = 0;
+	rec->ops = 0;
+	rec->max_ops = 0;
+}
+
+
+double ltr390_emu_wire_time_us(const struct ltr390_emu_stats *stats, uint32_t bus_hz)
+{
+	if ((stats == NULL) || (bus_hz == 0))
+		return 0.;
+
+	return ((double)stats->bus_bits * 1e6) / (double)bus_hz;
+}
+
+
+void ltr390_emu_advance(uint64_t period_us)
+{
+	uint8_t i;
+
+	emu_time_us += period_us;
+	for (i = 0; i < LTR390_EMU_MAX_DEV; i++) {
+		if (emu_devs[i] != NULL)
+			emu_update(emu_devs[i]);
+	}
+}
+
+
+void ltr390_emu_delay_us(uint32_t period_us)
+{
+	ltr390_emu_advance(period_us);
+}
+
+
+uint32_t ltr390_emu_time_us(void)
+{
+	return (uint32_t)emu_time_us;
+}
+
+
+uint64_t ltr390_emu_now(void)
+{
+	return emu_time_us;
+}
+
+
+void ltr390_emu_set_time(uint64_t time_us)
+{
+	emu_time_us = time_us;
+}
+
+
+static struct ltr390_emu *emu_find(uint8_t addr)
+{
+	uint8_t i;
+	/* The driver passes the handle shifted left with the R/W bit */
+	uint8_t dev_id = (uint8_t)(addr >> 1);
+
+	for (i = 0; i < LTR390_EMU_MAX_DEV; i++) {
+		if ((emu_devs[i] != NULL) && (emu_devs[i]->dev_id == dev_id))
+			return emu_devs[i];
+	}
+
+	return NULL;
+}
+
+static void emu_load_defaults(struct ltr390_emu *emu)
+{
+	uint8_t i;
+
+	for (i = 0; i < LTR390_EMU_REG_COUNT; i++)
+		emu->regs[i] = 0;
+
+	emu->regs[LTR390_REG_MAIN_CTRL] = LTR390_DEF_MAIN_CTRL;
+	emu->regs[LTR390_REG_ALS_UVS_MEAS_RATE] = LTR390_DEF_ALS_UVS_MEAS_RATE;
+	emu->regs[LTR390_REG_ALS_UVS_GAIN] = LTR390_DEF_ALS_UVS_GAIN;
+	emu->regs[LTR390_REG_PART_ID] = LTR390_EMU_PART_ID_REG;
+	emu->regs[LTR390_REG_INT_CFG] = LTR390_DEF_INT_CFG;
+	emu->regs[LTR390_REG_INT_PST] = LTR390_DEF_INT_PST;
+	emu->regs[LTR390_REG_ALS_UVS_THRES_UP_0] = LTR390_GET_LSB(LTR390_DEF_ALS_UVS_THRES_UP);
+	emu->regs[LTR390_REG_ALS_UVS_THRES_UP_1] = LTR390_GET_MID(LTR390_DEF_ALS_UVS_THRES_UP);
+	emu->regs[LTR390_REG_ALS_UVS_THRES_UP_2] = LTR390_GET_MSB(LTR390_DEF_ALS_UVS_THRES_UP);
+	emu->int_count = 0;
+	emu->next_conv_us = 0;
+}
+
+static void emu_update(struct ltr390_emu *emu)
+{
+	/* Complete every conversion due by now */
+	if (emu->regs[LTR390_REG_MAIN_CTRL] & LTR390_MASK_ALS_UVS_EN) {
+		while (emu->next_conv_us <= emu_time_us) {
+			emu_convert(emu, emu->next_conv_us);
+			emu->next_conv_us += emu_period_us(emu);
+		}
+	}
+}
+
+static void emu_convert(struct ltr390_emu *emu, uint64_t time_us)
+{
+	uint8_t res = (emu->regs[LTR390_REG_ALS_UVS_MEAS_RATE] & LTR390_MASK_ALS_UVS_RES) >> LTR390_POS_ALS_UVS_RES;
+	uint8_t gain = emu->regs[LTR390_REG_ALS_UVS_GAIN] & LTR390_MASK_ALS_UVS_GAIN_RANGE;
+	uint8_t uvs = (emu->regs[LTR390_REG_MAIN_CTRL] & LTR390_MASK_UVS_MODE) ? TRUE : FALSE;
+	uint8_t int_cfg = emu->regs[LTR390_REG_INT_CFG];
+	uint8_t int_sel;
+	uint8_t pers;
+	uint32_t full_scale = (UINT32_C(1) << emu_res_bits[res]) - 1;
+	uint32_t counts;
+	uint32_t thres_up;
+	uint32_t thres_low;
+	uint8_t reg;
+	double lux = emu->lux;
+	double uvi = emu->uvi;
+	double value;
+
+	if (emu->input != NULL)
+		emu->input(time_us, &lux, &uvi, emu->input_ctx);
+
+	/* Inverse of the datasheet lux and UVI formulas, saturated at full scale */
+	if (uvs)
+		value = uvi * EMU_UVS_SENSITIVITY * (emu_gain[gain] / 18.) * (emu_int_factor[res] / 4.);
+	else
+		value = lux * emu_gain[gain] * emu_int_factor[res] / LTR390_EMU_ALS_LUX_FACTOR;
+
+	if (value <= 0.)
+		counts = 0;
+	else if (value >= (double)full_scale)
+		counts = full_scale;
+	else
+		counts = (uint32_t)(value + 0.5);
+
+	reg = uvs ? LTR390_REG_UVS_DATA_0 : LTR390_REG_ALS_DATA_0;
+	emu->regs[reg] = LTR390_GET_LSB(counts);
+	emu->regs[reg + 1] = LTR390_GET_MID(counts);
+	emu->regs[reg + 2] = LTR390_GET_MSB(counts);
+	emu->regs[LTR390_REG_MAIN_STATUS] |= LTR390_MASK_ALS_UVS_DATA_STAT;
+	emu->stats.conv_count++;
+
+	/* Threshold interrupt on the selected channel, with persistence */
+	int_sel = (uint8_t)LTR390_GET_BITS(int_cfg, LTR390_POS_LS_INT_SEL, LTR390_MASK_LS_INT_SEL);
+	if ((int_cfg & LTR390_MASK_LS_INT_EN) &&
+		(((int_sel == LTR390_VAL_LS_INT_SEL_UVS) && uvs) || ((int_sel == LTR390_VAL_LS_INT_SEL_ALS) && !uvs))) {
+		thres_up = LTR390_CONCAT_BYTES(emu->regs[LTR390_REG_ALS_UVS_THRES_UP_2],
+									emu->regs[LTR390_REG_ALS_UVS_THRES_UP_1],
+									emu->regs[LTR390_REG_ALS_UVS_THRES_UP_0]);
+		thres_low = LTR390_CONCAT_BYTES(emu->regs[LTR390_REG_ALS_UVS_THRES_LOW_2],
+									emu->regs[LTR390_REG_ALS_UVS_THRES_LOW_1],
+									emu->regs[LTR390_REG_ALS_UVS_THRES_LOW_0]);
+		pers = (uint8_t)LTR390_GET_BITS(emu->regs[LTR390_REG_INT_PST], LTR390_POS_ALS_UVS_PERSIST,
+									LTR390_MASK_ALS_UVS_PERSIST);
+		if ((counts > thres_up) || (counts < thres_low)) {
+			if (emu->int_count <= pers)
+				emu->int_count++;
+			if ((emu->int_count > pers) &&
+				!(emu->regs[LTR390_REG_MAIN_STATUS] & LTR390_MASK_ALS_UVS_INT_STAT)) {
+				/* INT pin goes active until MAIN_STATUS is read */
+				emu->regs[LTR390_REG_MAIN_STATUS] |= LTR390_MASK_ALS_UVS_INT_STAT;
+				if (emu->int_pin != NULL)
+					emu->int_pin(emu->dev_id, emu->int_ctx);
+			}
+		} else {
+			emu->int_count = 0;
+		}
+	}
+}
+
+static void emu_restart(struct ltr390_emu *emu)
+{
+	uint8_t res = (emu->regs[LTR390_REG_ALS_UVS_MEAS_RATE] & LTR390_MASK_ALS_UVS_RES) >> LTR390_POS_ALS_UVS_RES;
+
+	/* First result after one integration time */
+	emu->next_conv_us = emu_time_us + emu_skew_us(emu, emu_conv_us[res]);
+	emu->int_count = 0;
+}
+
+static uint32_t emu_period_us(const struct ltr390_emu *emu)
+{
+	uint8_t meas_rate = emu->regs[LTR390_REG_ALS_UVS_MEAS_RATE];
+	uint8_t res = (meas_rate & LTR390_MASK_ALS_UVS_RES) >> LTR390_POS_ALS_UVS_RES;
+	uint8_t rate = meas_rate & LTR390_MASK_ALS_UVS_MEAS_RATE;
+
+	/* Measurement rate, stretched to the conversion time if shorter */
+	if (emu_conv_us[res] > emu_rate_us[rate])
+		return emu_skew_us(emu, emu_conv_us[res]);
+
+	return emu_skew_us(emu, emu_rate_us[rate]);
+}
+
+static uint32_t emu_skew_us(const struct ltr390_emu *emu, uint32_t period_us)
+{
+	/* Sensor clock against the virtual clock */
+	return (uint32_t)(((int64_t)period_us * (1000000 + emu->clock_ppm)) / 1000000);
+}
@@ -0,0 +1,190 @@
+/*
+ * This file is part of the LTR-390-UV-01 library (https://github.com/Cplaton/ltr390).
+ * Copyright (c) 2021 Clement Platon.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host-side LTR-390-UV-01 emulator.
+ *
+ * Each emulated sensor is attached under a dev_id handle and is reached
+ * through ltr390_emu_read/ltr390_emu_write, which follow the
+ * ltr390_com_fptr_t signature. All sensors share one virtual clock that
+ * only moves through ltr390_emu_delay_us/ltr390_emu_advance, so
+ * conversions complete deterministically.
+ *
+ * ltr390_emu_xfer is a job transport for ltr390_dev.xfer over the same
+ * sensors. Given a struct ltr390_emu_rec as context, it records each
+ * submission.
+ */
+
+#ifndef LTR390_EMU_H_
+#define LTR390_EMU_H_
+
+/********************************************************/
+/* header includes */
+#include "ltr390uv_defs.h"
+
+
+/********************************************************/
+/*                      Consts                          */
+/********************************************************/
+
+/* Maximum number of attached sensors */
+#define LTR390_EMU_MAX_DEV                      16
+
+/* Register map size (0x00 to ALS_UVS_THRES_LOW_2) */
+#define LTR390_EMU_REG_COUNT                    (LTR390_REG_ALS_UVS_THRES_LOW_2 + 1)
+
+/* Register value returned by PART_ID (part 0xB, revision 2) */
+#define LTR390_EMU_PART_ID_REG                  0xB2
+
+/* I2C clocks per transaction: start, address, register, stop */
+#define LTR390_EMU_WRITE_OVERHEAD_BITS          20
+/* I2C clocks per read: write overhead plus repeated start and address */
+#define LTR390_EMU_READ_OVERHEAD_BITS           30
+/* I2C clocks per data byte (8 bits and ACK) */
+#define LTR390_EMU_BYTE_BITS                    9
+
+/* ALS count per lux at gain 1x and 100ms integration */
+#define LTR390_EMU_ALS_LUX_FACTOR               0.6
+
+/* Submissions kept by the recording transport */
+#define LTR390_EMU_REC_DEPTH                    16
+
+
+/* Type definitions */
+typedef void (*ltr390_emu_input_fptr_t)(uint64_t time_us, double *lux, double *uvi, void *ctx);
+
+typedef void (*ltr390_emu_int_fptr_t)(uint8_t dev_id, void *ctx);
+
+
+/* ltr390 emulator bus statistics */
+struct ltr390_emu_stats {
+    /* Read transactions */
+    uint32_t read_count;
+    /* Write transactions */
+    uint32_t write_count;
+    /* Data bytes read */
+    uint32_t bytes_read;
+    /* Data bytes written */
+    uint32_t bytes_written;
+    /* Transactions answered with a failure */
+    uint32_t fail_count;
+    /* Conversions completed */
+    uint32_t conv_count;
+    /* I2C clock cycles spent on the wire */
+    uint32_t bus_bits;
+};
+
+/* ltr390 emulated sensor */
+struct ltr390_emu {
+    /* Handle the sensor answers to (ltr390_dev.dev_id) */
+    uint8_t dev_id;
+    /* Register map */
+    uint8_t regs[LTR390_EMU_REG_COUNT];
+    /* Illuminance seen by the sensor, when no input function */
+    double lux;
+    /* UV index seen by the sensor, when no input function */
+    double uvi;
+    /* Scripted input function (optional) */
+    ltr390_emu_input_fptr_t input;
+    /* Input function context */
+    void *input_ctx;
+    /* INT pin assertion hook (optional) */
+    ltr390_emu_int_fptr_t int_pin;
+    /* INT pin hook context */
+    void *int_ctx;
+    /* Completion time of the running conversion */
+    uint64_t next_conv_us;
+    /* Consecutive out of threshold conversions */
+    uint8_t int_count;
+    /* Number of upcoming transactions to fail */
+    uint8_t fail_next;
+    /* Internal oscillator error in ppm, stretches conversion timing */
+    int32_t clock_ppm;
+    /* Bus statistics */
+    struct ltr390_emu_stats stats;
+};
+
+/* ltr390 recorded bus operation */
+struct ltr390_emu_rec_op {
+    /* Device address with the R/W bit */
+    uint8_t addr;
+    /* Register address */
+    uint8_t reg_addr;
+    /* LTR390_BUS_READ or LTR390_BUS_WRITE */
+    uint8_t dir;
+    /* Data length */
+    uint16_t len;
+};
+
+/* ltr390 recorded submission */
+struct ltr390_emu_rec_job {
+    /* Operations submitted, only the first LTR390_BUS_MAX_OPS are kept */
+    uint8_t count;
+    /* Operations in submission order */
+    struct ltr390_emu_rec_op ops[LTR390_BUS_MAX_OPS];
+};
+
+/* ltr390 job transport recorder */
+struct ltr390_emu_rec {
+    /* Submissions */
+    uint32_t jobs;
+    /* Operations over all submissions */
+    uint32_t ops;
+    /* Largest submission */
+    uint8_t max_ops;
+    /* Last LTR390_EMU_REC_DEPTH submissions, submission n in log[n % depth] */
+    struct ltr390_emu_rec_job log[LTR390_EMU_REC_DEPTH];
+};
+
+
+/********************************************************/
+
+int8_t ltr390_emu_attach(struct ltr390_emu *emu, uint8_t dev_id);
+
+void ltr390_emu_detach(struct ltr390_emu *emu);
+
+void ltr390_emu_power_on(struct ltr390_emu *emu);
+
+void ltr390_emu_set_input(struct ltr390_emu *emu, double lux, double uvi);
+
+void ltr390_emu_set_input_fn(struct ltr390_emu *emu, ltr390_emu_input_fptr_t input, void *ctx);
+
+void ltr390_emu_set_int_fn(struct ltr390_emu *emu, ltr390_emu_int_fptr_t int_pin, void *ctx);
+
+void ltr390_emu_reset_stats(struct ltr390_emu *emu);
+
+int8_t ltr390_emu_read(uint8_t dev_id, uint8_t reg_addr, uint8_t *data, uint16_t len);
+
+int8_t ltr390_emu_write(uint8_t dev_id, uint8_t reg_addr, uint8_t *data, uint16_t len);
+
+int8_t ltr390_emu_xfer(struct ltr390_bus_op *ops, uint8_t count, void *ctx);
+
+void ltr390_emu_rec_reset(struct ltr390_emu_rec *rec);
+
+double ltr390_emu_wire_time_us(const struct ltr390_emu_stats *stats, uint32_t bus_hz);
+
+void ltr390_emu_advance(uint64_t period_us);
+
+void ltr390_emu_delay_us(uint32_t period_us);
+
+uint32_t ltr390_emu_time_us(void);
+
+uint64_t ltr390_emu_now(void);
+
+void ltr390_emu_set_time(uint64_t time_us);
+
+#endif /* LTR390_EMU_H_ */
@@ -0,0 +1,232 @@
+/*
+ * This file is part of the LTR-390-UV-01 library (https://github.com/Cplaton/ltr390).
+ * Copyright (c) 2021 Clement Platon.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/********************************************************/
+/* header includes */
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include "ltr390uv_event.h"
+#include "ltr390uv.h"
+
+/* Large enough for an eventfd counter or a GPIO line event */
+#define EVENT_ACK_BUF_LEN                       64
+
+static int8_t event_handle(struct ltr390_event_loop *loop, struct ltr390_event_entry *entry);
+
+static int8_t event_ack_read(int fd, void *ctx);
+
+/********************************************************/
+
+
+int8_t ltr390_event_init(struct ltr390_event_loop *loop, ltr390_event_cb_t callback, void *ctx)
+{
+	if (loop == NULL)
+		return LTR390_E_NULL_PTR;
+
+	loop->dev_count = 0;
+	loop->callback = callback;
+	loop->cb_ctx = ctx;
+	loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (loop->epoll_fd < 0)
+		return LTR390_E_INVALID_VAL;
+
+	return LTR390_OK;
+}
+
+
+int8_t ltr390_event_add(struct ltr390_event_loop *loop, struct ltr390_dev *dev, const struct ltr390_int_src *src)
+{
+	struct ltr390_event_entry *entry;
+	struct epoll_event ev;
+
+	if ((loop == NULL) || (dev == NULL) || (src == NULL))
+		return LTR390_E_NULL_PTR;
+	if (src->fd < 0)
+		return LTR390_E_INVALID_VAL;
+	if (loop->dev_count >= LTR390_EVENT_MAX_DEV)
+		return LTR390_E_INVALID_LEN;
+
+	entry = &loop->devs[loop->dev_count];
+	entry->dev = dev;
+	entry->src = *src;
+	entry->stats.events = 0;
+	entry->stats.interrupts = 0;
+	entry->stats.spurious = 0;
+	entry->stats.errors = 0;
+
+	/* Level triggered: an event left pending is reported again */
+	ev.events = EPOLLIN;
+	ev.data.u32 = loop->dev_count;
+	if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, src->fd, &ev) < 0)
+		return LTR390_E_INVALID_VAL;
+	loop->dev_count++;
+
+	return LTR390_OK;
+}
+
+
+int ltr390_event_fd(const struct ltr390_event_loop *loop)
+{
+	/* Readable when any sensor has an event, for use in an outer loop */
+	if (loop == NULL)
+		return -1;
+
+	return loop->epoll_fd;
+}
+
+
+int8_t ltr390_event_run_once(struct ltr390_event_loop *loop, int timeout_ms, uint8_t *handled)
+{
+	int8_t rslt = LTR390_OK;
+	int8_t entry_rslt;
+	struct epoll_event events[LTR390_EVENT_MAX_DEV];
+	int count;
+	int i;
+
+	if (loop == NULL)
+		return LTR390_E_NULL_PTR;
+	if (handled != NULL)
+		*handled = 0;
+
+	/* Sleep until an INT line fires, no bus traffic while idle */
+	count = epoll_wait(loop->epoll_fd, events, LTR390_EVENT_MAX_DEV, timeout_ms);
+	if (count < 0)
+		return (errno == EINTR) ? LTR390_OK : LTR390_E_INVALID_VAL;
+	if (count == 0)
+		return LTR390_E_TIMEOUT;
+
+	for (i = 0; i < count; i++) {
+		if (events[i].data.u32 >= loop->dev_count)
+			continue;
+		entry_rslt = event_handle(loop, &loop->devs[events[i].data.u32]);
+		/* Report the first failure, the other sensors are still served */
+		if ((entry_rslt != LTR390_OK) && (rslt == LTR390_OK))
+			rslt = entry_rslt;
+	}
+	if (handled != NULL)
+		*handled = (uint8_t)count;
+
+	return rslt;
+}
+
+
+int8_t ltr390_event_get_stats(const struct ltr390_event_loop *loop, const struct ltr390_dev *dev, struct ltr390_event_stats *stats)
+{
+	uint8_t i;
+
+	if ((loop == NULL) || (dev == NULL) || (stats == NULL))
+		return LTR390_E_NULL_PTR;
+
+	for (i = 0; i < loop->dev_count; i++) {
+		if (loop->devs[i].dev == dev) {
+			*stats = loop->devs[i].stats;
+			return LTR390_OK;
+		}
+	}
+
+	return LTR390_E_INVALID_VAL;
+}
+
+
+void ltr390_event_deinit(struct ltr390_event_loop *loop)
+{
+	/* INT line sources belong to the caller and stay open */
+	if ((loop == NULL) || (loop->epoll_fd < 0))
+		return;
+
+	close(loop->epoll_fd);
+	loop->epoll_fd = -1;
+	loop->dev_count = 0;
+}
+
+
+int8_t ltr390_event_eventfd_open(struct ltr390_int_src *src)
+{
+	if (src == NULL)
+		return LTR390_E_NULL_PTR;
+
+	/* Stand-in INT line, closed by the caller with close(2) */
+	src->fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	src->ack = NULL;
+	src->ctx = NULL;
+	if (src->fd < 0)
+		return LTR390_E_INVALID_VAL;
+
+	return LTR390_OK;
+}
+
+
+void ltr390_event_raise(uint8_t dev_id, void *ctx)
+{
+	const struct ltr390_int_src *src = (const struct ltr390_int_src *)ctx;
+	uint64_t one = 1;
+
+	(void)dev_id;
+	/* Matches ltr390_emu_int_fptr_t, ctx is the eventfd source */
+	if ((src != NULL) && (src->fd >= 0))
+		(void)write(src->fd, &one, sizeof(one));
+}
+
+
+static int8_t event_handle(struct ltr390_event_loop *loop, struct ltr390_event_entry *entry)
+{
+	struct ltr390_frame frame;
+	int8_t rslt;
+
+	entry->stats.events++;
+
+	if (entry->src.ack != NULL)
+		rslt = entry->src.ack(entry->src.fd, entry->src.ctx);
+	else
+		rslt = event_ack_read(entry->src.fd, NULL);
+	if (rslt != LTR390_OK) {
+		entry->stats.errors++;
+		return rslt;
+	}
+
+	/* Status and data in one read, which also releases the INT line */
+	rslt = ltr390_get_frame(&frame, entry->dev);
+	if (rslt != LTR390_OK) {
+		entry->stats.errors++;
+		return rslt;
+	}
+
+	if (!(frame.status & LTR390_MASK_ALS_UVS_INT_STAT)) {
+		entry->stats.spurious++;
+		return LTR390_OK;
+	}
+
+	entry->stats.interrupts++;
+	if (loop->callback != NULL)
+		loop->callback(entry->dev, &frame, loop->cb_ctx);
+
+	return LTR390_OK;
+}
+
+static int8_t event_ack_read(int fd, void *ctx)
+{
+	uint8_t buf[EVENT_ACK_BUF_LEN];
+
+	(void)ctx;
+	/* Nothing left to read is fine, another event may have raced us */
+	if ((read(fd, buf, sizeof(buf)) < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK))
+		return LTR390_E_COMM_FAIL;
+
+	return LTR390_OK;
+}
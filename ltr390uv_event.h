@@ -0,0 +1,118 @@
+/*
+ * This file is part of the LTR-390-UV-01 library (https://github.com/Cplaton/ltr390).
+ * Copyright (c) 2021 Clement Platon.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Interrupt-driven acquisition (Linux).
+ *
+ * The INT line of each sensor is delivered through a file descriptor
+ * that becomes readable when the line is asserted: a GPIO line event fd,
+ * a UIO fd, or an eventfd (ltr390_event_eventfd_open) raised by the
+ * emulator through ltr390_event_raise. Sensors are waited on with a
+ * single epoll set. On an event the status and data registers are read
+ * in one transaction (which also releases the INT line) and the callback
+ * gets the frame when the interrupt bit is set. Nothing touches the bus
+ * between events.
+ */
+
+#ifndef LTR390_EVENT_H_
+#define LTR390_EVENT_H_
+
+/********************************************************/
+/* header includes */
+#include "ltr390uv_defs.h"
+
+
+/********************************************************/
+/*                      Consts                          */
+/********************************************************/
+
+/* Maximum number of sensors per event loop */
+#define LTR390_EVENT_MAX_DEV                    16
+
+
+/* Type definitions */
+typedef void (*ltr390_event_cb_t)(struct ltr390_dev *dev, const struct ltr390_frame *frame, void *ctx);
+
+typedef int8_t (*ltr390_event_ack_fptr_t)(int fd, void *ctx);
+
+
+/* ltr390 INT line source */
+struct ltr390_int_src {
+    /* Readable while an INT event is pending */
+    int fd;
+    /* Consumes the pending event, NULL to read and drop it */
+    ltr390_event_ack_fptr_t ack;
+    /* Acknowledge context */
+    void *ctx;
+};
+
+/* ltr390 event statistics */
+struct ltr390_event_stats {
+    /* INT line events */
+    uint32_t events;
+    /* Events with the interrupt bit set, delivered to the callback */
+    uint32_t interrupts;
+    /* Events without the interrupt bit set */
+    uint32_t spurious;
+    /* Failed acknowledges or register reads */
+    uint32_t errors;
+};
+
+/* ltr390 event-driven sensor */
+struct ltr390_event_entry {
+    /* Sensor */
+    struct ltr390_dev *dev;
+    /* INT line source */
+    struct ltr390_int_src src;
+    /* Statistics */
+    struct ltr390_event_stats stats;
+};
+
+/* ltr390 event loop */
+struct ltr390_event_loop {
+    /* Event-driven sensors */
+    struct ltr390_event_entry devs[LTR390_EVENT_MAX_DEV];
+    /* Number of sensors */
+    uint8_t dev_count;
+    /* epoll set over the INT line sources */
+    int epoll_fd;
+    /* Interrupt callback */
+    ltr390_event_cb_t callback;
+    /* Callback context */
+    void *cb_ctx;
+};
+
+
+/********************************************************/
+
+int8_t ltr390_event_init(struct ltr390_event_loop *loop, ltr390_event_cb_t callback, void *ctx);
+
+int8_t ltr390_event_add(struct ltr390_event_loop *loop, struct ltr390_dev *dev, const struct ltr390_int_src *src);
+
+int ltr390_event_fd(const struct ltr390_event_loop *loop);
+
+int8_t ltr390_event_run_once(struct ltr390_event_loop *loop, int timeout_ms, uint8_t *handled);
+
+int8_t ltr390_event_get_stats(const struct ltr390_event_loop *loop, const struct ltr390_dev *dev, struct ltr390_event_stats *stats);
+
+void ltr390_event_deinit(struct ltr390_event_loop *loop);
+
+int8_t ltr390_event_eventfd_open(struct ltr390_int_src *src);
+
+void ltr390_event_raise(uint8_t dev_id, void *ctx);
+
+#endif /* LTR390_EVENT_H_ */
@@ -0,0 +1,282 @@
+/*
+ * This file is part of the LTR-390-UV-01 library (https://github.com/Cplaton/ltr390).
+ * Copyright (c) 2021 Clement Platon.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/********************************************************/
+/* header includes */
+#include "ltr390uv_filter.h"
+
+static int8_t filter_add(struct ltr390_filter *filter, uint8_t type, uint8_t param, uint8_t pct);
+
+static uint32_t filter_avg(struct ltr390_filter_stage *stage, uint32_t value);
+
+static uint32_t filter_median(struct ltr390_filter_stage *stage, uint32_t value);
+
+static uint32_t filter_ema(struct ltr390_filter_stage *stage, uint32_t value);
+
+static uint32_t filter_spike(struct ltr390_filter *filter, struct ltr390_filter_stage *stage, uint32_t value);
+
+static uint8_t sorted_search(const uint32_t *sorted, uint8_t count, uint32_t value);
+
+/********************************************************/
+
+
+void ltr390_filter_init(struct ltr390_filter *filter)
+{
+	if (filter == NULL)
+		return;
+
+	filter->count = 0;
+	filter->mode = 0;
+	filter->gain_range = 0;
+	filter->resolution = 0;
+	filter->primed = FALSE;
+	filter->resets = 0;
+	filter->rejected = 0;
+}
+
+
+int8_t ltr390_filter_add_avg(struct ltr390_filter *filter, uint8_t window)
+{
+	if ((window == 0) || (window > LTR390_FILTER_MAX_WINDOW))
+		return LTR390_E_INVALID_LEN;
+
+	return filter_add(filter, LTR390_FILTER_AVG, window, 0);
+}
+
+
+int8_t ltr390_filter_add_median(struct ltr390_filter *filter, uint8_t window)
+{
+	if ((window == 0) || (window > LTR390_FILTER_MAX_WINDOW))
+		return LTR390_E_INVALID_LEN;
+
+	return filter_add(filter, LTR390_FILTER_MEDIAN, window, 0);
+}
+
+
+int8_t ltr390_filter_add_ema(struct ltr390_filter *filter, uint8_t shift)
+{
+	if ((shift == 0) || (shift > LTR390_FILTER_MAX_SHIFT))
+		return LTR390_E_INVALID_VAL;
+
+	return filter_add(filter, LTR390_FILTER_EMA, shift, 0);
+}
+
+
+int8_t ltr390_filter_add_spike(struct ltr390_filter *filter, uint8_t pct, uint8_t max_run)
+{
+	if ((pct == 0) || (max_run == 0))
+		return LTR390_E_INVALID_VAL;
+
+	return filter_add(filter, LTR390_FILTER_SPIKE, max_run, pct);
+}
+
+
+int8_t ltr390_filter_apply(struct ltr390_filter *filter, const struct ltr390_sample *in, struct ltr390_sample *out)
+{
+	struct ltr390_filter_stage *stage;
+	uint32_t value;
+	uint8_t i;
+
+	if ((filter == NULL) || (in == NULL) || (out == NULL))
+		return LTR390_E_NULL_PTR;
+	/* Stale samples would weigh twice */
+	if (!(in->flags & LTR390_SAMPLE_FRESH))
+		return LTR390_W_NO_NEW_DATA;
+
+	/* Counts from another configuration are not comparable, start over */
+	if ((filter->primed == TRUE) &&
+		((in->mode != filter->mode) || (in->gain_range != filter->gain_range) ||
+		(in->resolution != filter->resolution))) {
+		ltr390_filter_reset(filter);
+		filter->resets++;
+	}
+	filter->mode = in->mode;
+	filter->gain_range = in->gain_range;
+	filter->resolution = in->resolution;
+	filter->primed = TRUE;
+
+	value = in->raw;
+	for (i = 0; i < filter->count; i++) {
+		stage = &filter->stages[i];
+		switch (stage->type)
+		{
+			case LTR390_FILTER_AVG:
+				value = filter_avg(stage, value);
+				break;
+			case LTR390_FILTER_MEDIAN:
+				value = filter_median(stage, value);
+				break;
+			case LTR390_FILTER_EMA:
+				value = filter_ema(stage, value);
+				break;
+			default:
+				value = filter_spike(filter, stage, value);
+				break;
+		}
+	}
+
+	*out = *in;
+	out->raw = value;
+
+	return LTR390_OK;
+}
+
+
+void ltr390_filter_reset(struct ltr390_filter *filter)
+{
+	uint8_t i;
+
+	if (filter == NULL)
+		return;
+
+	for (i = 0; i < filter->count; i++) {
+		filter->stages[i].count = 0;
+		filter->stages[i].head = 0;
+		filter->stages[i].run = 0;
+		filter->stages[i].acc = 0;
+	}
+	filter->primed = FALSE;
+}
+
+
+static int8_t filter_add(struct ltr390_filter *filter, uint8_t type, uint8_t param, uint8_t pct)
+{
+	struct ltr390_filter_stage *stage;
+
+	if (filter == NULL)
+		return LTR390_E_NULL_PTR;
+	if (filter->count >= LTR390_FILTER_MAX_STAGES)
+		return LTR390_E_INVALID_LEN;
+
+	stage = &filter->stages[filter->count];
+	stage->type = type;
+	stage->param = param;
+	stage->pct = pct;
+	stage->count = 0;
+	stage->head = 0;
+	stage->run = 0;
+	stage->acc = 0;
+	filter->count++;
+
+	return LTR390_OK;
+}
+
+static uint32_t filter_avg(struct ltr390_filter_stage *stage, uint32_t value)
+{
+	/* Window of 32 20-bit counts, the sum fits 25 bits */
+	if (stage->count == stage->param) {
+		stage->acc -= stage->hist[stage->head];
+		stage->hist[stage->head] = value;
+		stage->head = (uint8_t)((stage->head + 1) % stage->param);
+	} else {
+		stage->hist[stage->count] = value;
+		stage->count++;
+	}
+	stage->acc += value;
+
+	return (stage->acc + stage->count / 2) / stage->count;
+}
+
+static uint32_t filter_median(struct ltr390_filter_stage *stage, uint32_t value)
+{
+	uint8_t pos;
+	uint8_t i;
+
+	if (stage->count == stage->param) {
+		/* Drop the oldest sample from the sorted window */
+		pos = sorted_search(stage->sorted, stage->count, stage->hist[stage->head]);
+		for (i = pos; i + 1 < stage->count; i++)
+			stage->sorted[i] = stage->sorted[i + 1];
+		stage->count--;
+		stage->hist[stage->head] = value;
+		stage->head = (uint8_t)((stage->head + 1) % stage->param);
+	} else {
+		stage->hist[stage->count] = value;
+	}
+
+	/* Insert the new one in place */
+	pos = sorted_search(stage->sorted, stage->count, value);
+	for (i = stage->count; i > pos; i--)
+		stage->sorted[i] = stage->sorted[i - 1];
+	stage->sorted[pos] = value;
+	stage->count++;
+
+	return (stage->sorted[(stage->count - 1) / 2] + stage->sorted[stage->count / 2]) / 2;
+}
+
+static uint32_t filter_ema(struct ltr390_filter_stage *stage, uint32_t value)
+{
+	uint32_t target = value << LTR390_FILTER_EMA_FRAC;
+
+	/* First sample seeds the state, then acc += (x - acc) / 2^shift */
+	if (stage->count == 0) {
+		stage->acc = target;
+		stage->count = 1;
+	} else if (target >= stage->acc) {
+		stage->acc += (target - stage->acc) >> stage->param;
+	} else {
+		stage->acc -= (stage->acc - target) >> stage->param;
+	}
+
+	return (stage->acc + (UINT32_C(1) << (LTR390_FILTER_EMA_FRAC - 1))) >> LTR390_FILTER_EMA_FRAC;
+}
+
+static uint32_t filter_spike(struct ltr390_filter *filter, struct ltr390_filter_stage *stage, uint32_t value)
+{
+	uint32_t dev;
+	uint32_t limit;
+
+	if (stage->count == 0) {
+		stage->acc = value;
+		stage->count = 1;
+		return value;
+	}
+
+	dev = (value > stage->acc) ? (value - stage->acc) : (stage->acc - value);
+	limit = (uint32_t)(((uint64_t)stage->acc * stage->pct) / 100);
+	if (limit < LTR390_FILTER_SPIKE_MIN_DEV)
+		limit = LTR390_FILTER_SPIKE_MIN_DEV;
+
+	/* Hold the reference, unless the departure lasts: then it is a step */
+	if ((dev > limit) && (stage->run < stage->param)) {
+		stage->run++;
+		filter->rejected++;
+		return stage->acc;
+	}
+	stage->run = 0;
+	stage->acc = value;
+
+	return value;
+}
+
+static uint8_t sorted_search(const uint32_t *sorted, uint8_t count, uint32_t value)
+{
+	uint8_t low = 0;
+	uint8_t high = count;
+	uint8_t mid;
+
+	/* First slot holding a value >= value */
+	while (low < high) {
+		mid = (uint8_t)((low + high) / 2);
+		if (sorted[mid] < value)
+			low = (uint8_t)(mid + 1);
+		else
+			high = mid;
+	}
+
+	return low;
+}
@@ -0,0 +1,126 @@
+/*
+ * This file is part of the LTR-390-UV-01 library (https://github.com/Cplaton/ltr390).
+ * Copyright (c) 2021 Clement Platon.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Streaming filters over raw samples, fixed memory, integer only.
+ *
+ * A filter is a chain of up to LTR390_FILTER_MAX_STAGES stages, applied
+ * in the order they were added. One filter is meant for one channel.
+ * Raw counts taken with different mode, gain range or resolution are
+ * not comparable, so every stage is reset when a sample tagged with
+ * another configuration comes in.
+ *
+ * - AVG: running-sum moving average over a window
+ * - MEDIAN: sliding median, window kept sorted by binary-search
+ *   insertion and removal, no re-sort. The shifts make it O(W) per
+ *   sample; with W bounded by LTR390_FILTER_MAX_WINDOW (32) that is a
+ *   few dozen word moves, cheaper than an indexable tree or two heaps
+ *   at this size and with no extra state
+ * - EMA: exponential moving average, alpha = 1/2^shift, Q8 state
+ * - SPIKE: holds the previous value while a sample departs from it by
+ *   more than pct percent, for at most max_run samples in a row, so a
+ *   real step still gets through
+ */
+
+#ifndef LTR390_FILTER_H_
+#define LTR390_FILTER_H_
+
+/********************************************************/
+/* header includes */
+#include "ltr390uv_defs.h"
+
+
+/********************************************************/
+/*                      Consts                          */
+/********************************************************/
+
+/* Stage types */
+#define LTR390_FILTER_AVG                       0x00
+#define LTR390_FILTER_MEDIAN                    0x01
+#define LTR390_FILTER_EMA                       0x02
+#define LTR390_FILTER_SPIKE                     0x03
+
+/* Limits */
+#define LTR390_FILTER_MAX_STAGES                4
+#define LTR390_FILTER_MAX_WINDOW                32
+#define LTR390_FILTER_MAX_SHIFT                 8
+
+/* EMA state fraction width */
+#define LTR390_FILTER_EMA_FRAC                  8
+
+/* SPIKE deviation always tolerated, in counts, for dark readings */
+#define LTR390_FILTER_SPIKE_MIN_DEV             16
+
+
+/* ltr390 filter stage */
+struct ltr390_filter_stage {
+    /* Stage type (LTR390_FILTER_xxx) */
+    uint8_t type;
+    /* AVG/MEDIAN window, EMA shift, SPIKE longest run */
+    uint8_t param;
+    /* SPIKE deviation in percent */
+    uint8_t pct;
+    /* Samples held */
+    uint8_t count;
+    /* Oldest sample slot */
+    uint8_t head;
+    /* SPIKE samples rejected in a row */
+    uint8_t run;
+    /* AVG running sum, EMA Q8 state, SPIKE reference */
+    uint32_t acc;
+    /* Samples in arrival order */
+    uint32_t hist[LTR390_FILTER_MAX_WINDOW];
+    /* MEDIAN samples in ascending order */
+    uint32_t sorted[LTR390_FILTER_MAX_WINDOW];
+};
+
+/* ltr390 filter chain */
+struct ltr390_filter {
+    /* Stages, applied in order */
+    struct ltr390_filter_stage stages[LTR390_FILTER_MAX_STAGES];
+    /* Stages in use */
+    uint8_t count;
+    /* Configuration of the samples held */
+    uint8_t mode;
+    uint8_t gain_range;
+    uint8_t resolution;
+    /* At least one sample held */
+    uint8_t primed;
+    /* Resets on configuration change */
+    uint32_t resets;
+    /* Samples held back by SPIKE stages */
+    uint32_t rejected;
+};
+
+
+/********************************************************/
+
+void ltr390_filter_init(struct ltr390_filter *filter);
+
+int8_t ltr390_filter_add_avg(struct ltr390_filter *filter, uint8_t window);
+
+int8_t ltr390_filter_add_median(struct ltr390_filter *filter, uint8_t window);
+
+int8_t ltr390_filter_add_ema(struct ltr390_filter *filter, uint8_t shift);
+
+int8_t ltr390_filter_add_spike(struct ltr390_filter *filter, uint8_t pct, uint8_t max_run);
+
+int8_t ltr390_filter_apply(struct ltr390_filter *filter, const struct ltr390_sample *in, struct ltr390_sample *out);
+
+void ltr390_filter_reset(struct ltr390_filter *filter);
+
+#endif /* LTR390_FILTER_H_ */
@@ -0,0 +1,278 @@
+/*
+ * This file is part of the LTR-390-UV-01 library (https://github.com/Cplaton/ltr390).
+ * Copyright (c) 2021 Clement Platon.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/********************************************************/
+/* header includes */
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+#include "ltr390uv_linux.h"
+
+/* Number of dev_id handles (7-bit) */
+#define LINUX_DEV_COUNT                         128
+
+struct linux_bus {
+    /* Bus node path, empty if unused */
+    char path[LTR390_LINUX_PATH_LEN];
+    /* Open file descriptor */
+    int fd;
+    /* Sensors bound to this bus */
+    uint8_t users;
+};
+
+struct linux_dev {
+    /* Bus index + 1, 0 if the handle is not bound */
+    uint8_t bus;
+    /* 7-bit I2C address of the sensor */
+    uint8_t addr;
+};
+
+static int linux_sys_open(const char *path, int flags);
+
+static int linux_sys_ioctl(int fd, unsigned long request, void *arg);
+
+static struct linux_dev *linux_find(uint8_t addr);
+
+static const struct ltr390_linux_ops linux_sys_ops = {
+	linux_sys_open, close, linux_sys_ioctl
+};
+
+static struct ltr390_linux_ops linux_ops = {
+	linux_sys_open, close, linux_sys_ioctl
+};
+
+static struct linux_bus linux_buses[LTR390_LINUX_MAX_BUS];
+
+static struct linux_dev linux_devs[LINUX_DEV_COUNT];
+
+/********************************************************/
+
+
+int8_t ltr390_linux_open(uint8_t dev_id, const char *bus_path, uint8_t i2c_addr)
+{
+	int8_t free_bus = -1;
+	uint8_t i;
+
+	if (bus_path == NULL)
+		return LTR390_E_NULL_PTR;
+	if ((dev_id >= LINUX_DEV_COUNT) || (i2c_addr > 0x7F) ||
+		(strlen(bus_path) >= LTR390_LINUX_PATH_LEN))
+		return LTR390_E_INVALID_VAL;
+
+	/* Rebinding a handle releases its previous bus */
+	ltr390_linux_close(dev_id);
+
+	/* Share the descriptor with the sensors already on this bus */
+	for (i = 0; i < LTR390_LINUX_MAX_BUS; i++) {
+		if (linux_buses[i].users == 0) {
+			if (free_bus < 0)
+				free_bus = (int8_t)i;
+		} else if (strcmp(linux_buses[i].path, bus_path) == 0) {
+			break;
+		}
+	}
+
+	if (i == LTR390_LINUX_MAX_BUS) {
+		if (free_bus < 0)
+			return LTR390_E_INVALID_LEN;
+		i = (uint8_t)free_bus;
+		linux_buses[i].fd = linux_ops.open(bus_path, O_RDWR);
+		if (linux_buses[i].fd < 0)
+			return LTR390_E_DEV_NOT_FOUND;
+		strcpy(linux_buses[i].path, bus_path);
+	}
+
+	linux_buses[i].users++;
+	linux_devs[dev_id].bus = (uint8_t)(i + 1);
+	linux_devs[dev_id].addr = i2c_addr;
+
+	return LTR390_OK;
+}
+
+
+void ltr390_linux_close(uint8_t dev_id)
+{
+	struct linux_bus *bus;
+
+	if ((dev_id >= LINUX_DEV_COUNT) || (linux_devs[dev_id].bus == 0))
+		return;
+
+	bus = &linux_buses[linux_devs[dev_id].bus - 1];
+	linux_devs[dev_id].bus = 0;
+	/* Last sensor on the bus closes the descriptor */
+	if (--bus->users == 0) {
+		(void)linux_ops.close(bus->fd);
+		bus->fd = -1;
+		bus->path[0] = '\0';
+	}
+}
+
+
+int8_t ltr390_linux_read(uint8_t dev_id, uint8_t reg_addr, uint8_t *data, uint16_t len)
+{
+	struct linux_dev *dev;
+	struct i2c_msg msgs[2];
+	struct i2c_rdwr_ioctl_data xfer;
+
+	dev = linux_find(dev_id);
+	if ((dev == NULL) || (data == NULL))
+		return LTR390_E_COMM_FAIL;
+
+	/* Register address then data, joined by a repeated start */
+	msgs[0].addr = dev->addr;
+	msgs[0].flags = 0;
+	msgs[0].len = 1;
+	msgs[0].buf = &reg_addr;
+	msgs[1].addr = dev->addr;
+	msgs[1].flags = I2C_M_RD;
+	msgs[1].len = len;
+	msgs[1].buf = data;
+	xfer.msgs = msgs;
+	xfer.nmsgs = 2;
+
+	if (linux_ops.ioctl(linux_buses[dev->bus - 1].fd, I2C_RDWR, &xfer) < 0)
+		return LTR390_E_COMM_FAIL;
+
+	return LTR390_OK;
+}
+
+
+int8_t ltr390_linux_write(uint8_t dev_id, uint8_t reg_addr, uint8_t *data, uint16_t len)
+{
+	struct linux_dev *dev;
+	struct i2c_msg msg;
+	struct i2c_rdwr_ioctl_data xfer;
+	uint8_t buf[LTR390_LINUX_MAX_WRITE + 1];
+
+	dev = linux_find(dev_id);
+	if ((dev == NULL) || (data == NULL) || (len > LTR390_LINUX_MAX_WRITE))
+		return LTR390_E_COMM_FAIL;
+
+	/* Register address and data in a single message */
+	buf[0] = reg_addr;
+	memcpy(&buf[1], data, len);
+	msg.addr = dev->addr;
+	msg.flags = 0;
+	msg.len = (uint16_t)(len + 1);
+	msg.buf = buf;
+	xfer.msgs = &msg;
+	xfer.nmsgs = 1;
+
+	if (linux_ops.ioctl(linux_buses[dev->bus - 1].fd, I2C_RDWR, &xfer) < 0)
+		return LTR390_E_COMM_FAIL;
+
+	return LTR390_OK;
+}
+
+
+int8_t ltr390_linux_xfer(struct ltr390_bus_op *ops, uint8_t count, void *ctx)
+{
+	struct linux_dev *dev;
+	struct i2c_msg msgs[2 * LTR390_BUS_MAX_OPS];
+	struct i2c_rdwr_ioctl_data xfer;
+	uint8_t regs[LTR390_BUS_MAX_OPS];
+	uint8_t bufs[LTR390_BUS_MAX_OPS][LTR390_LINUX_MAX_WRITE + 1];
+	uint8_t bus = 0;
+	uint8_t nmsgs = 0;
+	uint8_t i;
+
+	(void)ctx;
+	if ((ops == NULL) || (count > LTR390_BUS_MAX_OPS))
+		return LTR390_E_COMM_FAIL;
+
+	for (i = 0; i < count; i++) {
+		dev = linux_find(ops[i].addr);
+		if ((dev == NULL) || (ops[i].buf == NULL))
+			return LTR390_E_COMM_FAIL;
+		/* One ioctl per job, every operation must be on the same bus */
+		if ((bus != 0) && (dev->bus != bus))
+			return LTR390_E_COMM_FAIL;
+		bus = dev->bus;
+
+		if (ops[i].dir == LTR390_BUS_READ) {
+			/* Register address then data, joined by a repeated start */
+			regs[i] = ops[i].reg_addr;
+			msgs[nmsgs].addr = dev->addr;
+			msgs[nmsgs].flags = 0;
+			msgs[nmsgs].len = 1;
+			msgs[nmsgs].buf = &regs[i];
+			nmsgs++;
+			msgs[nmsgs].addr = dev->addr;
+			msgs[nmsgs].flags = I2C_M_RD;
+			msgs[nmsgs].len = ops[i].len;
+			msgs[nmsgs].buf = ops[i].buf;
+			nmsgs++;
+		} else {
+			/* Register address and data in a single message */
+			if (ops[i].len > LTR390_LINUX_MAX_WRITE)
+				return LTR390_E_COMM_FAIL;
+			bufs[i][0] = ops[i].reg_addr;
+			memcpy(&bufs[i][1], ops[i].buf, ops[i].len);
+			msgs[nmsgs].addr = dev->addr;
+			msgs[nmsgs].flags = 0;
+			msgs[nmsgs].len = (uint16_t)(ops[i].len + 1);
+			msgs[nmsgs].buf = bufs[i];
+			nmsgs++;
+		}
+	}
+	if (nmsgs == 0)
+		return LTR390_OK;
+
+	xfer.msgs = msgs;
+	xfer.nmsgs = nmsgs;
+
+	/* The adapter runs the whole job, all or nothing */
+	if (linux_ops.ioctl(linux_buses[bus - 1].fd, I2C_RDWR, &xfer) < 0)
+		return LTR390_E_COMM_FAIL;
+
+	return LTR390_OK;
+}
+
+
+void ltr390_linux_set_ops(const struct ltr390_linux_ops *ops)
+{
+	/* NULL restores the system calls */
+	if (ops == NULL)
+		linux_ops = linux_sys_ops;
+	else
+		linux_ops = *ops;
+}
+
+
+static int linux_sys_open(const char *path, int flags)
+{
+	return open(path, flags);
+}
+
+static int linux_sys_ioctl(int fd, unsigned long request, void *arg)
+{
+	return ioctl(fd, request, arg);
+}
+
+static struct linux_dev *linux_find(uint8_t addr)
+{
+	/* The driver passes the handle shifted left with the R/W bit */
+	uint8_t dev_id = (uint8_t)(addr >> 1);
+
+	if (linux_devs[dev_id].bus == 0)
+		return NULL;
+
+	return &linux_devs[dev_id];
+}
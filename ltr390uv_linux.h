@@ -0,0 +1,87 @@
+/*
+ * This file is part of the LTR-390-UV-01 library (https://github.com/Cplaton/ltr390).
+ * Copyright (c) 2021 Clement Platon.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Linux i2c-dev transport.
+ *
+ * A sensor is bound to a dev_id handle with ltr390_linux_open, then
+ * ltr390_linux_read/ltr390_linux_write are used as ltr390_dev.read and
+ * ltr390_dev.write. Register reads are a single I2C_RDWR transfer
+ * (register write, repeated start, read). Each /dev/i2c-N node is opened
+ * once and shared by every sensor on that bus.
+ *
+ * ltr390_linux_xfer can be used as ltr390_dev.xfer instead: the whole job
+ * goes to the adapter as one I2C_RDWR transfer, with repeated starts
+ * between the operations.
+ */
+
+#ifndef LTR390_LINUX_H_
+#define LTR390_LINUX_H_
+
+/********************************************************/
+/* header includes */
+#include "ltr390uv_defs.h"
+
+
+/********************************************************/
+/*                      Consts                          */
+/********************************************************/
+
+/* Maximum number of open buses */
+#define LTR390_LINUX_MAX_BUS                    8
+
+/* Maximum length of a bus node path */
+#define LTR390_LINUX_PATH_LEN                   32
+
+/* Longest register write, register address excluded */
+#define LTR390_LINUX_MAX_WRITE                  64
+
+
+/* Type definitions */
+typedef int (*ltr390_linux_open_fptr_t)(const char *path, int flags);
+
+typedef int (*ltr390_linux_close_fptr_t)(int fd);
+
+typedef int (*ltr390_linux_ioctl_fptr_t)(int fd, unsigned long request, void *arg);
+
+
+/* ltr390 Linux system calls, replaceable for tests */
+struct ltr390_linux_ops {
+    /* open(2) */
+    ltr390_linux_open_fptr_t open;
+    /* close(2) */
+    ltr390_linux_close_fptr_t close;
+    /* ioctl(2) */
+    ltr390_linux_ioctl_fptr_t ioctl;
+};
+
+
+/********************************************************/
+
+int8_t ltr390_linux_open(uint8_t dev_id, const char *bus_path, uint8_t i2c_addr);
+
+void ltr390_linux_close(uint8_t dev_id);
+
+int8_t ltr390_linux_read(uint8_t dev_id, uint8_t reg_addr, uint8_t *data, uint16_t len);
+
+int8_t ltr390_linux_write(uint8_t dev_id, uint8_t reg_addr, uint8_t *data, uint16_t len);
+
+int8_t ltr390_linux_xfer(struct ltr390_bus_op *ops, uint8_t count, void *ctx);
+
+void ltr390_linux_set_ops(const struct ltr390_linux_ops *ops);
+
+#endif /* LTR390_LINUX_H_ */
@@ -0,0 +1,338 @@
+/*
+ * This file is part of the LTR-390-UV-01 library (https://github.com/Cplaton/ltr390).
+ * Copyright (c) 2021 Clement Platon.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/********************************************************/
+/* header includes */
+#include "ltr390uv_log.h"
+
+/* Chunk header field offsets */
+#define LOG_HDR_MAGIC                           0
+#define LOG_HDR_PAYLOAD_LEN                     4
+#define LOG_HDR_COUNT                           6
+#define LOG_HDR_MODE                            8
+#define LOG_HDR_GAIN                            9
+#define LOG_HDR_RES                             10
+#define LOG_HDR_TIME_BASE                       12
+#define LOG_HDR_SPAN                            20
+#define LOG_HDR_CRC                             24
+
+/* Sample flags stored under the raw delta */
+#define LOG_FLAGS_BITS                          4
+#define LOG_FLAGS_MASK                          0x0F
+
+/* Largest gap between records, beyond it a new chunk starts */
+#define LOG_MAX_STEP_US                         UINT32_C(0x7FFFFFFF)
+
+/* CRC-32 (IEEE, reflected), one nibble at a time to keep the table small */
+static const uint32_t log_crc_table[16] = {
+	0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+	0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+};
+
+static void log_put_le(uint8_t *buf, uint64_t value, uint8_t len);
+
+static uint64_t log_get_le(const uint8_t *buf, uint8_t len);
+
+static uint8_t log_put_varint(uint8_t *buf, uint32_t value);
+
+static int8_t log_get_varint(const uint8_t *buf, uint32_t len, uint32_t *pos, uint32_t *value);
+
+/********************************************************/
+
+
+int8_t ltr390_log_writer_init(struct ltr390_log_writer *writer, uint8_t *buf, uint32_t buf_len, ltr390_log_flush_fptr_t flush, void *ctx)
+{
+	uint8_t hdr[LTR390_LOG_FILE_HDR_LEN] = {0};
+
+	if ((writer == NULL) || (buf == NULL) || (flush == NULL))
+		return LTR390_E_NULL_PTR;
+	if (buf_len < LTR390_LOG_MIN_BUF_LEN)
+		return LTR390_E_INVALID_LEN;
+
+	writer->buf = buf;
+	writer->buf_len = buf_len;
+	writer->payload_len = 0;
+	writer->count = 0;
+	writer->flush = flush;
+	writer->flush_ctx = ctx;
+	writer->chunks = 0;
+
+	/* File header goes out first */
+	log_put_le(hdr, LTR390_LOG_FILE_MAGIC, 4);
+	hdr[4] = LTR390_LOG_VERSION;
+
+	return flush(hdr, LTR390_LOG_FILE_HDR_LEN, ctx);
+}
+
+
+int8_t ltr390_log_append(struct ltr390_log_writer *writer, const struct ltr390_sample *sample, uint64_t time_us)
+{
+	int8_t rslt = LTR390_OK;
+	uint8_t *rec;
+	uint32_t step_us = 0;
+	uint32_t delta;
+
+	if ((writer == NULL) || (sample == NULL))
+		return LTR390_E_NULL_PTR;
+
+	/* A record that cannot follow the current chunk starts a new one */
+	if ((writer->count != 0) &&
+		((sample->mode != writer->mode) ||
+		(sample->gain_range != writer->gain_range) ||
+		(sample->resolution != writer->resolution) ||
+		(time_us < writer->prev_time_us) ||
+		(time_us - writer->prev_time_us > LOG_MAX_STEP_US) ||
+		(time_us - writer->time_base_us > UINT32_MAX) ||
+		(writer->count == LTR390_LOG_MAX_RECORDS) ||
+		(writer->payload_len + LTR390_LOG_REC_MAX_LEN > LTR390_LOG_MAX_PAYLOAD) ||
+		(LTR390_LOG_CHUNK_HDR_LEN + writer->payload_len + LTR390_LOG_REC_MAX_LEN > writer->buf_len)))
+		rslt = ltr390_log_flush(writer);
+	if (rslt != LTR390_OK)
+		return rslt;
+
+	if (writer->count == 0) {
+		writer->mode = sample->mode;
+		writer->gain_range = sample->gain_range;
+		writer->resolution = sample->resolution;
+		writer->time_base_us = time_us;
+		writer->prev_time_us = time_us;
+		writer->prev_step_us = 0;
+		writer->prev_raw = 0;
+	}
+
+	/* Change of time step, then raw delta with the flags */
+	rec = &writer->buf[LTR390_LOG_CHUNK_HDR_LEN + writer->payload_len];
+	step_us = (uint32_t)(time_us - writer->prev_time_us);
+	delta = (uint32_t)((int32_t)step_us - (int32_t)writer->prev_step_us);
+	writer->payload_len += log_put_varint(rec, (delta << 1) ^ (uint32_t)((int32_t)delta >> 31));
+
+	rec = &writer->buf[LTR390_LOG_CHUNK_HDR_LEN + writer->payload_len];
+	delta = (sample->raw & 0xFFFFF) - writer->prev_raw;
+	delta = (delta << 1) ^ (uint32_t)((int32_t)delta >> 31);
+	writer->payload_len += log_put_varint(rec, (delta << LOG_FLAGS_BITS) | (sample->flags & LOG_FLAGS_MASK));
+
+	writer->prev_time_us = time_us;
+	writer->prev_step_us = step_us;
+	writer->prev_raw = sample->raw & 0xFFFFF;
+	writer->count++;
+
+	return LTR390_OK;
+}
+
+
+int8_t ltr390_log_flush(struct ltr390_log_writer *writer)
+{
+	int8_t rslt;
+	uint8_t *hdr;
+	uint32_t crc;
+
+	if (writer == NULL)
+		return LTR390_E_NULL_PTR;
+	if (writer->count == 0)
+		return LTR390_OK;
+
+	hdr = writer->buf;
+	log_put_le(&hdr[LOG_HDR_MAGIC], LTR390_LOG_CHUNK_MAGIC, 4);
+	log_put_le(&hdr[LOG_HDR_PAYLOAD_LEN], writer->payload_len, 2);
+	log_put_le(&hdr[LOG_HDR_COUNT], writer->count, 2);
+	hdr[LOG_HDR_MODE] = writer->mode;
+	hdr[LOG_HDR_GAIN] = writer->gain_range;
+	hdr[LOG_HDR_RES] = writer->resolution;
+	hdr[LOG_HDR_RES + 1] = 0;
+	log_put_le(&hdr[LOG_HDR_TIME_BASE], writer->time_base_us, 8);
+	log_put_le(&hdr[LOG_HDR_SPAN], writer->prev_time_us - writer->time_base_us, 4);
+
+	/* CRC over the header fields before it, then the payload */
+	crc = ltr390_log_crc32(0, hdr, LOG_HDR_CRC);
+	crc = ltr390_log_crc32(crc, &hdr[LTR390_LOG_CHUNK_HDR_LEN], writer->payload_len);
+	log_put_le(&hdr[LOG_HDR_CRC], crc, 4);
+
+	rslt = writer->flush(hdr, LTR390_LOG_CHUNK_HDR_LEN + writer->payload_len, writer->flush_ctx);
+	if (rslt == LTR390_OK) {
+		writer->chunks++;
+		writer->count = 0;
+		writer->payload_len = 0;
+	}
+
+	return rslt;
+}
+
+
+int8_t ltr390_log_parse_chunk(struct ltr390_log_chunk *chunk, const uint8_t *data, size_t len)
+{
+	if ((chunk == NULL) || (data == NULL))
+		return LTR390_E_NULL_PTR;
+	if (len < LTR390_LOG_CHUNK_HDR_LEN)
+		return LTR390_E_INVALID_LEN;
+	if (log_get_le(&data[LOG_HDR_MAGIC], 4) != LTR390_LOG_CHUNK_MAGIC)
+		return LTR390_E_INVALID_VAL;
+
+	chunk->payload_len = (uint16_t)log_get_le(&data[LOG_HDR_PAYLOAD_LEN], 2);
+	/* Chunk cut short, e.g. the tail of a log still being written */
+	if (len - LTR390_LOG_CHUNK_HDR_LEN < chunk->payload_len)
+		return LTR390_E_INVALID_LEN;
+
+	chunk->payload = &data[LTR390_LOG_CHUNK_HDR_LEN];
+	chunk->count = (uint16_t)log_get_le(&data[LOG_HDR_COUNT], 2);
+	chunk->mode = data[LOG_HDR_MODE];
+	chunk->gain_range = data[LOG_HDR_GAIN];
+	chunk->resolution = data[LOG_HDR_RES];
+	chunk->time_base_us = log_get_le(&data[LOG_HDR_TIME_BASE], 8);
+	chunk->span_us = (uint32_t)log_get_le(&data[LOG_HDR_SPAN], 4);
+	chunk->crc = (uint32_t)log_get_le(&data[LOG_HDR_CRC], 4);
+
+	return LTR390_OK;
+}
+
+
+int8_t ltr390_log_verify_chunk(const struct ltr390_log_chunk *chunk)
+{
+	const uint8_t *hdr;
+	uint32_t crc;
+
+	if (chunk == NULL)
+		return LTR390_E_NULL_PTR;
+
+	hdr = chunk->payload - LTR390_LOG_CHUNK_HDR_LEN;
+	crc = ltr390_log_crc32(0, hdr, LOG_HDR_CRC);
+	crc = ltr390_log_crc32(crc, chunk->payload, chunk->payload_len);
+
+	return (crc == chunk->crc) ? LTR390_OK : LTR390_E_INVALID_VAL;
+}
+
+
+void ltr390_log_cursor_init(struct ltr390_log_cursor *cursor, const struct ltr390_log_chunk *chunk)
+{
+	if (cursor == NULL)
+		return;
+
+	/* A cursor on no chunk is rejected by ltr390_log_cursor_next */
+	cursor->chunk = chunk;
+	cursor->pos = 0;
+	cursor->index = 0;
+	cursor->time_us = (chunk != NULL) ? chunk->time_base_us : 0;
+	cursor->step_us = 0;
+	cursor->raw = 0;
+}
+
+
+int8_t ltr390_log_cursor_next(struct ltr390_log_cursor *cursor, struct ltr390_sample *sample, uint64_t *time_us)
+{
+	const struct ltr390_log_chunk *chunk;
+	uint32_t value;
+	uint32_t delta;
+	int8_t rslt;
+
+	if ((cursor == NULL) || (sample == NULL) || (cursor->chunk == NULL))
+		return LTR390_E_NULL_PTR;
+
+	chunk = cursor->chunk;
+	if (cursor->index >= chunk->count)
+		return LTR390_W_NO_NEW_DATA;
+
+	rslt = log_get_varint(chunk->payload, chunk->payload_len, &cursor->pos, &value);
+	if (rslt != LTR390_OK)
+		return rslt;
+	delta = (value >> 1) ^ (uint32_t)-(int32_t)(value & 1);
+	cursor->step_us += delta;
+	cursor->time_us += cursor->step_us;
+
+	rslt = log_get_varint(chunk->payload, chunk->payload_len, &cursor->pos, &value);
+	if (rslt != LTR390_OK)
+		return rslt;
+	delta = value >> LOG_FLAGS_BITS;
+	delta = (delta >> 1) ^ (uint32_t)-(int32_t)(delta & 1);
+	cursor->raw = (cursor->raw + delta) & 0xFFFFF;
+	cursor->index++;
+
+	sample->raw = cursor->raw;
+	sample->mode = chunk->mode;
+	sample->gain_range = chunk->gain_range;
+	sample->resolution = chunk->resolution;
+	sample->flags = (uint8_t)(value & LOG_FLAGS_MASK);
+	if (time_us != NULL)
+		*time_us = cursor->time_us;
+
+	return LTR390_OK;
+}
+
+
+uint32_t ltr390_log_crc32(uint32_t crc, const uint8_t *data, uint32_t len)
+{
+	uint32_t i;
+
+	crc = ~crc;
+	for (i = 0; i < len; i++) {
+		crc = (crc >> 4) ^ log_crc_table[(crc ^ data[i]) & 0x0F];
+		crc = (crc >> 4) ^ log_crc_table[(crc ^ ((uint32_t)data[i] >> 4)) & 0x0F];
+	}
+
+	return ~crc;
+}
+
+
+static void log_put_le(uint8_t *buf, uint64_t value, uint8_t len)
+{
+	uint8_t i;
+
+	for (i = 0; i < len; i++)
+		buf[i] = (uint8_t)(value >> (8 * i));
+}
+
+static uint64_t log_get_le(const uint8_t *buf, uint8_t len)
+{
+	uint64_t value = 0;
+	uint8_t i;
+
+	for (i = 0; i < len; i++)
+		value |= (uint64_t)buf[i] << (8 * i);
+
+	return value;
+}
+
+static uint8_t log_put_varint(uint8_t *buf, uint32_t value)
+{
+	uint8_t len = 0;
+
+	/* 7 bits per byte, high bit set on all but the last */
+	while (value >= 0x80) {
+		buf[len++] = (uint8_t)(value | 0x80);
+		value >>= 7;
+	}
+	buf[len++] = (uint8_t)value;
+
+	return len;
+}
+
+static int8_t log_get_varint(const uint8_t *buf, uint32_t len, uint32_t *pos, uint32_t *value)
+{
+	uint32_t result = 0;
+	uint8_t shift = 0;
+	uint8_t byte;
+
+	do {
+		if ((*pos >= len) || (shift > 28))
+			return LTR390_E_INVALID_LEN;
+		byte = buf[(*pos)++];
+		result |= (uint32_t)(byte & 0x7F) << shift;
+		shift += 7;
+	} while (byte & 0x80);
+
+	*value = result;
+
+	return LTR390_OK;
+}
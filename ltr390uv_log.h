@@ -0,0 +1,196 @@
+/*
+ * This file is part of the LTR-390-UV-01 library (https://github.com/Cplaton/ltr390).
+ * Copyright (c) 2021 Clement Platon.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Streaming binary log of raw samples.
+ *
+ * A log is a file header followed by chunks. A chunk header carries the
+ * mode, gain range and resolution shared by its records, so values can
+ * be recomputed with ltr390_computed_sample. It also holds a timestamp
+ * base, the time span, the record count and a CRC-32 of the header and
+ * payload. All fields are little endian.
+ *
+ * Each record is two varints:
+ * - zigzag of the change in time step (us), usually a single byte
+ * - zigzag of the raw count delta, shifted left by 4, or'ed with the
+ *   sample flags
+ *
+ * The writer (ltr390uv_log.c) works in a caller-provided buffer, one
+ * chunk at a time, and hands full chunks to a flush callback. The
+ * reader (ltr390uv_log_mmap.c, POSIX hosts) maps a file, walks chunks
+ * without copying, and keeps a sparse time index of bounded size for
+ * seeking.
+ */
+
+#ifndef LTR390_LOG_H_
+#define LTR390_LOG_H_
+
+/********************************************************/
+/* header includes */
+#include "ltr390uv_defs.h"
+
+
+/********************************************************/
+/*                      Consts                          */
+/********************************************************/
+
+/* File header: "L390", version, 3 reserved bytes */
+#define LTR390_LOG_FILE_MAGIC                   UINT32_C(0x3039334C)
+#define LTR390_LOG_VERSION                      0x01
+#define LTR390_LOG_FILE_HDR_LEN                 8
+
+/* Chunk header: "LCHK", then the fields below */
+#define LTR390_LOG_CHUNK_MAGIC                  UINT32_C(0x4B48434C)
+#define LTR390_LOG_CHUNK_HDR_LEN                28
+
+/* Longest encoded record (two 5-byte varints) */
+#define LTR390_LOG_REC_MAX_LEN                  10
+
+/* Smallest writer buffer: one chunk header and one record */
+#define LTR390_LOG_MIN_BUF_LEN                  (LTR390_LOG_CHUNK_HDR_LEN + LTR390_LOG_REC_MAX_LEN)
+
+/* Largest chunk payload and record count (16-bit header fields) */
+#define LTR390_LOG_MAX_PAYLOAD                  UINT16_MAX
+#define LTR390_LOG_MAX_RECORDS                  UINT16_MAX
+
+
+/* Type definitions */
+typedef int8_t (*ltr390_log_flush_fptr_t)(const uint8_t *data, uint32_t len, void *ctx);
+
+
+/* ltr390 log writer, fixed memory */
+struct ltr390_log_writer {
+    /* Chunk buffer, header then payload */
+    uint8_t *buf;
+    /* Buffer length */
+    uint32_t buf_len;
+    /* Payload bytes in the current chunk */
+    uint32_t payload_len;
+    /* Records in the current chunk */
+    uint16_t count;
+    /* Chunk mode, gain range and resolution */
+    uint8_t mode;
+    uint8_t gain_range;
+    uint8_t resolution;
+    /* Chunk timestamp base in us */
+    uint64_t time_base_us;
+    /* Previous record timestamp, time step and raw value */
+    uint64_t prev_time_us;
+    uint32_t prev_step_us;
+    uint32_t prev_raw;
+    /* Output callback */
+    ltr390_log_flush_fptr_t flush;
+    /* Output callback context */
+    void *flush_ctx;
+    /* Chunks written */
+    uint32_t chunks;
+};
+
+/* ltr390 log chunk, pointing into the mapped file */
+struct ltr390_log_chunk {
+    /* Chunk offset in the file */
+    size_t offset;
+    /* Encoded records */
+    const uint8_t *payload;
+    /* Payload length */
+    uint16_t payload_len;
+    /* Record count */
+    uint16_t count;
+    /* Mode, gain range and resolution of every record */
+    uint8_t mode;
+    uint8_t gain_range;
+    uint8_t resolution;
+    /* First record timestamp in us */
+    uint64_t time_base_us;
+    /* Last minus first record timestamp in us */
+    uint32_t span_us;
+    /* CRC-32 stored in the header */
+    uint32_t crc;
+};
+
+/* ltr390 log chunk record cursor */
+struct ltr390_log_cursor {
+    /* Chunk being decoded */
+    const struct ltr390_log_chunk *chunk;
+    /* Next byte in the payload */
+    uint32_t pos;
+    /* Records decoded */
+    uint16_t index;
+    /* Previous timestamp, time step and raw value */
+    uint64_t time_us;
+    uint32_t step_us;
+    uint32_t raw;
+};
+
+/* ltr390 log sparse time index entry */
+struct ltr390_log_index_ent {
+    /* Chunk timestamp base in us */
+    uint64_t time_us;
+    /* Chunk offset in the file */
+    size_t offset;
+};
+
+/* ltr390 mapped log reader */
+struct ltr390_log_reader {
+    /* Mapped file */
+    const uint8_t *data;
+    /* Mapped length */
+    size_t len;
+    /* End of the last complete chunk */
+    size_t end;
+    /* Index storage, provided by the caller */
+    struct ltr390_log_index_ent *index;
+    /* Index capacity */
+    uint32_t index_cap;
+    /* Index entries used */
+    uint32_t index_count;
+    /* One index entry every index_stride chunks */
+    uint32_t index_stride;
+    /* Complete chunks in the file */
+    uint32_t chunks;
+};
+
+
+/********************************************************/
+
+int8_t ltr390_log_writer_init(struct ltr390_log_writer *writer, uint8_t *buf, uint32_t buf_len, ltr390_log_flush_fptr_t flush, void *ctx);
+
+int8_t ltr390_log_append(struct ltr390_log_writer *writer, const struct ltr390_sample *sample, uint64_t time_us);
+
+int8_t ltr390_log_flush(struct ltr390_log_writer *writer);
+
+int8_t ltr390_log_parse_chunk(struct ltr390_log_chunk *chunk, const uint8_t *data, size_t len);
+
+int8_t ltr390_log_verify_chunk(const struct ltr390_log_chunk *chunk);
+
+void ltr390_log_cursor_init(struct ltr390_log_cursor *cursor, const struct ltr390_log_chunk *chunk);
+
+int8_t ltr390_log_cursor_next(struct ltr390_log_cursor *cursor, struct ltr390_sample *sample, uint64_t *time_us);
+
+uint32_t ltr390_log_crc32(uint32_t crc, const uint8_t *data, uint32_t len);
+
+/* Host reader (ltr390uv_log_mmap.c) */
+
+int8_t ltr390_log_open(struct ltr390_log_reader *reader, const char *path, struct ltr390_log_index_ent *index, uint32_t index_cap);
+
+void ltr390_log_close(struct ltr390_log_reader *reader);
+
+int8_t ltr390_log_next_chunk(const struct ltr390_log_reader *reader, size_t *pos, struct ltr390_log_chunk *chunk);
+
+int8_t ltr390_log_seek(const struct ltr390_log_reader *reader, uint64_t time_us, size_t *pos);
+
+#endif /* LTR390_LOG_H_ */
@@ -0,0 +1,182 @@
+/*
+ * This file is part of the LTR-390-UV-01 library (https://github.com/Cplaton/ltr390).
+ * Copyright (c) 2021 Clement Platon.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/********************************************************/
+/* header includes */
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "ltr390uv_log.h"
+
+static void log_index_add(struct ltr390_log_reader *reader, const struct ltr390_log_chunk *chunk);
+
+/********************************************************/
+
+
+int8_t ltr390_log_open(struct ltr390_log_reader *reader, const char *path, struct ltr390_log_index_ent *index, uint32_t index_cap)
+{
+	struct ltr390_log_chunk chunk;
+	struct stat st;
+	void *map;
+	size_t pos;
+	uint32_t magic;
+	int fd;
+
+	if ((reader == NULL) || (path == NULL) || (index == NULL))
+		return LTR390_E_NULL_PTR;
+	/* Two entries at least, so halving the index always frees one */
+	if (index_cap < 2)
+		return LTR390_E_INVALID_LEN;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return LTR390_E_DEV_NOT_FOUND;
+	if ((fstat(fd, &st) < 0) || ((size_t)st.st_size < LTR390_LOG_FILE_HDR_LEN)) {
+		close(fd);
+		return LTR390_E_INVALID_LEN;
+	}
+
+	/* The mapping stays valid once the descriptor is closed */
+	map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return LTR390_E_INVALID_VAL;
+
+	reader->data = (const uint8_t *)map;
+	reader->len = (size_t)st.st_size;
+	reader->index = index;
+	reader->index_cap = index_cap;
+	reader->index_count = 0;
+	reader->index_stride = 1;
+	reader->chunks = 0;
+
+	magic = (uint32_t)reader->data[0] | ((uint32_t)reader->data[1] << 8) |
+			((uint32_t)reader->data[2] << 16) | ((uint32_t)reader->data[3] << 24);
+	if ((magic != LTR390_LOG_FILE_MAGIC) || (reader->data[4] != LTR390_LOG_VERSION)) {
+		ltr390_log_close(reader);
+		return LTR390_E_INVALID_VAL;
+	}
+
+	/* Walk the chunk headers only, payloads are not touched */
+	pos = LTR390_LOG_FILE_HDR_LEN;
+	while (ltr390_log_parse_chunk(&chunk, &reader->data[pos], reader->len - pos) == LTR390_OK) {
+		chunk.offset = pos;
+		log_index_add(reader, &chunk);
+		pos += LTR390_LOG_CHUNK_HDR_LEN + chunk.payload_len;
+		reader->chunks++;
+	}
+	reader->end = pos;
+
+	return LTR390_OK;
+}
+
+
+void ltr390_log_close(struct ltr390_log_reader *reader)
+{
+	if ((reader == NULL) || (reader->data == NULL))
+		return;
+
+	munmap((void *)reader->data, reader->len);
+	reader->data = NULL;
+	reader->len = 0;
+	reader->end = 0;
+}
+
+
+int8_t ltr390_log_next_chunk(const struct ltr390_log_reader *reader, size_t *pos, struct ltr390_log_chunk *chunk)
+{
+	int8_t rslt;
+
+	if ((reader == NULL) || (pos == NULL) || (chunk == NULL))
+		return LTR390_E_NULL_PTR;
+
+	/* Iteration starts at 0 or at a position from ltr390_log_seek */
+	if (*pos < LTR390_LOG_FILE_HDR_LEN)
+		*pos = LTR390_LOG_FILE_HDR_LEN;
+	if (*pos >= reader->end)
+		return LTR390_W_NO_NEW_DATA;
+
+	rslt = ltr390_log_parse_chunk(chunk, &reader->data[*pos], reader->end - *pos);
+	if (rslt == LTR390_OK) {
+		chunk->offset = *pos;
+		*pos += LTR390_LOG_CHUNK_HDR_LEN + chunk->payload_len;
+	}
+
+	return rslt;
+}
+
+
+int8_t ltr390_log_seek(const struct ltr390_log_reader *reader, uint64_t time_us, size_t *pos)
+{
+	struct ltr390_log_chunk chunk;
+	uint32_t low = 0;
+	uint32_t high;
+	uint32_t mid;
+	size_t next;
+
+	if ((reader == NULL) || (pos == NULL))
+		return LTR390_E_NULL_PTR;
+	if (reader->index_count == 0)
+		return LTR390_W_NO_NEW_DATA;
+
+	/* Last indexed chunk starting at or before time_us */
+	high = reader->index_count;
+	while (high - low > 1) {
+		mid = low + (high - low) / 2;
+		if (reader->index[mid].time_us <= time_us)
+			low = mid;
+		else
+			high = mid;
+	}
+
+	/* Then chunk headers up to the one covering time_us */
+	*pos = reader->index[low].offset;
+	while (ltr390_log_parse_chunk(&chunk, &reader->data[*pos], reader->end - *pos) == LTR390_OK) {
+		if (chunk.time_base_us + chunk.span_us >= time_us)
+			break;
+		next = *pos + LTR390_LOG_CHUNK_HDR_LEN + chunk.payload_len;
+		if (next >= reader->end)
+			break;
+		*pos = next;
+	}
+
+	return LTR390_OK;
+}
+
+
+static void log_index_add(struct ltr390_log_reader *reader, const struct ltr390_log_chunk *chunk)
+{
+	uint32_t i;
+
+	if ((reader->chunks % reader->index_stride) != 0)
+		return;
+
+	/* Index full: keep every other entry and halve the density */
+	if (reader->index_count == reader->index_cap) {
+		for (i = 0; i < (reader->index_count + 1) / 2; i++)
+			reader->index[i] = reader->index[2 * i];
+		reader->index_count = (reader->index_count + 1) / 2;
+		reader->index_stride *= 2;
+		if ((reader->chunks % reader->index_stride) != 0)
+			return;
+	}
+
+	reader->index[reader->index_count].time_us = chunk->time_base_us;
+	reader->index[reader->index_count].offset = chunk->offset;
+	reader->index_count++;
+}
@@ -0,0 +1,194 @@
+/*
+ * This file is part of the LTR-390-UV-01 library (https://github.com/Cplaton/ltr390).
+ * Copyright (c) 2021 Clement Platon.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/********************************************************/
+/* header includes */
+#include "ltr390uv_phase.h"
+#include "ltr390uv.h"
+
+static int8_t phase_poll(struct ltr390_phase *phase, struct ltr390_sample *sample, uint32_t *edge_us, uint8_t *bracketed, uint32_t timeout_us, struct ltr390_dev *dev);
+
+static void phase_track(struct ltr390_phase *phase, uint32_t edge_us);
+
+/********************************************************/
+
+
+int8_t ltr390_phase_init(struct ltr390_phase *phase, uint32_t guard_us, const struct ltr390_dev *dev)
+{
+	uint32_t period_us;
+
+	if ((phase == NULL) || (dev == NULL))
+		return LTR390_E_NULL_PTR;
+
+	/* Nominal period, refined from the data-ready edges */
+	period_us = ltr390_meas_period_us(dev->settings.rate, dev->settings.resolution);
+	if (period_us == 0)
+		return LTR390_E_INVALID_VAL;
+	if (guard_us == 0)
+		guard_us = period_us / LTR390_PHASE_GUARD_DIV;
+	if ((guard_us < 2) || (guard_us >= period_us / 2))
+		return LTR390_E_INVALID_VAL;
+
+	phase->period_us = period_us;
+	phase->guard_us = guard_us;
+	phase->edge_us = 0;
+	phase->locked = FALSE;
+	phase->stats.samples = 0;
+	phase->stats.missed = 0;
+	phase->stats.early_reads = 0;
+	phase->stats.locks = 0;
+	phase->stats.jitter_last_us = 0;
+	phase->stats.jitter_max_us = 0;
+	phase->stats.jitter_sum_us = 0;
+
+	return LTR390_OK;
+}
+
+
+int8_t ltr390_phase_read(struct ltr390_phase *phase, struct ltr390_phase_sample *out, struct ltr390_dev *dev)
+{
+	int8_t rslt;
+	uint8_t status;
+	uint32_t predicted_us;
+	uint32_t now_us;
+	uint32_t edge_us;
+	uint32_t jitter_us;
+	int32_t wait_us;
+	int32_t error_us;
+	uint8_t bracketed = FALSE;
+	uint8_t tries = 2;
+
+	if ((phase == NULL) || (out == NULL) || (dev == NULL))
+		return LTR390_E_NULL_PTR;
+	if ((dev->delay_us == NULL) || (dev->get_time_us == NULL))
+		return LTR390_E_NULL_PTR;
+
+	if (phase->locked != TRUE) {
+		/* Acquire: drop a pending result, then catch the next edge */
+		rslt = ltr390_get_status(&status, dev);
+		/* Only a bracketed edge gives the phase, the next one will be */
+		while ((rslt == LTR390_OK) && (bracketed != TRUE) && tries--)
+			rslt = phase_poll(phase, &out->sample, &edge_us, &bracketed, 2 * phase->period_us, dev);
+		if (rslt != LTR390_OK)
+			return rslt;
+		if (bracketed != TRUE)
+			return LTR390_E_TIMEOUT;
+		phase->edge_us = edge_us;
+		phase->locked = TRUE;
+		phase->stats.locks++;
+	} else {
+		/* Start one guard interval ahead of the predicted edge */
+		predicted_us = phase->edge_us + phase->period_us;
+		now_us = dev->get_time_us();
+		wait_us = (int32_t)(predicted_us - phase->guard_us - now_us);
+		if (wait_us > 0)
+			dev->delay_us((uint32_t)wait_us);
+
+		rslt = phase_poll(phase, &out->sample, &edge_us, &bracketed, phase->period_us, dev);
+		if (rslt == LTR390_E_TIMEOUT)
+			phase->locked = FALSE;
+		if (rslt != LTR390_OK)
+			return rslt;
+
+		if (bracketed != TRUE) {
+			/*
+			 * Fresh on the first read. Called late, the edge follows the
+			 * model. Otherwise it came earlier than predicted: assume one
+			 * guard interval, the next read starts earlier and brackets it.
+			 */
+			if ((int32_t)(edge_us - predicted_us) >= 0) {
+				predicted_us += ((edge_us - predicted_us) / phase->period_us) * phase->period_us;
+				edge_us = predicted_us;
+			} else {
+				edge_us -= phase->guard_us;
+			}
+		}
+
+		error_us = (int32_t)(edge_us - predicted_us);
+		jitter_us = (error_us < 0) ? (uint32_t)-error_us : (uint32_t)error_us;
+		phase->stats.jitter_last_us = jitter_us;
+		if (jitter_us > phase->stats.jitter_max_us)
+			phase->stats.jitter_max_us = jitter_us;
+		phase->stats.jitter_sum_us += jitter_us;
+		phase_track(phase, edge_us);
+	}
+
+	/* Integration ends at the edge and lasts one integration time */
+	out->end_us = edge_us;
+	out->start_us = edge_us - ltr390_power_lead_us(dev);
+	phase->stats.samples++;
+
+	return LTR390_OK;
+}
+
+
+static int8_t phase_poll(struct ltr390_phase *phase, struct ltr390_sample *sample, uint32_t *edge_us, uint8_t *bracketed, uint32_t timeout_us, struct ltr390_dev *dev)
+{
+	int8_t rslt;
+	uint32_t step_us = phase->guard_us / 2;
+	uint32_t start_us;
+	uint32_t stale_us;
+	uint32_t read_us;
+
+	*bracketed = FALSE;
+	start_us = dev->get_time_us();
+	stale_us = start_us;
+	for (;;) {
+		read_us = dev->get_time_us();
+		rslt = ltr390_get_new_data(sample, dev);
+		if (rslt != LTR390_W_NO_NEW_DATA)
+			break;
+		/* Edge is after this read */
+		stale_us = read_us;
+		*bracketed = TRUE;
+		phase->stats.early_reads++;
+		if ((read_us - start_us) >= timeout_us)
+			return LTR390_E_TIMEOUT;
+		dev->delay_us(step_us);
+	}
+	if (rslt != LTR390_OK)
+		return rslt;
+
+	/* Between the last stale read and this one, else at most this read */
+	if (*bracketed == TRUE)
+		*edge_us = stale_us + (read_us - stale_us) / 2;
+	else
+		*edge_us = read_us;
+
+	return LTR390_OK;
+}
+
+static void phase_track(struct ltr390_phase *phase, uint32_t edge_us)
+{
+	uint32_t delta_us = edge_us - phase->edge_us;
+	uint32_t periods;
+	uint32_t measured_us;
+
+	/* Whole periods since the last edge, more than one means missed conversions */
+	periods = (delta_us + phase->period_us / 2) / phase->period_us;
+	if (periods == 0)
+		periods = 1;
+	phase->stats.missed += periods - 1;
+
+	/* Period estimate follows the sensor clock */
+	measured_us = delta_us / periods;
+	if (measured_us >= phase->period_us)
+		phase->period_us += (measured_us - phase->period_us) >> LTR390_PHASE_PERIOD_SHIFT;
+	else
+		phase->period_us -= (phase->period_us - measured_us) >> LTR390_PHASE_PERIOD_SHIFT;
+	phase->edge_us = edge_us;
+}
@@ -0,0 +1,100 @@
+/*
+ * This file is part of the LTR-390-UV-01 library (https://github.com/Cplaton/ltr390).
+ * Copyright (c) 2021 Clement Platon.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Phase-locked sampling.
+ *
+ * The sensor converts on its own clock, which drifts against the host.
+ * The data-ready edge is located by polling at half the guard interval
+ * around its expected time: the edge lies between the last stale status
+ * and the first fresh one, and its estimate is the middle of the two.
+ * Each read then starts one guard interval before the next predicted
+ * edge. The period is tracked from the measured edges, so the schedule
+ * follows the sensor clock instead of the host timer.
+ *
+ * Samples are stamped with the estimated end of integration (the edge)
+ * and its start, one integration time earlier. Needs dev->delay_us and
+ * dev->get_time_us.
+ */
+
+#ifndef LTR390_PHASE_H_
+#define LTR390_PHASE_H_
+
+/********************************************************/
+/* header includes */
+#include "ltr390uv_defs.h"
+
+
+/********************************************************/
+/*                      Consts                          */
+/********************************************************/
+
+/* Default guard interval, as a fraction of the period */
+#define LTR390_PHASE_GUARD_DIV                  32
+
+/* Period estimate update weight, 1/2^shift */
+#define LTR390_PHASE_PERIOD_SHIFT               3
+
+
+/* ltr390 phase-locked sampling statistics */
+struct ltr390_phase_stats {
+    /* Samples delivered */
+    uint32_t samples;
+    /* Conversions not read */
+    uint32_t missed;
+    /* Status reads made before the edge */
+    uint32_t early_reads;
+    /* Phase acquisitions, the first one included */
+    uint32_t locks;
+    /* Last, largest and summed |measured - predicted| edge time, in us */
+    uint32_t jitter_last_us;
+    uint32_t jitter_max_us;
+    uint64_t jitter_sum_us;
+};
+
+/* ltr390 phase-locked sampler */
+struct ltr390_phase {
+    /* Period estimate, in us */
+    uint32_t period_us;
+    /* Guard interval, in us */
+    uint32_t guard_us;
+    /* Last data-ready edge estimate, device clock */
+    uint32_t edge_us;
+    /* Phase known */
+    uint8_t locked;
+    /* Statistics */
+    struct ltr390_phase_stats stats;
+};
+
+/* ltr390 sample with integration timestamps */
+struct ltr390_phase_sample {
+    /* Sample */
+    struct ltr390_sample sample;
+    /* Estimated integration start, device clock */
+    uint32_t start_us;
+    /* Estimated integration end (data-ready edge), device clock */
+    uint32_t end_us;
+};
+
+
+/********************************************************/
+
+int8_t ltr390_phase_init(struct ltr390_phase *phase, uint32_t guard_us, const struct ltr390_dev *dev);
+
+int8_t ltr390_phase_read(struct ltr390_phase *phase, struct ltr390_phase_sample *out, struct ltr390_dev *dev);
+
+#endif /* LTR390_PHASE_H_ */
@@ -0,0 +1,765 @@
+/*
+ * This file is part of the LTR-390-UV-01 library (https://github.com/Cplaton/ltr390).
+ * Copyright (c) 2021 Clement Platon.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _POSIX_C_SOURCE 199309L
+
+/********************************************************/
+/* header includes */
+#include <time.h>
+#include "ltr390uv_prof.h"
+#include "ltr390uv.h"
+#include "ltr390uv_emu.h"
+#include "ltr390uv_batch.h"
+#include "ltr390uv_async.h"
+
+/* The reference decode must stay an out of line call, like the table one */
+#if defined(__GNUC__)
+#define PROF_NOINLINE __attribute__((noinline))
+#else
+#define PROF_NOINLINE
+#endif
+
+typedef int8_t (*prof_case_fptr_t)(struct ltr390_dev *dev, uint32_t iter);
+
+struct prof_case {
+    const char *name;
+    prof_case_fptr_t run;
+    uint32_t tx_budget;
+};
+
+static int8_t prof_init(struct ltr390_dev *dev, uint32_t iter);
+static int8_t prof_configure(struct ltr390_dev *dev, uint32_t iter);
+static int8_t prof_soft_reset(struct ltr390_dev *dev, uint32_t iter);
+static int8_t prof_sync_regs(struct ltr390_dev *dev, uint32_t iter);
+static int8_t prof_set_mode(struct ltr390_dev *dev, uint32_t iter);
+static int8_t prof_set_rate(struct ltr390_dev *dev, uint32_t iter);
+static int8_t prof_set_resolution(struct ltr390_dev *dev, uint32_t iter);
+static int8_t prof_set_gain(struct ltr390_dev *dev, uint32_t iter);
+static int8_t prof_set_int(struct ltr390_dev *dev, uint32_t iter);
+static int8_t prof_set_int_src(struct ltr390_dev *dev, uint32_t iter);
+static int8_t prof_set_int_pers(struct ltr390_dev *dev, uint32_t iter);
+static int8_t prof_set_thresh_low(struct ltr390_dev *dev, uint32_t iter);
+static int8_t prof_set_thresh_up(struct ltr390_dev *dev, uint32_t iter);
+static int8_t prof_get_raw_data(struct ltr390_dev *dev, uint32_t iter);
+static int8_t prof_get_status(struct ltr390_dev *dev, uint32_t iter);
+static int8_t prof_get_new_data(struct ltr390_dev *dev, uint32_t iter);
+static int8_t prof_get_frame(struct ltr390_dev *dev, uint32_t iter);
+static int8_t prof_computed_data(struct ltr390_dev *dev, uint32_t iter);
+static int8_t prof_restore(struct ltr390_dev *dev, uint32_t iter);
+
+/* Profiled APIs and their transaction budget per call */
+static const struct prof_case prof_cases[LTR390_PROF_CASE_COUNT] = {
+	{"ltr390_init", prof_init, 3},
+	{"ltr390_configure", prof_configure, 4},
+	{"ltr390_soft_reset", prof_soft_reset, 1},
+	{"ltr390_sync_regs", prof_sync_regs, 4},
+	{"ltr390_set_mode", prof_set_mode, 1},
+	{"ltr390_set_rate", prof_set_rate, 1},
+	{"ltr390_set_resolution", prof_set_resolution, 1},
+	{"ltr390_set_gain", prof_set_gain, 1},
+	{"ltr390_set_int", prof_set_int, 1},
+	{"ltr390_set_int_src", prof_set_int_src, 1},
+	{"ltr390_set_int_pers", prof_set_int_pers, 1},
+	{"ltr390_set_thresh_low", prof_set_thresh_low, 1},
+	{"ltr390_set_thresh_up", prof_set_thresh_up, 1},
+	{"ltr390_get_raw_data", prof_get_raw_data, 1},
+	{"ltr390_get_status", prof_get_status, 1},
+	{"ltr390_get_new_data", prof_get_new_data, 2},
+	{"ltr390_get_frame", prof_get_frame, 1},
+	{"ltr390_computed_data", prof_computed_data, 0},
+};
+
+/* APIs building multi-operation jobs and their submission budget per call */
+static const struct prof_case prof_xfer_cases[LTR390_PROF_XFER_COUNT] = {
+	{"ltr390_configure", prof_configure, 1},
+	{"ltr390_restore", prof_restore, 1},
+	{"ltr390_get_new_data", prof_get_new_data, 1},
+};
+
+static const uint32_t prof_bus_hz[LTR390_PROF_BUS_COUNT] = {
+	LTR390_PROF_BUS_100K, LTR390_PROF_BUS_400K, LTR390_PROF_BUS_1M
+};
+
+static int8_t prof_null_read(uint8_t dev_id, uint8_t reg_addr, uint8_t *data, uint16_t len);
+
+static int8_t prof_null_write(uint8_t dev_id, uint8_t reg_addr, uint8_t *data, uint16_t len);
+
+static int8_t prof_null_xfer(struct ltr390_bus_op *ops, uint8_t count, void *ctx);
+
+static int8_t prof_count_xfer(struct ltr390_bus_op *ops, uint8_t count, void *ctx);
+
+static int8_t prof_async_submit(struct ltr390_async_req *req, void *ctx);
+
+static void prof_async_done(struct ltr390_async_dev *adev, uint8_t op, int8_t rslt, void *ctx);
+
+static void prof_setup(struct ltr390_dev *dev);
+
+static double prof_now_ns(void);
+
+static PROF_NOINLINE uint32_t prof_decode_switch(const uint8_t *reg_data, uint8_t resolution);
+
+static uint32_t prof_decode_diff(const uint32_t *ref, const uint32_t *out, size_t count);
+
+static uint32_t prof_convert_diff(const float *ref, const float *out, size_t count);
+
+/********************************************************/
+
+
+int8_t ltr390_prof_run(struct ltr390_prof_result *results, uint8_t *count)
+{
+	int8_t rslt = LTR390_OK;
+	struct ltr390_emu emu;
+	struct ltr390_dev dev;
+	struct ltr390_prof_result *res;
+	double wire_bytes;
+	double start_ns;
+	uint32_t iter;
+	uint8_t i;
+	uint8_t b;
+
+	if ((results == NULL) || (count == NULL))
+		return LTR390_E_NULL_PTR;
+	if (*count < LTR390_PROF_CASE_COUNT)
+		return LTR390_E_INVALID_LEN;
+
+	rslt = ltr390_emu_attach(&emu, LTR390_PROF_DEV_ID);
+	if (rslt != LTR390_OK)
+		return rslt;
+	ltr390_emu_set_input(&emu, 500., 2.);
+	/* Read/write callbacks only */
+	dev.xfer = NULL;
+	dev.xfer_ctx = NULL;
+
+	for (i = 0; i < LTR390_PROF_CASE_COUNT; i++) {
+		res = &results[i];
+		res->name = prof_cases[i].name;
+		res->calls = LTR390_PROF_ITERATIONS;
+		res->tx_budget = prof_cases[i].tx_budget;
+
+		/* Bus cost, measured on the emulator */
+		dev.read = ltr390_emu_read;
+		dev.write = ltr390_emu_write;
+		prof_setup(&dev);
+		ltr390_emu_reset_stats(&emu);
+		for (iter = 0; iter < LTR390_PROF_ITERATIONS; iter++)
+			res->rslt = prof_cases[i].run(&dev, iter);
+
+		res->transactions = (double)(emu.stats.read_count + emu.stats.write_count) / LTR390_PROF_ITERATIONS;
+		/* Address and register bytes, plus the repeated start address for reads */
+		wire_bytes = (double)emu.stats.bytes_read + (double)emu.stats.bytes_written +
+					3. * emu.stats.read_count + 2. * emu.stats.write_count;
+		res->wire_bytes = wire_bytes / LTR390_PROF_ITERATIONS;
+		for (b = 0; b < LTR390_PROF_BUS_COUNT; b++)
+			res->wire_us[b] = ltr390_emu_wire_time_us(&emu.stats, prof_bus_hz[b]) / LTR390_PROF_ITERATIONS;
+
+		/* CPU cost, measured on a bus that costs nothing */
+		dev.read = prof_null_read;
+		dev.write = prof_null_write;
+		prof_setup(&dev);
+		start_ns = prof_now_ns();
+		for (iter = 0; iter < LTR390_PROF_ITERATIONS; iter++)
+			(void)prof_cases[i].run(&dev, iter);
+		res->cpu_ns = (prof_now_ns() - start_ns) / LTR390_PROF_ITERATIONS;
+	}
+
+	ltr390_emu_detach(&emu);
+	*count = LTR390_PROF_CASE_COUNT;
+
+	return rslt;
+}
+
+
+uint8_t ltr390_prof_regressions(const struct ltr390_prof_result *results, uint8_t count)
+{
+	uint8_t i;
+	uint8_t regressions = 0;
+
+	for (i = 0; i < count; i++) {
+		if ((results[i].rslt < LTR390_OK) || (results[i].transactions > (double)results[i].tx_budget))
+			regressions++;
+	}
+
+	return regressions;
+}
+
+
+void ltr390_prof_write_csv(FILE *stream, const struct ltr390_prof_result *results, uint8_t count)
+{
+	uint8_t i;
+
+	fprintf(stream, "api,calls,transactions,tx_budget,wire_bytes,wire_us_100k,wire_us_400k,wire_us_1m,cpu_ns,rslt\n");
+	for (i = 0; i < count; i++) {
+		fprintf(stream, "%s,%lu,%.2f,%lu,%.2f,%.1f,%.1f,%.1f,%.1f,%d\n",
+				results[i].name, (unsigned long)results[i].calls,
+				results[i].transactions, (unsigned long)results[i].tx_budget,
+				results[i].wire_bytes, results[i].wire_us[0], results[i].wire_us[1],
+				results[i].wire_us[2], results[i].cpu_ns, results[i].rslt);
+	}
+}
+
+
+void ltr390_prof_write_json(FILE *stream, const struct ltr390_prof_result *results, uint8_t count)
+{
+	uint8_t i;
+
+	fprintf(stream, "[\n");
+	for (i = 0; i < count; i++) {
+		fprintf(stream, "  {\"api\": \"%s\", \"calls\": %lu, \"transactions\": %.2f, \"tx_budget\": %lu, "
+				"\"wire_bytes\": %.2f, \"wire_us\": {\"100k\": %.1f, \"400k\": %.1f, \"1m\": %.1f}, "
+				"\"cpu_ns\": %.1f, \"rslt\": %d}%s\n",
+				results[i].name, (unsigned long)results[i].calls,
+				results[i].transactions, (unsigned long)results[i].tx_budget,
+				results[i].wire_bytes, results[i].wire_us[0], results[i].wire_us[1],
+				results[i].wire_us[2], results[i].cpu_ns, results[i].rslt,
+				(i + 1 < count) ? "," : "");
+	}
+	fprintf(stream, "]\n");
+}
+
+
+int8_t ltr390_prof_xfer(struct ltr390_prof_xfer *results, uint8_t *count)
+{
+	int8_t rslt = LTR390_OK;
+	struct ltr390_emu emu;
+	struct ltr390_dev dev;
+	struct ltr390_prof_xfer *res;
+	uint32_t jobs;
+	double start_ns;
+	uint32_t iter;
+	uint8_t i;
+
+	if ((results == NULL) || (count == NULL))
+		return LTR390_E_NULL_PTR;
+	if (*count < LTR390_PROF_XFER_COUNT)
+		return LTR390_E_INVALID_LEN;
+
+	rslt = ltr390_emu_attach(&emu, LTR390_PROF_DEV_ID);
+	if (rslt != LTR390_OK)
+		return rslt;
+	ltr390_emu_set_input(&emu, 500., 2.);
+	dev.xfer_ctx = NULL;
+
+	for (i = 0; i < LTR390_PROF_XFER_COUNT; i++) {
+		res = &results[i];
+		res->name = prof_xfer_cases[i].name;
+		res->calls = LTR390_PROF_ITERATIONS;
+		res->job_budget = prof_xfer_cases[i].tx_budget;
+
+		/* One submission per operation on the callbacks */
+		dev.read = ltr390_emu_read;
+		dev.write = ltr390_emu_write;
+		dev.xfer = NULL;
+		prof_setup(&dev);
+		ltr390_emu_reset_stats(&emu);
+		for (iter = 0; iter < LTR390_PROF_ITERATIONS; iter++)
+			(void)prof_xfer_cases[i].run(&dev, iter);
+		res->ops = (double)(emu.stats.read_count + emu.stats.write_count) / LTR390_PROF_ITERATIONS;
+		res->callback_subs = res->ops;
+
+		/* Jobs counted on the job transport */
+		dev.xfer = prof_count_xfer;
+		dev.xfer_ctx = &jobs;
+		prof_setup(&dev);
+		jobs = 0;
+		for (iter = 0; iter < LTR390_PROF_ITERATIONS; iter++)
+			res->rslt = prof_xfer_cases[i].run(&dev, iter);
+		res->xfer_subs = (double)jobs / LTR390_PROF_ITERATIONS;
+
+		/* CPU cost, measured on buses that cost nothing */
+		dev.read = prof_null_read;
+		dev.write = prof_null_write;
+		dev.xfer = NULL;
+		prof_setup(&dev);
+		start_ns = prof_now_ns();
+		for (iter = 0; iter < LTR390_PROF_ITERATIONS; iter++)
+			(void)prof_xfer_cases[i].run(&dev, iter);
+		res->callback_ns = (prof_now_ns() - start_ns) / LTR390_PROF_ITERATIONS;
+
+		dev.xfer = prof_null_xfer;
+		dev.xfer_ctx = NULL;
+		prof_setup(&dev);
+		start_ns = prof_now_ns();
+		for (iter = 0; iter < LTR390_PROF_ITERATIONS; iter++)
+			(void)prof_xfer_cases[i].run(&dev, iter);
+		res->xfer_ns = (prof_now_ns() - start_ns) / LTR390_PROF_ITERATIONS;
+	}
+
+	ltr390_emu_detach(&emu);
+	*count = LTR390_PROF_XFER_COUNT;
+
+	return rslt;
+}
+
+
+int8_t ltr390_prof_decode(struct ltr390_prof_decode *result)
+{
+	static uint8_t reg_data[LTR390_PROF_DECODE_COUNT * 3];
+	static uint32_t ref[LTR390_PROF_DECODE_COUNT];
+	static uint32_t out[LTR390_PROF_DECODE_COUNT];
+	uint32_t seed = 0x2545F491;
+	double switch_ns = 0.;
+	double table_ns = 0.;
+	double bulk_ns = 0.;
+	double start_ns;
+	uint32_t round;
+	uint32_t mask;
+	uint8_t resolution;
+	size_t i;
+
+	if (result == NULL)
+		return LTR390_E_NULL_PTR;
+
+	/* Random dumps, the bits above the resolution are set as often as not */
+	for (i = 0; i < sizeof(reg_data); i++) {
+		seed = seed * 1664525 + 1013904223;
+		reg_data[i] = (uint8_t)(seed >> 24);
+	}
+
+	result->mismatches = 0;
+	for (round = 0; round < LTR390_PROF_DECODE_ROUNDS; round++) {
+		resolution = (uint8_t)(round % (LTR390_VAL_RES_13_BIT + 1));
+
+		start_ns = prof_now_ns();
+		for (i = 0; i < LTR390_PROF_DECODE_COUNT; i++)
+			ref[i] = prof_decode_switch(&reg_data[i * 3], resolution);
+		switch_ns += prof_now_ns() - start_ns;
+
+		start_ns = prof_now_ns();
+		mask = ltr390_full_scale[LTR390_RES_INDEX(resolution)];
+		for (i = 0; i < LTR390_PROF_DECODE_COUNT; i++)
+			out[i] = LTR390_DECODE_DATA(&reg_data[i * 3], mask);
+		table_ns += prof_now_ns() - start_ns;
+		result->mismatches += prof_decode_diff(ref, out, LTR390_PROF_DECODE_COUNT);
+
+		start_ns = prof_now_ns();
+		ltr390_batch_decode(reg_data, out, LTR390_PROF_DECODE_COUNT, resolution);
+		bulk_ns += prof_now_ns() - start_ns;
+		result->mismatches += prof_decode_diff(ref, out, LTR390_PROF_DECODE_COUNT);
+	}
+
+	result->samples = LTR390_PROF_DECODE_COUNT * LTR390_PROF_DECODE_ROUNDS;
+	result->switch_ns = switch_ns / result->samples;
+	result->table_ns = table_ns / result->samples;
+	result->bulk_ns = bulk_ns / result->samples;
+	result->isa = ltr390_batch_isa();
+
+	return LTR390_OK;
+}
+
+
+int8_t ltr390_prof_convert(struct ltr390_prof_convert *result)
+{
+	static uint32_t raw[LTR390_PROF_CONVERT_COUNT];
+	static uint8_t tags[LTR390_PROF_CONVERT_COUNT];
+	static float ref[LTR390_PROF_CONVERT_COUNT];
+	static float out[LTR390_PROF_CONVERT_COUNT];
+	static const float scales[LTR390_PROF_CONVERT_SCALES] = {0.6f, 0.025f, 1.5e-4f, 2.6e-5f};
+	uint32_t seed = 0x9E3779B9;
+	double start_ns;
+	uint32_t round;
+	uint8_t isa;
+	size_t i;
+
+	if (result == NULL)
+		return LTR390_E_NULL_PTR;
+
+	/* Random counts with stray bits above the 20-bit registers, random tags */
+	for (i = 0; i < LTR390_PROF_CONVERT_COUNT; i++) {
+		seed = seed * 1664525 + 1013904223;
+		raw[i] = seed;
+		tags[i] = (uint8_t)((seed >> 8) % LTR390_PROF_CONVERT_SCALES);
+	}
+
+	result->scalar_ns = 0.;
+	result->simd_ns = 0.;
+	result->tagged_scalar_ns = 0.;
+	result->tagged_simd_ns = 0.;
+	result->mismatches = 0;
+	isa = ltr390_batch_isa();
+	for (round = 0; round < LTR390_PROF_CONVERT_ROUNDS; round++) {
+		ltr390_batch_force_isa(LTR390_BATCH_ISA_SCALAR);
+		start_ns = prof_now_ns();
+		ltr390_batch_convert(raw, ref, LTR390_PROF_CONVERT_COUNT, scales[round % LTR390_PROF_CONVERT_SCALES]);
+		result->scalar_ns += prof_now_ns() - start_ns;
+
+		/* Forcing anything but scalar or the current kernel re-runs the detection */
+		ltr390_batch_force_isa(isa);
+		start_ns = prof_now_ns();
+		ltr390_batch_convert(raw, out, LTR390_PROF_CONVERT_COUNT, scales[round % LTR390_PROF_CONVERT_SCALES]);
+		result->simd_ns += prof_now_ns() - start_ns;
+		result->mismatches += prof_convert_diff(ref, out, LTR390_PROF_CONVERT_COUNT);
+
+		ltr390_batch_force_isa(LTR390_BATCH_ISA_SCALAR);
+		start_ns = prof_now_ns();
+		ltr390_batch_convert_tagged(raw, tags, scales, ref, LTR390_PROF_CONVERT_COUNT);
+		result->tagged_scalar_ns += prof_now_ns() - start_ns;
+
+		ltr390_batch_force_isa(isa);
+		start_ns = prof_now_ns();
+		ltr390_batch_convert_tagged(raw, tags, scales, out, LTR390_PROF_CONVERT_COUNT);
+		result->tagged_simd_ns += prof_now_ns() - start_ns;
+		result->mismatches += prof_convert_diff(ref, out, LTR390_PROF_CONVERT_COUNT);
+	}
+
+	result->samples = LTR390_PROF_CONVERT_COUNT * LTR390_PROF_CONVERT_ROUNDS;
+	result->scalar_ns /= result->samples;
+	result->simd_ns /= result->samples;
+	result->tagged_scalar_ns /= result->samples;
+	result->tagged_simd_ns /= result->samples;
+	result->isa = ltr390_batch_isa();
+
+	return LTR390_OK;
+}
+
+
+int8_t ltr390_prof_async(struct ltr390_prof_async *result)
+{
+	static struct ltr390_dev devs[LTR390_PROF_ASYNC_DEVS];
+	static struct ltr390_async_dev adevs[LTR390_PROF_ASYNC_DEVS];
+	static struct ltr390_sample samples[LTR390_PROF_ASYNC_DEVS];
+	struct ltr390_async_loop loop;
+	struct ltr390_frame frame;
+	double start_ns;
+	uint32_t round;
+	uint32_t i;
+
+	if (result == NULL)
+		return LTR390_E_NULL_PTR;
+
+	/* Every sensor configured, on a bus that completes each request at once */
+	ltr390_async_loop_init(&loop, prof_async_submit, &loop);
+	result->rslt = LTR390_OK;
+	for (i = 0; i < LTR390_PROF_ASYNC_DEVS; i++) {
+		devs[i].read = prof_null_read;
+		devs[i].write = prof_null_write;
+		devs[i].xfer = NULL;
+		devs[i].xfer_ctx = NULL;
+		prof_setup(&devs[i]);
+		(void)ltr390_async_attach(&adevs[i], &devs[i], &loop, prof_async_done, result);
+	}
+
+	/* One read in flight per sensor, then one pass of the loop */
+	result->reads = 0;
+	start_ns = prof_now_ns();
+	for (round = 0; round < LTR390_PROF_ASYNC_ROUNDS; round++) {
+		for (i = 0; i < LTR390_PROF_ASYNC_DEVS; i++)
+			(void)ltr390_async_read(&adevs[i], &samples[i]);
+		result->reads += ltr390_async_run(&loop);
+	}
+	result->async_ns = (prof_now_ns() - start_ns) / ((double)LTR390_PROF_ASYNC_ROUNDS * LTR390_PROF_ASYNC_DEVS);
+
+	/* Same reads, blocking, one sensor after the other */
+	start_ns = prof_now_ns();
+	for (round = 0; round < LTR390_PROF_ASYNC_ROUNDS; round++) {
+		for (i = 0; i < LTR390_PROF_ASYNC_DEVS; i++)
+			(void)ltr390_get_frame(&frame, &devs[i]);
+	}
+	result->blocking_ns = (prof_now_ns() - start_ns) / ((double)LTR390_PROF_ASYNC_ROUNDS * LTR390_PROF_ASYNC_DEVS);
+
+	result->sensors = LTR390_PROF_ASYNC_DEVS;
+	if (result->reads != LTR390_PROF_ASYNC_ROUNDS * LTR390_PROF_ASYNC_DEVS)
+		result->rslt = LTR390_E_COMM_FAIL;
+	result->sensors_per_core = (result->async_ns > 0.) ? 1e9 / (result->async_ns * LTR390_PROF_ASYNC_RATE_HZ) : 0.;
+
+	return LTR390_OK;
+}
+
+
+static void prof_setup(struct ltr390_dev *dev)
+{
+	ltr390_com_fptr_t read = dev->read;
+	ltr390_com_fptr_t write = dev->write;
+	ltr390_xfer_fptr_t xfer = dev->xfer;
+	void *xfer_ctx = dev->xfer_ctx;
+	uint8_t *raw = (uint8_t *)dev;
+	size_t i;
+
+	for (i = 0; i < sizeof(*dev); i++)
+		raw[i] = 0;
+
+	/* ALS at 100ms, threshold interrupt armed */
+	dev->dev_id = LTR390_PROF_DEV_ID;
+	dev->read = read;
+	dev->write = write;
+	dev->xfer = xfer;
+	dev->xfer_ctx = xfer_ctx;
+	dev->delay_us = ltr390_emu_delay_us;
+	dev->get_time_us = ltr390_emu_time_us;
+	dev->settings.mode = LTR390_VAL_UVS_MODE_ALS;
+	dev->settings.rate = LTR390_VAL_MEAS_RATE_100_MS;
+	dev->settings.resolution = LTR390_VAL_RES_18_BIT;
+	dev->settings.gain_range = LTR390_VAL_GAIN_RANGE_3;
+	dev->settings.int_enabled = TRUE;
+	dev->settings.int_src = LTR390_VAL_LS_INT_SEL_ALS;
+	dev->settings.int_pers = LTR390_VAL_ALS_UVS_TRIG_INT_2_CONS;
+	dev->settings.int_thresh_low = 100;
+	dev->settings.int_thresh_up = 100000;
+	dev->settings.w_fac = 1;
+
+	(void)ltr390_init(dev);
+	(void)ltr390_configure(dev);
+}
+
+static int8_t prof_null_read(uint8_t dev_id, uint8_t reg_addr, uint8_t *data, uint16_t len)
+{
+	uint16_t i;
+
+	(void)dev_id;
+	/* New data always ready, valid part id */
+	for (i = 0; i < len; i++) {
+		if ((uint8_t)(reg_addr + i) == LTR390_REG_PART_ID)
+			data[i] = 0xB2;
+		else if ((uint8_t)(reg_addr + i) == LTR390_REG_MAIN_STATUS)
+			data[i] = LTR390_MASK_ALS_UVS_DATA_STAT;
+		else
+			data[i] = (uint8_t)(reg_addr + i);
+	}
+
+	return LTR390_OK;
+}
+
+static int8_t prof_null_write(uint8_t dev_id, uint8_t reg_addr, uint8_t *data, uint16_t len)
+{
+	(void)dev_id;
+	(void)reg_addr;
+	(void)data;
+	(void)len;
+
+	return LTR390_OK;
+}
+
+static int8_t prof_async_submit(struct ltr390_async_req *req, void *ctx)
+{
+	/* Completed at once, processed on the next ltr390_async_run */
+	if (req->dir == LTR390_ASYNC_READ)
+		(void)prof_null_read(req->dev_id, req->reg_addr, req->data, req->len);
+	ltr390_async_complete((struct ltr390_async_loop *)ctx, req, LTR390_OK);
+
+	return LTR390_OK;
+}
+
+static void prof_async_done(struct ltr390_async_dev *adev, uint8_t op, int8_t rslt, void *ctx)
+{
+	struct ltr390_prof_async *result = (struct ltr390_prof_async *)ctx;
+
+	(void)adev;
+	(void)op;
+	if ((rslt != LTR390_OK) && (result->rslt == LTR390_OK))
+		result->rslt = rslt;
+}
+
+static int8_t prof_null_xfer(struct ltr390_bus_op *ops, uint8_t count, void *ctx)
+{
+	uint8_t i;
+
+	(void)ctx;
+	for (i = 0; i < count; i++) {
+		if (ops[i].dir == LTR390_BUS_READ)
+			(void)prof_null_read(ops[i].addr, ops[i].reg_addr, ops[i].buf, ops[i].len);
+	}
+
+	return LTR390_OK;
+}
+
+static int8_t prof_count_xfer(struct ltr390_bus_op *ops, uint8_t count, void *ctx)
+{
+	(*(uint32_t *)ctx)++;
+
+	return ltr390_emu_xfer(ops, count, NULL);
+}
+
+static double prof_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static PROF_NOINLINE uint32_t prof_decode_switch(const uint8_t *reg_data, uint8_t resolution)
+{
+	uint32_t data;
+
+	/* Per-sample decode the mask table replaced, kept as the reference */
+	switch(resolution)
+	{
+		case LTR390_VAL_RES_13_BIT:
+			data=(uint32_t)(((uint32_t)(reg_data[1]<<8)&0x1F00)|(uint32_t)reg_data[0]);
+			break;
+		case LTR390_VAL_RES_16_BIT:
+			data=(uint32_t)(((uint32_t)(reg_data[1]<<8))|(uint32_t)reg_data[0]);
+			break;
+		case LTR390_VAL_RES_17_BIT:
+			data=(uint32_t)(((uint32_t)(reg_data[2]<<16)&0x10000)|((uint32_t)(reg_data[1]<<8))|(uint32_t)reg_data[0]);
+			break;
+		case LTR390_VAL_RES_18_BIT:
+			data=(uint32_t)(((uint32_t)(reg_data[2]<<16)&0x30000)|((uint32_t)(reg_data[1]<<8))|(uint32_t)reg_data[0]);
+			break;
+		case LTR390_VAL_RES_19_BIT:
+			data=(uint32_t)(((uint32_t)(reg_data[2]<<16)&0x70000)|((uint32_t)(reg_data[1]<<8))|(uint32_t)reg_data[0]);
+			break;
+		default:
+			data=(uint32_t)(((uint32_t)(reg_data[2]<<16)&0xF0000)|((uint32_t)(reg_data[1]<<8))|(uint32_t)reg_data[0]);
+			break;
+	}
+
+	return data;
+}
+
+static uint32_t prof_decode_diff(const uint32_t *ref, const uint32_t *out, size_t count)
+{
+	uint32_t diff = 0;
+	size_t i;
+
+	for (i = 0; i < count; i++) {
+		if (out[i] != ref[i])
+			diff++;
+	}
+
+	return diff;
+}
+
+static uint32_t prof_convert_diff(const float *ref, const float *out, size_t count)
+{
+	uint32_t diff = 0;
+	size_t i;
+
+	for (i = 0; i < count; i++) {
+		if (out[i] != ref[i])
+			diff++;
+	}
+
+	return diff;
+}
+
+static int8_t prof_init(struct ltr390_dev *dev, uint32_t iter)
+{
+	(void)iter;
+	return ltr390_init(dev);
+}
+
+static int8_t prof_configure(struct ltr390_dev *dev, uint32_t iter)
+{
+	/* Alternate the gain so every call has something to write */
+	dev->settings.gain_range = (iter & 1) ? LTR390_VAL_GAIN_RANGE_6 : LTR390_VAL_GAIN_RANGE_3;
+	return ltr390_configure(dev);
+}
+
+static int8_t prof_soft_reset(struct ltr390_dev *dev, uint32_t iter)
+{
+	(void)iter;
+	return ltr390_soft_reset(dev);
+}
+
+static int8_t prof_sync_regs(struct ltr390_dev *dev, uint32_t iter)
+{
+	(void)iter;
+	return ltr390_sync_regs(dev);
+}
+
+static int8_t prof_set_mode(struct ltr390_dev *dev, uint32_t iter)
+{
+	return ltr390_set_mode((uint8_t)(iter & 1), dev);
+}
+
+static int8_t prof_set_rate(struct ltr390_dev *dev, uint32_t iter)
+{
+	return ltr390_set_rate((uint8_t)(iter % (LTR390_VAL_MEAS_RATE_2000_MS + 1)), dev);
+}
+
+static int8_t prof_set_resolution(struct ltr390_dev *dev, uint32_t iter)
+{
+	return ltr390_set_resolution((uint8_t)(iter % (LTR390_VAL_RES_13_BIT + 1)), dev);
+}
+
+static int8_t prof_set_gain(struct ltr390_dev *dev, uint32_t iter)
+{
+	return ltr390_set_gain((uint8_t)(iter % (LTR390_VAL_GAIN_RANGE_18 + 1)), dev);
+}
+
+static int8_t prof_set_int(struct ltr390_dev *dev, uint32_t iter)
+{
+	return ltr390_set_int((uint8_t)(iter & 1), dev);
+}
+
+static int8_t prof_set_int_src(struct ltr390_dev *dev, uint32_t iter)
+{
+	return ltr390_set_int_src((iter & 1) ? LTR390_VAL_LS_INT_SEL_UVS : LTR390_VAL_LS_INT_SEL_ALS, dev);
+}
+
+static int8_t prof_set_int_pers(struct ltr390_dev *dev, uint32_t iter)
+{
+	return ltr390_set_int_pers((uint8_t)(iter & 0x0F), dev);
+}
+
+static int8_t prof_set_thresh_low(struct ltr390_dev *dev, uint32_t iter)
+{
+	return ltr390_set_thresh_low(iter * 16, dev);
+}
+
+static int8_t prof_set_thresh_up(struct ltr390_dev *dev, uint32_t iter)
+{
+	return ltr390_set_thresh_up(0xFFFFF - iter * 16, dev);
+}
+
+static int8_t prof_get_raw_data(struct ltr390_dev *dev, uint32_t iter)
+{
+	uint32_t data;
+
+	(void)iter;
+	return ltr390_get_raw_data(&data, dev);
+}
+
+static int8_t prof_get_status(struct ltr390_dev *dev, uint32_t iter)
+{
+	uint8_t status;
+
+	(void)iter;
+	return ltr390_get_status(&status, dev);
+}
+
+static int8_t prof_get_new_data(struct ltr390_dev *dev, uint32_t iter)
+{
+	struct ltr390_sample sample;
+
+	(void)iter;
+	/* Let one conversion complete, costs no bus traffic */
+	ltr390_emu_advance(ltr390_meas_period_us(dev->settings.rate, dev->settings.resolution));
+	return ltr390_get_new_data(&sample, dev);
+}
+
+static int8_t prof_get_frame(struct ltr390_dev *dev, uint32_t iter)
+{
+	struct ltr390_frame frame;
+
+	(void)iter;
+	return ltr390_get_frame(&frame, dev);
+}
+
+static int8_t prof_computed_data(struct ltr390_dev *dev, uint32_t iter)
+{
+	double computed;
+
+	return ltr390_computed_data(iter * 1000, &computed, dev);
+}
+
+static int8_t prof_restore(struct ltr390_dev *dev, uint32_t iter)
+{
+	(void)iter;
+	return ltr390_restore(dev);
+}
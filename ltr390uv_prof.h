@@ -0,0 +1,192 @@
+/*
+ * This file is part of the LTR-390-UV-01 library (https://github.com/Cplaton/ltr390).
+ * Copyright (c) 2021 Clement Platon.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Bus cost profiler.
+ *
+ * Runs each public API of ltr390uv.h against the emulator and reports,
+ * per call, the bus transactions, bytes on the wire, the wire time at
+ * standard I2C clocks and the host CPU time. Each API has a transaction
+ * budget so a caller can fail on regressions.
+ *
+ * A separate microbenchmark times the data register decode: the former
+ * per-sample switch on resolution, the mask table decode and the bulk
+ * decode of ltr390uv_batch.h, and checks they agree. Another times the
+ * batch conversions, plain and tagged, on the scalar kernel against the
+ * detected AVX2 or NEON one.
+ *
+ * ltr390_prof_async drives many sensors from one thread through the
+ * non-blocking API on a bus that completes at once, and reports the host
+ * CPU time per read and how many sensors one core keeps up with at the
+ * fastest measurement rate.
+ *
+ * ltr390_prof_xfer compares, for the APIs that build multi-operation
+ * jobs, the read/write callbacks against the ltr390_dev.xfer transport:
+ * transport submissions and host CPU time per call.
+ */
+
+#ifndef LTR390_PROF_H_
+#define LTR390_PROF_H_
+
+/********************************************************/
+/* header includes */
+#include <stdio.h>
+#include "ltr390uv_defs.h"
+
+
+/********************************************************/
+/*                      Consts                          */
+/********************************************************/
+
+/* Number of profiled APIs */
+#define LTR390_PROF_CASE_COUNT                  18
+
+/* Calls per profiled API */
+#define LTR390_PROF_ITERATIONS                  64
+
+/* Handle of the emulated sensor used by the profiler */
+#define LTR390_PROF_DEV_ID                      0x53
+
+/* I2C clocks the wire time is reported for */
+#define LTR390_PROF_BUS_COUNT                   3
+#define LTR390_PROF_BUS_100K                    100000
+#define LTR390_PROF_BUS_400K                    400000
+#define LTR390_PROF_BUS_1M                      1000000
+
+/* Number of APIs compared on the job transport */
+#define LTR390_PROF_XFER_COUNT                  3
+
+/* Decode microbenchmark: register triplets per round, rounds */
+#define LTR390_PROF_DECODE_COUNT                1024
+#define LTR390_PROF_DECODE_ROUNDS               240
+
+/* Conversion microbenchmark: samples per round, rounds, scales of the tagged conversion */
+#define LTR390_PROF_CONVERT_COUNT               1024
+#define LTR390_PROF_CONVERT_ROUNDS              240
+#define LTR390_PROF_CONVERT_SCALES              4
+
+/* Async benchmark: sensors on the loop, reads per sensor, samples/s per sensor (25ms rate) */
+#define LTR390_PROF_ASYNC_DEVS                  32
+#define LTR390_PROF_ASYNC_ROUNDS                256
+#define LTR390_PROF_ASYNC_RATE_HZ               40
+
+
+/* ltr390 profiler result of one API */
+struct ltr390_prof_result {
+    /* API name */
+    const char *name;
+    /* Number of calls */
+    uint32_t calls;
+    /* Bus transactions per call */
+    double transactions;
+    /* Bytes on the wire per call, addressing included */
+    double wire_bytes;
+    /* Wire time per call in us at 100kHz, 400kHz and 1MHz */
+    double wire_us[LTR390_PROF_BUS_COUNT];
+    /* Host CPU time per call in ns, bus excluded */
+    double cpu_ns;
+    /* Maximum transactions per call */
+    uint32_t tx_budget;
+    /* Result of the last call */
+    int8_t rslt;
+};
+
+/* ltr390 profiler result of one API, callbacks against the job transport */
+struct ltr390_prof_xfer {
+    /* API name */
+    const char *name;
+    /* Number of calls */
+    uint32_t calls;
+    /* Bus operations per call */
+    double ops;
+    /* Transport submissions per call, with read/write and with xfer */
+    double callback_subs;
+    double xfer_subs;
+    /* Host CPU time per call in ns, with read/write and with xfer, bus excluded */
+    double callback_ns;
+    double xfer_ns;
+    /* Maximum xfer submissions per call */
+    uint32_t job_budget;
+    /* Result of the last call on the job transport */
+    int8_t rslt;
+};
+
+/* ltr390 decode microbenchmark result */
+struct ltr390_prof_decode {
+    /* Samples decoded by each variant */
+    uint32_t samples;
+    /* Host CPU time per sample in ns: per-sample switch, mask table, bulk */
+    double switch_ns;
+    double table_ns;
+    double bulk_ns;
+    /* Samples the mask table or bulk decode got different from the switch */
+    uint32_t mismatches;
+    /* Bulk kernel (LTR390_BATCH_ISA_xxx) */
+    uint8_t isa;
+};
+
+/* ltr390 conversion microbenchmark result */
+struct ltr390_prof_convert {
+    /* Samples converted by each variant */
+    uint32_t samples;
+    /* Host CPU time per sample in ns, scalar and detected kernel */
+    double scalar_ns;
+    double simd_ns;
+    /* Same for the tagged conversion */
+    double tagged_scalar_ns;
+    double tagged_simd_ns;
+    /* Samples the detected kernel got different from the scalar one */
+    uint32_t mismatches;
+    /* Detected kernel (LTR390_BATCH_ISA_xxx) */
+    uint8_t isa;
+};
+
+/* ltr390 async benchmark result */
+struct ltr390_prof_async {
+    /* Sensors on the loop */
+    uint32_t sensors;
+    /* Reads completed */
+    uint32_t reads;
+    /* Host CPU time per read in ns, async loop and blocking ltr390_get_frame, bus excluded */
+    double async_ns;
+    double blocking_ns;
+    /* Sensors one core serves at LTR390_PROF_ASYNC_RATE_HZ, async driver time only */
+    double sensors_per_core;
+    /* First failed read, LTR390_OK if none */
+    int8_t rslt;
+};
+
+
+/********************************************************/
+
+int8_t ltr390_prof_run(struct ltr390_prof_result *results, uint8_t *count);
+
+uint8_t ltr390_prof_regressions(const struct ltr390_prof_result *results, uint8_t count);
+
+void ltr390_prof_write_csv(FILE *stream, const struct ltr390_prof_result *results, uint8_t count);
+
+void ltr390_prof_write_json(FILE *stream, const struct ltr390_prof_result *results, uint8_t count);
+
+int8_t ltr390_prof_decode(struct ltr390_prof_decode *result);
+
+int8_t ltr390_prof_convert(struct ltr390_prof_convert *result);
+
+int8_t ltr390_prof_async(struct ltr390_prof_async *result);
+
+int8_t ltr390_prof_xfer(struct ltr390_prof_xfer *results, uint8_t *count);
+
+#endif /* LTR390_PROF_H_ */
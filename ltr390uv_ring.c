@@ -0,0 +1,157 @@
+/*
+ * This file is part of the LTR-390-UV-01 library (https://github.com/Cplaton/ltr390).
+ * Copyright (c) 2021 Clement Platon.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/********************************************************/
+/* header includes */
+#include "ltr390uv_ring.h"
+
+/********************************************************/
+
+
+int8_t ltr390_ring_init(struct ltr390_ring *ring, struct ltr390_ring_rec *storage, uint32_t capacity, uint8_t policy)
+{
+	if ((ring == NULL) || (storage == NULL))
+		return LTR390_E_NULL_PTR;
+	/* Power of two so free running indexes wrap cleanly */
+	if ((capacity == 0) || (capacity & (capacity - 1)) || (capacity > UINT32_C(0x80000000)))
+		return LTR390_E_INVALID_LEN;
+	if (policy > LTR390_RING_DROP_OLDEST)
+		return LTR390_E_INVALID_VAL;
+
+	ring->recs = storage;
+	ring->mask = capacity - 1;
+	ring->policy = policy;
+	atomic_init(&ring->head, 0);
+	atomic_init(&ring->tail, 0);
+	atomic_init(&ring->overflows, 0);
+
+	return LTR390_OK;
+}
+
+
+int8_t ltr390_ring_push(struct ltr390_ring *ring, const struct ltr390_sample *sample, uint32_t time_us)
+{
+	int8_t rslt = LTR390_OK;
+	uint32_t head;
+	uint32_t tail;
+
+	if ((ring == NULL) || (sample == NULL))
+		return LTR390_E_NULL_PTR;
+
+	head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+	tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+	/*
+	 * Full: either drop this sample, or reclaim the oldest record by moving
+	 * the tail before its slot is overwritten. A consumer reading that slot
+	 * meanwhile fails its own tail update and retries. A failed update here
+	 * means the consumer freed space, so this loops at most once.
+	 */
+	while ((head - tail) > ring->mask) {
+		if (ring->policy == LTR390_RING_DROP_NEWEST) {
+			atomic_fetch_add_explicit(&ring->overflows, 1, memory_order_relaxed);
+			return LTR390_W_OVERFLOW;
+		}
+		if (atomic_compare_exchange_weak_explicit(&ring->tail, &tail, tail + 1,
+				memory_order_acq_rel, memory_order_acquire)) {
+			atomic_fetch_add_explicit(&ring->overflows, 1, memory_order_relaxed);
+			rslt = LTR390_W_OVERFLOW;
+			break;
+		}
+	}
+
+	ltr390_ring_pack(&ring->recs[head & ring->mask], sample, time_us);
+	/* Publish the record */
+	atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+
+	return rslt;
+}
+
+
+uint32_t ltr390_ring_pop(struct ltr390_ring *ring, struct ltr390_ring_rec *recs, uint32_t max_count)
+{
+	uint32_t head;
+	uint32_t tail;
+	uint32_t count;
+	uint32_t i;
+
+	if ((ring == NULL) || (recs == NULL))
+		return 0;
+
+	tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+	do {
+		head = atomic_load_explicit(&ring->head, memory_order_acquire);
+		count = head - tail;
+		if (count > max_count)
+			count = max_count;
+		if (count == 0)
+			return 0;
+
+		for (i = 0; i < count; i++)
+			recs[i] = ring->recs[(tail + i) & ring->mask];
+
+		/* Fails only if the producer reclaimed records being copied */
+	} while (!atomic_compare_exchange_strong_explicit(&ring->tail, &tail, tail + count,
+				memory_order_acq_rel, memory_order_acquire));
+
+	return count;
+}
+
+
+uint32_t ltr390_ring_count(struct ltr390_ring *ring)
+{
+	uint32_t tail;
+	uint32_t head;
+
+	if (ring == NULL)
+		return 0;
+
+	tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+	head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+	return head - tail;
+}
+
+
+uint32_t ltr390_ring_overflows(struct ltr390_ring *ring)
+{
+	if (ring == NULL)
+		return 0;
+
+	return atomic_load_explicit(&ring->overflows, memory_order_relaxed);
+}
+
+
+void ltr390_ring_pack(struct ltr390_ring_rec *rec, const struct ltr390_sample *sample, uint32_t time_us)
+{
+	rec->time_us = time_us;
+	rec->data = (sample->raw & LTR390_RING_MASK_RAW) |
+				(((uint32_t)sample->mode << LTR390_RING_POS_MODE) & LTR390_RING_MASK_MODE) |
+				(((uint32_t)sample->gain_range << LTR390_RING_POS_GAIN) & LTR390_RING_MASK_GAIN) |
+				(((uint32_t)sample->resolution << LTR390_RING_POS_RES) & LTR390_RING_MASK_RES) |
+				(((uint32_t)sample->flags << LTR390_RING_POS_FLAGS) & LTR390_RING_MASK_FLAGS);
+}
+
+
+void ltr390_ring_unpack(struct ltr390_sample *sample, const struct ltr390_ring_rec *rec)
+{
+	sample->raw = LTR390_RING_REC_RAW(rec);
+	sample->mode = LTR390_RING_REC_MODE(rec);
+	sample->gain_range = LTR390_RING_REC_GAIN(rec);
+	sample->resolution = LTR390_RING_REC_RES(rec);
+	sample->flags = LTR390_RING_REC_FLAGS(rec);
+}
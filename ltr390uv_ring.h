@@ -0,0 +1,119 @@
+/*
+ * This file is part of the LTR-390-UV-01 library (https://github.com/Cplaton/ltr390).
+ * Copyright (c) 2021 Clement Platon.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Lock-free single-producer/single-consumer sample ring (C11 atomics).
+ *
+ * Samples are packed into 8-byte records, eight per 64-byte cache line,
+ * in storage provided by the caller. The producer never blocks and never
+ * allocates, so it can run from an interrupt handler. When the ring is
+ * full the new sample is dropped (DROP_NEWEST) or the oldest record is
+ * reclaimed (DROP_OLDEST), and the overflow counter is incremented.
+ */
+
+#ifndef LTR390_RING_H_
+#define LTR390_RING_H_
+
+/********************************************************/
+/* header includes */
+#include <stdatomic.h>
+#include "ltr390uv_defs.h"
+
+
+/********************************************************/
+/*                      Macros                          */
+/********************************************************/
+
+#define LTR390_RING_REC_RAW(rec) \
+        ((rec)->data & LTR390_RING_MASK_RAW)
+
+#define LTR390_RING_REC_MODE(rec) \
+        (uint8_t)(((rec)->data & LTR390_RING_MASK_MODE) >> LTR390_RING_POS_MODE)
+
+#define LTR390_RING_REC_GAIN(rec) \
+        (uint8_t)(((rec)->data & LTR390_RING_MASK_GAIN) >> LTR390_RING_POS_GAIN)
+
+#define LTR390_RING_REC_RES(rec) \
+        (uint8_t)(((rec)->data & LTR390_RING_MASK_RES) >> LTR390_RING_POS_RES)
+
+#define LTR390_RING_REC_FLAGS(rec) \
+        (uint8_t)(((rec)->data & LTR390_RING_MASK_FLAGS) >> LTR390_RING_POS_FLAGS)
+
+
+/********************************************************/
+/*                      Consts                          */
+/********************************************************/
+
+/* Overflow policies */
+#define LTR390_RING_DROP_NEWEST                 0x00
+#define LTR390_RING_DROP_OLDEST                 0x01
+
+/* Packed record fields */
+#define LTR390_RING_POS_MODE                    20
+#define LTR390_RING_POS_GAIN                    21
+#define LTR390_RING_POS_RES                     24
+#define LTR390_RING_POS_FLAGS                   27
+
+#define LTR390_RING_MASK_RAW                    UINT32_C(0x000FFFFF)
+#define LTR390_RING_MASK_MODE                   UINT32_C(0x00100000)
+#define LTR390_RING_MASK_GAIN                   UINT32_C(0x00E00000)
+#define LTR390_RING_MASK_RES                    UINT32_C(0x07000000)
+#define LTR390_RING_MASK_FLAGS                  UINT32_C(0x78000000)
+
+
+/* ltr390 packed sample record */
+struct ltr390_ring_rec {
+    /* Timestamp in us */
+    uint32_t time_us;
+    /* Raw counts, mode, gain range, resolution and sample flags */
+    uint32_t data;
+};
+
+/* ltr390 SPSC sample ring */
+struct ltr390_ring {
+    /* Record storage, capacity entries */
+    struct ltr390_ring_rec *recs;
+    /* Capacity - 1, capacity is a power of two */
+    uint32_t mask;
+    /* Overflow policy (LTR390_RING_DROP_xxx) */
+    uint8_t policy;
+    /* Next record to write, free running, written by the producer */
+    _Atomic uint32_t head;
+    /* Next record to read, free running, written by the consumer (and the producer on DROP_OLDEST) */
+    _Atomic uint32_t tail;
+    /* Samples lost to overflow */
+    _Atomic uint32_t overflows;
+};
+
+
+/********************************************************/
+
+int8_t ltr390_ring_init(struct ltr390_ring *ring, struct ltr390_ring_rec *storage, uint32_t capacity, uint8_t policy);
+
+int8_t ltr390_ring_push(struct ltr390_ring *ring, const struct ltr390_sample *sample, uint32_t time_us);
+
+uint32_t ltr390_ring_pop(struct ltr390_ring *ring, struct ltr390_ring_rec *recs, uint32_t max_count);
+
+uint32_t ltr390_ring_count(struct ltr390_ring *ring);
+
+uint32_t ltr390_ring_overflows(struct ltr390_ring *ring);
+
+void ltr390_ring_pack(struct ltr390_ring_rec *rec, const struct ltr390_sample *sample, uint32_t time_us);
+
+void ltr390_ring_unpack(struct ltr390_sample *sample, const struct ltr390_ring_rec *rec);
+
+#endif /* LTR390_RING_H_ */
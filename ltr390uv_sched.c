@@ -0,0 +1,317 @@
+/*
+ * This file is part of the LTR-390-UV-01 library (https://github.com/Cplaton/ltr390).
+ * Copyright (c) 2021 Clement Platon.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+/********************************************************/
+/* header includes */
+#include <time.h>
+#include "ltr390uv_sched.h"
+#include "ltr390uv.h"
+
+static void *sched_worker(void *arg);
+
+static void sched_read(struct ltr390_sched *sched, struct ltr390_sched_entry *entry, uint64_t now_us);
+
+static uint64_t sched_now_us(void);
+
+/********************************************************/
+
+
+int8_t ltr390_sched_init(struct ltr390_sched *sched, ltr390_sched_cb_t callback, void *ctx)
+{
+	pthread_condattr_t attr;
+	uint8_t i;
+
+	if (sched == NULL)
+		return LTR390_E_NULL_PTR;
+
+	sched->dev_count = 0;
+	sched->callback = callback;
+	sched->cb_ctx = ctx;
+	sched->start_us = 0;
+	sched->stop = FALSE;
+	for (i = 0; i < LTR390_SCHED_MAX_BUS; i++) {
+		sched->buses[i].started = FALSE;
+		sched->buses[i].sched = sched;
+	}
+
+	/* Workers wait on the monotonic clock */
+	if (pthread_mutex_init(&sched->lock, NULL) != 0)
+		return LTR390_E_INVALID_VAL;
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	if (pthread_cond_init(&sched->wake, &attr) != 0) {
+		pthread_condattr_destroy(&attr);
+		pthread_mutex_destroy(&sched->lock);
+		return LTR390_E_INVALID_VAL;
+	}
+	pthread_condattr_destroy(&attr);
+
+	return LTR390_OK;
+}
+
+
+int8_t ltr390_sched_add(struct ltr390_sched *sched, struct ltr390_dev *dev, uint8_t bus)
+{
+	struct ltr390_sched_entry *entry;
+	uint32_t period_us;
+
+	if ((sched == NULL) || (dev == NULL))
+		return LTR390_E_NULL_PTR;
+	if (bus >= LTR390_SCHED_MAX_BUS)
+		return LTR390_E_INVALID_VAL;
+	if (sched->dev_count >= LTR390_SCHED_MAX_DEV)
+		return LTR390_E_INVALID_LEN;
+
+	period_us = ltr390_meas_period_us(dev->settings.rate, dev->settings.resolution);
+	if (period_us == 0)
+		return LTR390_E_INVALID_VAL;
+
+	entry = &sched->devs[sched->dev_count];
+	entry->dev = dev;
+	entry->bus = bus;
+	entry->period_us = period_us;
+	entry->due_us = 0;
+	entry->stats.samples = 0;
+	entry->stats.stale = 0;
+	entry->stats.errors = 0;
+	entry->stats.lag_last_us = 0;
+	entry->stats.lag_max_us = 0;
+	entry->stats.lag_sum_us = 0;
+	sched->dev_count++;
+
+	return LTR390_OK;
+}
+
+
+int8_t ltr390_sched_start(struct ltr390_sched *sched)
+{
+	int8_t rslt = LTR390_OK;
+	struct ltr390_sched_bus *bus;
+	uint8_t i;
+	uint8_t b;
+
+	if (sched == NULL)
+		return LTR390_E_NULL_PTR;
+
+	sched->stop = FALSE;
+	sched->start_us = sched_now_us();
+	/* First read one period after start, when a conversion is expected */
+	for (i = 0; i < sched->dev_count; i++)
+		sched->devs[i].due_us = sched->start_us + sched->devs[i].period_us;
+
+	for (b = 0; b < LTR390_SCHED_MAX_BUS; b++) {
+		bus = &sched->buses[b];
+		bus->stats.samples = 0;
+		bus->stats.batches = 0;
+		bus->stats.busy_us = 0;
+		bus->stats.elapsed_us = 0;
+		bus->stats.samples_per_s = 0.;
+
+		/* One worker per bus that has sensors */
+		for (i = 0; i < sched->dev_count; i++) {
+			if (sched->devs[i].bus == b)
+				break;
+		}
+		if (i == sched->dev_count)
+			continue;
+
+		if (pthread_create(&bus->thread, NULL, sched_worker, bus) != 0) {
+			rslt = LTR390_E_INVALID_VAL;
+			break;
+		}
+		bus->started = TRUE;
+	}
+
+	if (rslt != LTR390_OK)
+		(void)ltr390_sched_stop(sched);
+
+	return rslt;
+}
+
+
+int8_t ltr390_sched_stop(struct ltr390_sched *sched)
+{
+	uint8_t b;
+
+	if (sched == NULL)
+		return LTR390_E_NULL_PTR;
+
+	pthread_mutex_lock(&sched->lock);
+	sched->stop = TRUE;
+	pthread_cond_broadcast(&sched->wake);
+	pthread_mutex_unlock(&sched->lock);
+
+	for (b = 0; b < LTR390_SCHED_MAX_BUS; b++) {
+		if (sched->buses[b].started == TRUE) {
+			pthread_join(sched->buses[b].thread, NULL);
+			sched->buses[b].started = FALSE;
+		}
+	}
+
+	return LTR390_OK;
+}
+
+
+int8_t ltr390_sched_get_bus_stats(struct ltr390_sched *sched, uint8_t bus, struct ltr390_sched_bus_stats *stats)
+{
+	if ((sched == NULL) || (stats == NULL))
+		return LTR390_E_NULL_PTR;
+	if (bus >= LTR390_SCHED_MAX_BUS)
+		return LTR390_E_INVALID_VAL;
+
+	pthread_mutex_lock(&sched->lock);
+	*stats = sched->buses[bus].stats;
+	pthread_mutex_unlock(&sched->lock);
+
+	stats->elapsed_us = sched_now_us() - sched->start_us;
+	if (stats->elapsed_us > 0)
+		stats->samples_per_s = ((double)stats->samples * 1e6) / (double)stats->elapsed_us;
+
+	return LTR390_OK;
+}
+
+
+int8_t ltr390_sched_get_dev_stats(struct ltr390_sched *sched, const struct ltr390_dev *dev, struct ltr390_sched_dev_stats *stats)
+{
+	int8_t rslt = LTR390_E_INVALID_VAL;
+	uint8_t i;
+
+	if ((sched == NULL) || (dev == NULL) || (stats == NULL))
+		return LTR390_E_NULL_PTR;
+
+	pthread_mutex_lock(&sched->lock);
+	for (i = 0; i < sched->dev_count; i++) {
+		if (sched->devs[i].dev == dev) {
+			*stats = sched->devs[i].stats;
+			rslt = LTR390_OK;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&sched->lock);
+
+	return rslt;
+}
+
+
+void ltr390_sched_deinit(struct ltr390_sched *sched)
+{
+	if (sched == NULL)
+		return;
+
+	(void)ltr390_sched_stop(sched);
+	pthread_cond_destroy(&sched->wake);
+	pthread_mutex_destroy(&sched->lock);
+}
+
+
+static void *sched_worker(void *arg)
+{
+	struct ltr390_sched_bus *bus = (struct ltr390_sched_bus *)arg;
+	struct ltr390_sched *sched = bus->sched;
+	uint8_t bus_id = (uint8_t)(bus - sched->buses);
+	struct timespec until;
+	uint64_t next_us;
+	uint64_t now_us;
+	uint64_t batch_start_us;
+	uint8_t i;
+
+	pthread_mutex_lock(&sched->lock);
+	while (sched->stop == FALSE) {
+		/* Earliest due sensor on this bus */
+		next_us = UINT64_MAX;
+		for (i = 0; i < sched->dev_count; i++) {
+			if ((sched->devs[i].bus == bus_id) && (sched->devs[i].due_us < next_us))
+				next_us = sched->devs[i].due_us;
+		}
+
+		now_us = sched_now_us();
+		if (next_us > now_us) {
+			until.tv_sec = (time_t)(next_us / 1000000);
+			until.tv_nsec = (long)((next_us % 1000000) * 1000);
+			pthread_cond_timedwait(&sched->wake, &sched->lock, &until);
+			continue;
+		}
+
+		/*
+		 * Read every sensor already due, back-to-back. A sensor is never
+		 * read ahead of its due time, so its conversion is out; sensors
+		 * that fall due while the batch runs join it.
+		 */
+		batch_start_us = now_us;
+		for (i = 0; (i < sched->dev_count) && (sched->stop == FALSE); i++) {
+			now_us = sched_now_us();
+			if ((sched->devs[i].bus == bus_id) && (sched->devs[i].due_us <= now_us))
+				sched_read(sched, &sched->devs[i], now_us);
+		}
+		bus->stats.batches++;
+		bus->stats.busy_us += sched_now_us() - batch_start_us;
+	}
+	pthread_mutex_unlock(&sched->lock);
+
+	return NULL;
+}
+
+static void sched_read(struct ltr390_sched *sched, struct ltr390_sched_entry *entry, uint64_t now_us)
+{
+	struct ltr390_sample sample;
+	uint32_t lag_us = 0;
+	int8_t rslt;
+
+	if (now_us > entry->due_us)
+		lag_us = (uint32_t)(now_us - entry->due_us);
+
+	/* Bus transfer and callback run unlocked, entries are owned by their bus worker */
+	pthread_mutex_unlock(&sched->lock);
+	rslt = ltr390_get_new_data(&sample, entry->dev);
+	if ((rslt == LTR390_OK) && (sched->callback != NULL))
+		sched->callback(entry->dev, &sample, sched->cb_ctx);
+	pthread_mutex_lock(&sched->lock);
+
+	if (rslt == LTR390_W_NO_NEW_DATA) {
+		/* Conversion not out yet, come back a fraction of a period later */
+		entry->stats.stale++;
+		entry->due_us = now_us + entry->period_us / LTR390_DATA_POLL_DIV;
+		return;
+	}
+
+	if (rslt == LTR390_OK) {
+		entry->stats.samples++;
+		sched->buses[entry->bus].stats.samples++;
+		entry->stats.lag_last_us = lag_us;
+		entry->stats.lag_sum_us += lag_us;
+		if (lag_us > entry->stats.lag_max_us)
+			entry->stats.lag_max_us = lag_us;
+	} else {
+		entry->stats.errors++;
+	}
+
+	/* Next conversion, skipping the ones already missed */
+	entry->due_us += entry->period_us;
+	if (entry->due_us <= now_us)
+		entry->due_us = now_us + entry->period_us;
+}
+
+static uint64_t sched_now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
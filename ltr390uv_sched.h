@@ -0,0 +1,147 @@
+/*
+ * This file is part of the LTR-390-UV-01 library (https://github.com/Cplaton/ltr390).
+ * Copyright (c) 2021 Clement Platon.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Multi-sensor acquisition scheduler.
+ *
+ * Sensors are grouped by bus and each bus gets its own worker thread, so
+ * buses progress in parallel. A worker sleeps until the next sensor is
+ * due according to its measurement period, then reads every sensor
+ * already due back-to-back to keep the bus busy in bursts rather than
+ * spread out. No sensor is read before its due time.
+ */
+
+#ifndef LTR390_SCHED_H_
+#define LTR390_SCHED_H_
+
+/********************************************************/
+/* header includes */
+#include <pthread.h>
+#include "ltr390uv_defs.h"
+
+
+/********************************************************/
+/*                      Consts                          */
+/********************************************************/
+
+/* Maximum number of sensors per scheduler */
+#define LTR390_SCHED_MAX_DEV                    64
+
+/* Maximum number of buses (worker threads) per scheduler */
+#define LTR390_SCHED_MAX_BUS                    8
+
+
+/* Type definitions */
+typedef void (*ltr390_sched_cb_t)(struct ltr390_dev *dev, const struct ltr390_sample *sample, void *ctx);
+
+
+/* ltr390 scheduler per-sensor statistics */
+struct ltr390_sched_dev_stats {
+    /* Fresh samples delivered */
+    uint32_t samples;
+    /* Reads that found no new conversion */
+    uint32_t stale;
+    /* Failed reads */
+    uint32_t errors;
+    /* Last read lag behind its due time in us */
+    uint32_t lag_last_us;
+    /* Worst read lag in us */
+    uint32_t lag_max_us;
+    /* Sum of the read lags in us */
+    uint64_t lag_sum_us;
+};
+
+/* ltr390 scheduler per-bus statistics */
+struct ltr390_sched_bus_stats {
+    /* Fresh samples delivered */
+    uint32_t samples;
+    /* Batches issued */
+    uint32_t batches;
+    /* Time spent in bus transfers in us */
+    uint64_t busy_us;
+    /* Time since start in us */
+    uint64_t elapsed_us;
+    /* Fresh samples per second */
+    double samples_per_s;
+};
+
+/* ltr390 scheduled sensor */
+struct ltr390_sched_entry {
+    /* Sensor */
+    struct ltr390_dev *dev;
+    /* Bus index */
+    uint8_t bus;
+    /* Measurement period in us */
+    uint32_t period_us;
+    /* Next read time in us */
+    uint64_t due_us;
+    /* Statistics */
+    struct ltr390_sched_dev_stats stats;
+};
+
+/* ltr390 bus worker */
+struct ltr390_sched_bus {
+    /* Worker thread */
+    pthread_t thread;
+    /* Worker thread started */
+    uint8_t started;
+    /* Owning scheduler */
+    struct ltr390_sched *sched;
+    /* Statistics */
+    struct ltr390_sched_bus_stats stats;
+};
+
+/* ltr390 scheduler */
+struct ltr390_sched {
+    /* Scheduled sensors */
+    struct ltr390_sched_entry devs[LTR390_SCHED_MAX_DEV];
+    /* Number of scheduled sensors */
+    uint8_t dev_count;
+    /* Bus workers */
+    struct ltr390_sched_bus buses[LTR390_SCHED_MAX_BUS];
+    /* Sample callback, run from the bus worker threads */
+    ltr390_sched_cb_t callback;
+    /* Callback context */
+    void *cb_ctx;
+    /* Start time in us */
+    uint64_t start_us;
+    /* Stop requested */
+    uint8_t stop;
+    /* Protects the scheduling state and statistics */
+    pthread_mutex_t lock;
+    /* Wakes the workers on stop */
+    pthread_cond_t wake;
+};
+
+
+/********************************************************/
+
+int8_t ltr390_sched_init(struct ltr390_sched *sched, ltr390_sched_cb_t callback, void *ctx);
+
+int8_t ltr390_sched_add(struct ltr390_sched *sched, struct ltr390_dev *dev, uint8_t bus);
+
+int8_t ltr390_sched_start(struct ltr390_sched *sched);
+
+int8_t ltr390_sched_stop(struct ltr390_sched *sched);
+
+int8_t ltr390_sched_get_bus_stats(struct ltr390_sched *sched, uint8_t bus, struct ltr390_sched_bus_stats *stats);
+
+int8_t ltr390_sched_get_dev_stats(struct ltr390_sched *sched, const struct ltr390_dev *dev, struct ltr390_sched_dev_stats *stats);
+
+void ltr390_sched_deinit(struct ltr390_sched *sched);
+
+#endif /* LTR390_SCHED_H_ */
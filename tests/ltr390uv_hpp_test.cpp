@@ -0,0 +1,203 @@
+/*
+ * This file is part of the LTR-390-UV-01 library (https://github.com/Cplaton/ltr390).
+ * Copyright (c) 2021 Clement Platon.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * C++ wrapper tests against the emulator.
+ *
+ * Each configuration is instantiated as a Sensor on one emulated sensor
+ * and set up through the C API on another. The registers and the shadow
+ * configure leaves must be the same, and read/read_milli must agree with
+ * ltr390_computed_sample over a sweep of inputs. A failed check prints its
+ * location, and the program exits non-zero if any check failed.
+ */
+
+/********************************************************/
+/* header includes */
+#include <cstdio>
+#include <cstring>
+#include "ltr390uv.hpp"
+extern "C" {
+#include "ltr390uv_emu.h"
+}
+
+/* Emulator handles of the C API and C++ sensors */
+#define TEST_C_DEV_ID                           0x20
+#define TEST_HPP_DEV_ID                         0x21
+
+#define TEST_CHECK(cond)                        test_check((cond) ? 1 : 0, #cond, __LINE__)
+
+/* 18-bit ALS with the threshold interrupt armed */
+typedef ltr390::Config<LTR390_VAL_UVS_MODE_ALS, LTR390_VAL_MEAS_RATE_100_MS, LTR390_VAL_RES_18_BIT,
+	LTR390_VAL_GAIN_RANGE_3, true, LTR390_VAL_LS_INT_SEL_ALS, LTR390_VAL_ALS_UVS_TRIG_INT_5_CONS,
+	100, 100000> TestAlsConfig;
+
+/* 13-bit ALS at gain 18, two data bytes */
+typedef ltr390::Config<LTR390_VAL_UVS_MODE_ALS, LTR390_VAL_MEAS_RATE_25_MS, LTR390_VAL_RES_13_BIT,
+	LTR390_VAL_GAIN_RANGE_18> TestAlsFastConfig;
+
+/* UVS with the threshold interrupt armed */
+typedef ltr390::UvsConfig<LTR390_VAL_MEAS_RATE_500_MS, true, LTR390_VAL_ALS_UVS_TRIG_INT_8_CONS,
+	10, 5000> TestUvsConfig;
+
+/* Emulator transport */
+struct TestEmu {
+	static int8_t read(uint8_t dev_id, uint8_t reg_addr, uint8_t *data, uint16_t len)
+	{
+		return ltr390_emu_read(dev_id, reg_addr, data, len);
+	}
+
+	static int8_t write(uint8_t dev_id, uint8_t reg_addr, uint8_t *data, uint16_t len)
+	{
+		return ltr390_emu_write(dev_id, reg_addr, data, len);
+	}
+
+	static void delay_us(uint32_t period_us)
+	{
+		ltr390_emu_delay_us(period_us);
+	}
+};
+
+static uint32_t test_checks;
+static uint32_t test_failures;
+
+static void test_check(int ok, const char *expr, int line);
+
+static uint8_t test_near(double value, double expected, double tolerance);
+
+static uint8_t test_regs_match(const struct ltr390_emu *emu, const struct ltr390_shadow *shadow);
+
+template <class Config>
+static void test_settings(struct ltr390_dev *dev);
+
+template <class Config>
+static void test_config(const double *inputs, uint8_t count);
+
+/********************************************************/
+
+int main(void)
+{
+	static const double lux[] = {0., 1., 37.5, 1000., 20000.};
+	static const double uvi[] = {0., 0.5, 3., 11.};
+
+	test_config<TestAlsConfig>(lux, sizeof(lux) / sizeof(lux[0]));
+	test_config<TestAlsFastConfig>(lux, sizeof(lux) / sizeof(lux[0]));
+	test_config<TestUvsConfig>(uvi, sizeof(uvi) / sizeof(uvi[0]));
+
+	printf("%lu checks, %lu failed\n", (unsigned long)test_checks, (unsigned long)test_failures);
+
+	return (test_failures == 0) ? 0 : 1;
+}
+
+static void test_check(int ok, const char *expr, int line)
+{
+	test_checks++;
+	if (!ok) {
+		test_failures++;
+		printf("ltr390uv_hpp_test.cpp:%d: check failed: %s\n", line, expr);
+	}
+}
+
+static uint8_t test_near(double value, double expected, double tolerance)
+{
+	double diff = value - expected;
+
+	return ((diff <= tolerance) && (diff >= -tolerance)) ? TRUE : FALSE;
+}
+
+static uint8_t test_regs_match(const struct ltr390_emu *emu, const struct ltr390_shadow *shadow)
+{
+	const uint8_t *regs = emu->regs;
+
+	return ((regs[LTR390_REG_MAIN_CTRL] == shadow->main_ctrl) &&
+		(memcmp(&regs[LTR390_REG_ALS_UVS_MEAS_RATE], shadow->meas, 2) == 0) &&
+		(memcmp(&regs[LTR390_REG_INT_CFG], shadow->intr, 2) == 0) &&
+		(memcmp(&regs[LTR390_REG_ALS_UVS_THRES_UP_0], shadow->thres, 6) == 0)) ? TRUE : FALSE;
+}
+
+template <class Config>
+static void test_settings(struct ltr390_dev *dev)
+{
+	memset(dev, 0, sizeof(*dev));
+	dev->dev_id = TEST_C_DEV_ID;
+	dev->read = TestEmu::read;
+	dev->write = TestEmu::write;
+	dev->delay_us = TestEmu::delay_us;
+	dev->settings.mode = Config::mode;
+	dev->settings.rate = Config::rate;
+	dev->settings.resolution = Config::resolution;
+	dev->settings.gain_range = Config::gain_range;
+	dev->settings.int_enabled = Config::int_enabled ? TRUE : FALSE;
+	dev->settings.int_src = Config::int_src;
+	dev->settings.int_pers = Config::int_pers;
+	dev->settings.int_thresh_low = Config::int_thresh_low;
+	dev->settings.int_thresh_up = Config::int_thresh_up;
+	dev->settings.w_fac = Config::w_fac;
+	dev->settings.uv_sensitivity = Config::uv_sensitivity;
+}
+
+template <class Config>
+static void test_config(const double *inputs, uint8_t count)
+{
+	static struct ltr390_emu emu_c;
+	static struct ltr390_emu emu_hpp;
+	struct ltr390_dev dev;
+	struct ltr390_sample sample;
+	ltr390::Sensor<TestEmu, Config> sensor(TEST_HPP_DEV_ID);
+	uint32_t period_us;
+	uint32_t raw;
+	uint32_t milli;
+	double value;
+	double expected;
+	uint8_t uvs = (Config::mode == LTR390_VAL_UVS_MODE_UVS) ? TRUE : FALSE;
+	uint8_t i;
+
+	ltr390_emu_set_time(0);
+	TEST_CHECK(ltr390_emu_attach(&emu_c, TEST_C_DEV_ID) == LTR390_OK);
+	TEST_CHECK(ltr390_emu_attach(&emu_hpp, TEST_HPP_DEV_ID) == LTR390_OK);
+
+	/* Same register image and shadow as the C API */
+	test_settings<Config>(&dev);
+	TEST_CHECK(ltr390_init(&dev) == LTR390_OK);
+	TEST_CHECK(ltr390_configure(&dev) == LTR390_OK);
+	TEST_CHECK(sensor.init() == LTR390_OK);
+	TEST_CHECK(sensor.configure() == LTR390_OK);
+	TEST_CHECK(test_regs_match(&emu_c, &dev.shadow) == TRUE);
+	TEST_CHECK(test_regs_match(&emu_hpp, &dev.shadow) == TRUE);
+	TEST_CHECK(memcmp(&sensor.dev()->shadow, &dev.shadow, sizeof(dev.shadow)) == 0);
+	TEST_CHECK(memcmp(&sensor.dev()->settings, &dev.settings, sizeof(dev.settings)) == 0);
+
+	/* Same values as ltr390_computed_sample, milli within one count */
+	period_us = ltr390_meas_period_us(Config::rate, Config::resolution);
+	for (i = 0; i < count; i++) {
+		ltr390_emu_set_input(&emu_c, uvs ? 0. : inputs[i], uvs ? inputs[i] : 0.);
+		ltr390_emu_set_input(&emu_hpp, uvs ? 0. : inputs[i], uvs ? inputs[i] : 0.);
+		ltr390_emu_advance(2 * period_us);
+
+		TEST_CHECK(ltr390_get_new_data(&sample, &dev) == LTR390_OK);
+		TEST_CHECK(ltr390_computed_sample(&sample, &expected, &dev) == LTR390_OK);
+		TEST_CHECK(sensor.read_raw(raw) == LTR390_OK);
+		TEST_CHECK(raw == sample.raw);
+		TEST_CHECK(sensor.read(value) == LTR390_OK);
+		TEST_CHECK(test_near(value, expected, expected * 1e-12) == TRUE);
+		TEST_CHECK(sensor.read_milli(milli) == LTR390_OK);
+		TEST_CHECK(test_near((double)milli, expected * 1000., 1.) == TRUE);
+	}
+	TEST_CHECK(sample.raw > 0);
+
+	ltr390_emu_detach(&emu_c);
+	ltr390_emu_detach(&emu_hpp);
+}
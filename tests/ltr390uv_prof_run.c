@@ -0,0 +1,113 @@
+/*
+ * This file is part of the LTR-390-UV-01 library (https://github.com/Cplaton/ltr390).
+ * Copyright (c) 2021 Clement Platon.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Profiler runner.
+ *
+ * Prints the bus cost of every profiled API as CSV, then the job
+ * transport comparison and the register decode, batch conversion and
+ * async loop timings. Exits non-zero when an API fails or goes over its
+ * transaction or job budget, when a decode or batch kernel disagrees with
+ * its reference, or when an async read fails.
+ */
+
+/********************************************************/
+/* header includes */
+#include <stdio.h>
+#include "ltr390uv_prof.h"
+
+/********************************************************/
+
+
+int main(void)
+{
+	struct ltr390_prof_result results[LTR390_PROF_CASE_COUNT];
+	struct ltr390_prof_xfer xfer[LTR390_PROF_XFER_COUNT];
+	struct ltr390_prof_decode decode;
+	struct ltr390_prof_convert convert;
+	struct ltr390_prof_async async;
+	uint8_t count = LTR390_PROF_CASE_COUNT;
+	uint8_t xfer_count = LTR390_PROF_XFER_COUNT;
+	uint32_t regressions;
+	uint8_t i;
+
+	if (ltr390_prof_run(results, &count) < LTR390_OK) {
+		printf("profiler run failed\n");
+		return 1;
+	}
+
+	ltr390_prof_write_csv(stdout, results, count);
+
+	regressions = ltr390_prof_regressions(results, count);
+	for (i = 0; i < count; i++) {
+		if ((results[i].rslt < LTR390_OK) || (results[i].transactions > (double)results[i].tx_budget))
+			printf("regression: %s, %.2f transactions for a budget of %lu, rslt %d\n",
+					results[i].name, results[i].transactions,
+					(unsigned long)results[i].tx_budget, results[i].rslt);
+	}
+
+	if (ltr390_prof_xfer(xfer, &xfer_count) < LTR390_OK) {
+		printf("job transport benchmark failed\n");
+		return 1;
+	}
+	printf("\n");
+	for (i = 0; i < xfer_count; i++) {
+		printf("xfer, %s: %.1f ops, %.2f -> %.2f submissions, %.1f -> %.1f ns per call (%+.0f%%)\n",
+				xfer[i].name, xfer[i].ops, xfer[i].callback_subs, xfer[i].xfer_subs,
+				xfer[i].callback_ns, xfer[i].xfer_ns,
+				(xfer[i].callback_ns > 0.) ? 100. * (xfer[i].xfer_ns - xfer[i].callback_ns) / xfer[i].callback_ns : 0.);
+		if ((xfer[i].rslt < LTR390_OK) || (xfer[i].xfer_subs > (double)xfer[i].job_budget)) {
+			printf("regression: %s, %.2f submissions for a budget of %lu, rslt %d\n",
+					xfer[i].name, xfer[i].xfer_subs, (unsigned long)xfer[i].job_budget, xfer[i].rslt);
+			regressions++;
+		}
+	}
+
+	if (ltr390_prof_decode(&decode) < LTR390_OK) {
+		printf("decode benchmark failed\n");
+		return 1;
+	}
+	printf("decode, isa %u: switch %.3f ns, table %.3f ns, bulk %.3f ns per sample\n",
+			decode.isa, decode.switch_ns, decode.table_ns, decode.bulk_ns);
+	if (decode.mismatches != 0)
+		printf("regression: %lu decoded samples differ from the switch\n", (unsigned long)decode.mismatches);
+	regressions += decode.mismatches;
+
+	if (ltr390_prof_convert(&convert) < LTR390_OK) {
+		printf("conversion benchmark failed\n");
+		return 1;
+	}
+	printf("convert, isa %u: scalar %.3f ns, kernel %.3f ns, tagged scalar %.3f ns, tagged kernel %.3f ns per sample\n",
+			convert.isa, convert.scalar_ns, convert.simd_ns, convert.tagged_scalar_ns, convert.tagged_simd_ns);
+	if (convert.mismatches != 0)
+		printf("regression: %lu converted samples differ from the scalar kernel\n", (unsigned long)convert.mismatches);
+	regressions += convert.mismatches;
+
+	if (ltr390_prof_async(&async) < LTR390_OK) {
+		printf("async benchmark failed\n");
+		return 1;
+	}
+	printf("async, %lu sensors: %.1f ns per read (blocking %.1f ns), %.0f sensors per core at %u Hz\n",
+			(unsigned long)async.sensors, async.async_ns, async.blocking_ns,
+			async.sensors_per_core, LTR390_PROF_ASYNC_RATE_HZ);
+	if (async.rslt != LTR390_OK) {
+		printf("regression: async reads failed, rslt %d\n", async.rslt);
+		regressions++;
+	}
+
+	return (regressions == 0) ? 0 : 1;
+}
@@ -0,0 +1,1388 @@
+/*
+ * This file is part of the LTR-390-UV-01 library (https://github.com/Cplaton/ltr390).
+ * Copyright (c) 2021 Clement Platon.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Driver tests against the emulator.
+ *
+ * Each test attaches its own emulated sensor. The Linux transport runs
+ * through a fake i2c-dev adapter that forwards to the emulator. The log,
+ * ring and filter tests need no sensor, the log one round-trips a file in /tmp.
+ * The scheduler test runs its bus threads in real time for about a second.
+ * A failed check prints its location, and the program exits non-zero if
+ * any check failed.
+ */
+
+/********************************************************/
+/* header includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+#include "ltr390uv.h"
+#include "ltr390uv_emu.h"
+#include "ltr390uv_linux.h"
+#include "ltr390uv_async.h"
+#include "ltr390uv_phase.h"
+#include "ltr390uv_event.h"
+#include "ltr390uv_log.h"
+#include "ltr390uv_ring.h"
+#include "ltr390uv_filter.h"
+#include "ltr390uv_sched.h"
+
+/* Handle of the emulated sensor */
+#define TEST_DEV_ID                             0x53
+
+/* Emulator input */
+#define TEST_LUX                                1000.
+#define TEST_UVI                                3.
+
+/* Bus node and descriptor of the fake i2c-dev adapter */
+#define TEST_BUS_PATH                           "/dev/i2c-test"
+#define TEST_BUS_FD                             42
+
+/* Log file template, writer buffer, samples and reader index capacity */
+#define TEST_LOG_PATH                           "/tmp/ltr390_test_log_XXXXXX"
+#define TEST_LOG_BUF_LEN                        256
+#define TEST_LOG_SAMPLES                        300
+#define TEST_LOG_INDEX_CAP                      4
+
+/* Ring capacity */
+#define TEST_RING_CAP                           8
+
+/* Filter input length */
+#define TEST_FILTER_SAMPLES                     200
+
+/* Scheduled sensors, spread over two buses, and real-time run length */
+#define TEST_SCHED_DEV                          4
+#define TEST_SCHED_RUN_US                       1000000
+
+#define TEST_CHECK(cond)                        test_check((cond) ? 1 : 0, #cond, __LINE__)
+
+static uint32_t test_checks;
+
+static uint32_t test_failures;
+
+/* Fake adapter calls */
+static uint32_t test_opens;
+
+static uint32_t test_closes;
+
+static uint32_t test_ioctls;
+
+/* Log file being written */
+static int test_log_fd;
+
+/* Serializes the bus workers on the emulator, whose clock follows real time */
+static pthread_mutex_t test_sched_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t test_sched_base_us;
+
+static void test_check(int ok, const char *expr, int line);
+
+static uint8_t test_near(double value, double expected, double tolerance);
+
+static void test_setup(struct ltr390_emu *emu, struct ltr390_dev *dev, uint8_t mode, uint8_t resolution);
+
+static uint8_t test_regs_match(const struct ltr390_emu *emu, const struct ltr390_dev *dev);
+
+static void test_init_configure(void);
+
+static void test_new_data(void);
+
+static void test_uvs(void);
+
+static void test_frame(void);
+
+static void test_restore(void);
+
+static void test_autorange_run(struct ltr390_autorange *ar, struct ltr390_dev *dev, uint8_t steps);
+
+static void test_autorange(void);
+
+static void test_pair(void);
+
+static int8_t test_async_submit(struct ltr390_async_req *req, void *ctx);
+
+static void test_async_done(struct ltr390_async_dev *adev, uint8_t op, int8_t rslt, void *ctx);
+
+static int8_t test_async_wait(struct ltr390_async_loop *loop, int8_t rslt);
+
+static void test_async(void);
+
+static void test_power_run(struct ltr390_dev *dev, uint8_t duty, uint8_t minutes);
+
+static void test_power(void);
+
+static void test_change_light(uint64_t time_us, double *lux, double *uvi, void *ctx);
+
+static void test_change_pin(uint8_t dev_id, void *ctx);
+
+static void test_change(void);
+
+static void test_phase_run(int32_t clock_ppm);
+
+static void test_phase(void);
+
+static int test_open(const char *path, int flags);
+
+static int test_close(int fd);
+
+static int test_ioctl(int fd, unsigned long request, void *arg);
+
+static void test_linux(void);
+
+static void test_event_cb(struct ltr390_dev *dev, const struct ltr390_frame *frame, void *ctx);
+
+static void test_event(void);
+
+static int8_t test_log_flush(const uint8_t *data, uint32_t len, void *ctx);
+
+static void test_log(void);
+
+static void test_ring_fill(struct ltr390_ring *ring, uint32_t first, uint32_t count, uint32_t *overflowed);
+
+static uint32_t test_ring_drain(struct ltr390_ring *ring, uint32_t first, uint32_t max_count);
+
+static void test_ring(void);
+
+static int test_cmp_u32(const void *a, const void *b);
+
+static uint32_t test_filter_ref(const uint32_t *in, uint32_t index, uint8_t type, uint8_t window);
+
+static void test_filter(void);
+
+static uint64_t test_sched_now_us(void);
+
+static int8_t test_sched_read(uint8_t dev_id, uint8_t reg_addr, uint8_t *data, uint16_t len);
+
+static int8_t test_sched_write(uint8_t dev_id, uint8_t reg_addr, uint8_t *data, uint16_t len);
+
+static void test_sched_cb(struct ltr390_dev *dev, const struct ltr390_sample *sample, void *ctx);
+
+static void test_sched(void);
+
+static const struct ltr390_linux_ops test_linux_ops = {
+	test_open, test_close, test_ioctl
+};
+
+/********************************************************/
+
+
+int main(void)
+{
+	test_init_configure();
+	test_new_data();
+	test_uvs();
+	test_frame();
+	test_restore();
+	test_autorange();
+	test_pair();
+	test_async();
+	test_power();
+	test_change();
+	test_phase();
+	test_linux();
+	test_event();
+	test_log();
+	test_ring();
+	test_filter();
+	test_sched();
+
+	printf("%lu checks, %lu failed\n", (unsigned long)test_checks, (unsigned long)test_failures);
+
+	return (test_failures == 0) ? 0 : 1;
+}
+
+
+static void test_check(int ok, const char *expr, int line)
+{
+	test_checks++;
+	if (!ok) {
+		test_failures++;
+		printf("ltr390uv_test.c:%d: check failed: %s\n", line, expr);
+	}
+}
+
+static uint8_t test_near(double value, double expected, double tolerance)
+{
+	double diff = value - expected;
+
+	return ((diff <= tolerance) && (diff >= -tolerance)) ? TRUE : FALSE;
+}
+
+static void test_setup(struct ltr390_emu *emu, struct ltr390_dev *dev, uint8_t mode, uint8_t resolution)
+{
+	memset(dev, 0, sizeof(*dev));
+	ltr390_emu_set_time(0);
+	(void)ltr390_emu_attach(emu, TEST_DEV_ID);
+	ltr390_emu_set_input(emu, TEST_LUX, TEST_UVI);
+
+	/* Threshold interrupt armed, so every register block differs from defaults */
+	dev->dev_id = TEST_DEV_ID;
+	dev->read = ltr390_emu_read;
+	dev->write = ltr390_emu_write;
+	dev->delay_us = ltr390_emu_delay_us;
+	dev->get_time_us = ltr390_emu_time_us;
+	dev->write_mode = LTR390_SHADOW_WRITE_CHANGED;
+	dev->settings.mode = mode;
+	dev->settings.rate = LTR390_VAL_MEAS_RATE_100_MS;
+	dev->settings.resolution = resolution;
+	dev->settings.gain_range = LTR390_VAL_GAIN_RANGE_3;
+	dev->settings.int_enabled = TRUE;
+	dev->settings.int_src = LTR390_VAL_LS_INT_SEL_ALS;
+	dev->settings.int_pers = LTR390_VAL_ALS_UVS_TRIG_INT_2_CONS;
+	dev->settings.int_thresh_low = 100;
+	dev->settings.int_thresh_up = 100000;
+	dev->settings.w_fac = 1;
+	dev->settings.uv_sensitivity = LTR390_UVS_SENSITIVITY;
+}
+
+static uint8_t test_regs_match(const struct ltr390_emu *emu, const struct ltr390_dev *dev)
+{
+	const uint8_t *regs = emu->regs;
+
+	return ((regs[LTR390_REG_MAIN_CTRL] == dev->shadow.main_ctrl) &&
+		(memcmp(&regs[LTR390_REG_ALS_UVS_MEAS_RATE], dev->shadow.meas, 2) == 0) &&
+		(memcmp(&regs[LTR390_REG_INT_CFG], dev->shadow.intr, 2) == 0) &&
+		(memcmp(&regs[LTR390_REG_ALS_UVS_THRES_UP_0], dev->shadow.thres, 6) == 0)) ? TRUE : FALSE;
+}
+
+static void test_init_configure(void)
+{
+	static struct ltr390_emu emu;
+	struct ltr390_dev dev;
+
+	test_setup(&emu, &dev, LTR390_VAL_UVS_MODE_ALS, LTR390_VAL_RES_18_BIT);
+	TEST_CHECK(ltr390_init(&dev) == LTR390_OK);
+	TEST_CHECK(ltr390_configure(&dev) == LTR390_OK);
+	TEST_CHECK(dev.shadow.valid == TRUE);
+	TEST_CHECK(test_regs_match(&emu, &dev) == TRUE);
+	TEST_CHECK(emu.regs[LTR390_REG_MAIN_CTRL] & LTR390_MASK_ALS_UVS_EN);
+
+	/* Nothing changed, nothing written */
+	ltr390_emu_reset_stats(&emu);
+	TEST_CHECK(ltr390_configure(&dev) == LTR390_OK);
+	TEST_CHECK(emu.stats.write_count == 0);
+
+	/* No sensor answering */
+	dev.dev_id = TEST_DEV_ID + 1;
+	TEST_CHECK(ltr390_init(&dev) < LTR390_OK);
+
+	ltr390_emu_detach(&emu);
+}
+
+static void test_new_data(void)
+{
+	static struct ltr390_emu emu;
+	struct ltr390_dev dev;
+	struct ltr390_sample sample;
+	struct ltr390_fixp fp;
+	double lux;
+	uint8_t res;
+
+	/* Lux comes back at every resolution, 13-bit integrates for 12.5ms */
+	for (res = LTR390_VAL_RES_20_BIT; res <= LTR390_VAL_RES_13_BIT; res++) {
+		test_setup(&emu, &dev, LTR390_VAL_UVS_MODE_ALS, res);
+		TEST_CHECK(ltr390_init(&dev) == LTR390_OK);
+		TEST_CHECK(ltr390_configure(&dev) == LTR390_OK);
+		TEST_CHECK(ltr390_get_new_data(&sample, &dev) == LTR390_W_NO_NEW_DATA);
+
+		ltr390_emu_advance(ltr390_meas_period_us(dev.settings.rate, res));
+		TEST_CHECK(ltr390_get_new_data(&sample, &dev) == LTR390_OK);
+		TEST_CHECK(sample.flags & LTR390_SAMPLE_FRESH);
+		TEST_CHECK(sample.resolution == res);
+		TEST_CHECK(ltr390_computed_sample(&sample, &lux, &dev) == LTR390_OK);
+		TEST_CHECK(test_near(lux, TEST_LUX, TEST_LUX / 200.) == TRUE);
+
+		/* Fixed point agrees with the float conversion */
+		TEST_CHECK(ltr390_fixp_prepare(&fp, &sample, &dev) == LTR390_OK);
+		TEST_CHECK(test_near((double)ltr390_fixp_convert(sample.raw, &fp), lux * LTR390_FIXP_UNIT, 1.) == TRUE);
+
+		/* Read once */
+		TEST_CHECK(ltr390_get_new_data(&sample, &dev) == LTR390_W_NO_NEW_DATA);
+		ltr390_emu_detach(&emu);
+	}
+}
+
+static void test_uvs(void)
+{
+	static struct ltr390_emu emu;
+	struct ltr390_dev dev;
+	struct ltr390_sample sample;
+	double uvi;
+
+	test_setup(&emu, &dev, LTR390_VAL_UVS_MODE_UVS, LTR390_VAL_RES_18_BIT);
+	TEST_CHECK(ltr390_init(&dev) == LTR390_OK);
+	TEST_CHECK(ltr390_configure(&dev) == LTR390_OK);
+	/* UV mode forces 20-bit, gain 18x, 500ms or slower */
+	TEST_CHECK(dev.settings.resolution == LTR390_VAL_RES_20_BIT);
+	TEST_CHECK(dev.settings.gain_range == LTR390_VAL_GAIN_RANGE_18);
+
+	TEST_CHECK(ltr390_wait_new_data(&sample, 1000000, &dev) == LTR390_OK);
+	TEST_CHECK(sample.mode == LTR390_VAL_UVS_MODE_UVS);
+	TEST_CHECK(ltr390_computed_sample(&sample, &uvi, &dev) == LTR390_OK);
+	TEST_CHECK(test_near(uvi, TEST_UVI, TEST_UVI / 200.) == TRUE);
+
+	ltr390_emu_detach(&emu);
+}
+
+static void test_frame(void)
+{
+	static struct ltr390_emu emu;
+	struct ltr390_dev dev;
+	struct ltr390_frame frame;
+
+	test_setup(&emu, &dev, LTR390_VAL_UVS_MODE_ALS, LTR390_VAL_RES_18_BIT);
+	TEST_CHECK(ltr390_init(&dev) == LTR390_OK);
+	TEST_CHECK(ltr390_configure(&dev) == LTR390_OK);
+	ltr390_emu_advance(ltr390_meas_period_us(dev.settings.rate, dev.settings.resolution));
+
+	/* One read for status and both channels */
+	ltr390_emu_reset_stats(&emu);
+	TEST_CHECK(ltr390_get_frame(&frame, &dev) == LTR390_OK);
+	TEST_CHECK(emu.stats.read_count == 1);
+	TEST_CHECK(frame.status & LTR390_MASK_ALS_UVS_DATA_STAT);
+	TEST_CHECK(frame.sample.flags & LTR390_SAMPLE_FRESH);
+	TEST_CHECK(frame.sample.raw == frame.als);
+	TEST_CHECK(frame.als == LTR390_CONCAT_BYTES(emu.regs[LTR390_REG_ALS_DATA_2],
+											emu.regs[LTR390_REG_ALS_DATA_1],
+											emu.regs[LTR390_REG_ALS_DATA_0]));
+
+	/* Status cleared by the read */
+	TEST_CHECK(ltr390_get_frame(&frame, &dev) == LTR390_OK);
+	TEST_CHECK(!(frame.sample.flags & LTR390_SAMPLE_FRESH));
+
+	ltr390_emu_detach(&emu);
+}
+
+static void test_restore(void)
+{
+	static struct ltr390_emu emu;
+	struct ltr390_dev dev;
+	struct ltr390_sample sample;
+	uint8_t status;
+
+	test_setup(&emu, &dev, LTR390_VAL_UVS_MODE_ALS, LTR390_VAL_RES_18_BIT);
+	TEST_CHECK(ltr390_init(&dev) == LTR390_OK);
+	TEST_CHECK(ltr390_configure(&dev) == LTR390_OK);
+
+	/* Brownout seen by a status read, the shadow is replayed */
+	ltr390_emu_power_on(&emu);
+	TEST_CHECK(test_regs_match(&emu, &dev) == FALSE);
+	TEST_CHECK(ltr390_get_status(&status, &dev) == LTR390_OK);
+	TEST_CHECK(status & LTR390_MASK_ALS_UVS_PWR_ON_STAT);
+	TEST_CHECK(test_regs_match(&emu, &dev) == TRUE);
+	TEST_CHECK(dev.por.events == 1);
+	TEST_CHECK(dev.por.restored == 1);
+	TEST_CHECK(dev.por.failed == 0);
+	TEST_CHECK(dev.por.writes > 0);
+
+	/* Measurements go on with the restored configuration */
+	ltr390_emu_advance(ltr390_meas_period_us(dev.settings.rate, dev.settings.resolution));
+	TEST_CHECK(ltr390_get_new_data(&sample, &dev) == LTR390_OK);
+	TEST_CHECK(sample.raw > 0);
+
+	/* Explicit restore, then a failed one invalidates the shadow */
+	ltr390_emu_power_on(&emu);
+	TEST_CHECK(ltr390_restore(&dev) == LTR390_OK);
+	TEST_CHECK(test_regs_match(&emu, &dev) == TRUE);
+	ltr390_emu_power_on(&emu);
+	emu.fail_next = 1;
+	TEST_CHECK(ltr390_restore(&dev) == LTR390_E_COMM_FAIL);
+	TEST_CHECK(dev.shadow.valid == FALSE);
+	TEST_CHECK(ltr390_restore(&dev) == LTR390_E_INVALID_VAL);
+
+	ltr390_emu_detach(&emu);
+}
+
+static void test_autorange_run(struct ltr390_autorange *ar, struct ltr390_dev *dev, uint8_t steps)
+{
+	struct ltr390_sample sample;
+
+	while (steps--) {
+		ltr390_emu_advance(ltr390_meas_period_us(dev->settings.rate, dev->settings.resolution));
+		TEST_CHECK(ltr390_get_new_data(&sample, dev) == LTR390_OK);
+		TEST_CHECK(ltr390_autorange_update(ar, &sample, dev) == LTR390_OK);
+	}
+}
+
+static void test_autorange(void)
+{
+	static struct ltr390_emu emu;
+	struct ltr390_dev dev;
+	struct ltr390_autorange ar;
+
+	test_setup(&emu, &dev, LTR390_VAL_UVS_MODE_ALS, LTR390_VAL_RES_18_BIT);
+	TEST_CHECK(ltr390_init(&dev) == LTR390_OK);
+	TEST_CHECK(ltr390_configure(&dev) == LTR390_OK);
+
+	memset(&ar, 0xA5, sizeof(ar));
+	ltr390_autorange_init(NULL, &dev);
+	ltr390_autorange_init(&ar, NULL);
+	TEST_CHECK(ar.switches == 0xA5A5A5A5);
+	ltr390_autorange_init(&ar, &dev);
+	TEST_CHECK(ar.res_base == LTR390_VAL_RES_18_BIT);
+	TEST_CHECK(ar.res_min == LTR390_VAL_RES_16_BIT);
+
+	/* Saturated: gain to the floor, then the resolution steps down to res_min */
+	ltr390_emu_set_input(&emu, 1000000., 0.);
+	test_autorange_run(&ar, &dev, 6);
+	TEST_CHECK(dev.settings.gain_range == LTR390_VAL_GAIN_RANGE_1);
+	TEST_CHECK(dev.settings.resolution == LTR390_VAL_RES_16_BIT);
+	TEST_CHECK(ar.saturated > 0);
+	TEST_CHECK(test_regs_match(&emu, &dev) == TRUE);
+
+	/* Dark: base resolution first, then the gain, then 20-bit */
+	ltr390_emu_set_input(&emu, 0.5, 0.);
+	test_autorange_run(&ar, &dev, 2);
+	TEST_CHECK(dev.settings.resolution == LTR390_VAL_RES_18_BIT);
+	TEST_CHECK(dev.settings.gain_range == LTR390_VAL_GAIN_RANGE_1);
+	test_autorange_run(&ar, &dev, 6);
+	TEST_CHECK(dev.settings.gain_range == LTR390_VAL_GAIN_RANGE_18);
+	TEST_CHECK(dev.settings.resolution == LTR390_VAL_RES_20_BIT);
+
+	ltr390_emu_detach(&emu);
+}
+
+static void test_pair(void)
+{
+	static struct ltr390_emu emu;
+	struct ltr390_dev dev;
+	struct ltr390_pair pair;
+	double value;
+	uint64_t start_us;
+
+	test_setup(&emu, &dev, LTR390_VAL_UVS_MODE_ALS, LTR390_VAL_RES_18_BIT);
+	TEST_CHECK(ltr390_init(&dev) == LTR390_OK);
+	TEST_CHECK(ltr390_configure(&dev) == LTR390_OK);
+
+	/* Seeded by init: ALS as configured, UVS at 18x/20-bit */
+	TEST_CHECK(dev.dual[LTR390_VAL_UVS_MODE_ALS].gain_range == LTR390_VAL_GAIN_RANGE_3);
+	TEST_CHECK(dev.dual[LTR390_VAL_UVS_MODE_ALS].resolution == LTR390_VAL_RES_18_BIT);
+	TEST_CHECK(dev.dual[LTR390_VAL_UVS_MODE_UVS].gain_range == LTR390_VAL_GAIN_RANGE_18);
+	TEST_CHECK(dev.dual[LTR390_VAL_UVS_MODE_UVS].resolution == LTR390_VAL_RES_20_BIT);
+
+	/* ALS result waiting, only UVS is acquired, then back to ALS */
+	ltr390_emu_advance(ltr390_meas_period_us(dev.settings.rate, dev.settings.resolution));
+	start_us = ltr390_emu_time_us();
+	TEST_CHECK(ltr390_get_pair(&pair, &dev) == LTR390_OK);
+	TEST_CHECK(ltr390_emu_time_us() - start_us == 400000);
+	TEST_CHECK(ltr390_computed_sample(&pair.als, &value, &dev) == LTR390_OK);
+	TEST_CHECK(test_near(value, TEST_LUX, TEST_LUX / 200.) == TRUE);
+	TEST_CHECK(ltr390_computed_sample(&pair.uvs, &value, &dev) == LTR390_OK);
+	TEST_CHECK(test_near(value, TEST_UVI, TEST_UVI / 200.) == TRUE);
+	TEST_CHECK(dev.settings.mode == LTR390_VAL_UVS_MODE_ALS);
+	TEST_CHECK(dev.settings.gain_range == LTR390_VAL_GAIN_RANGE_3);
+	TEST_CHECK(dev.settings.resolution == LTR390_VAL_RES_18_BIT);
+	TEST_CHECK(test_regs_match(&emu, &dev) == TRUE);
+
+	/* Nothing waiting: UVS then ALS, settings untouched without a write */
+	TEST_CHECK(ltr390_get_pair(&pair, &dev) == LTR390_OK);
+	TEST_CHECK(dev.settings.mode == LTR390_VAL_UVS_MODE_ALS);
+	TEST_CHECK(dev.settings.resolution == LTR390_VAL_RES_18_BIT);
+
+	/* A 2% slow sensor clock costs one retry */
+	emu.clock_ppm = 20000;
+	TEST_CHECK(ltr390_get_pair(&pair, &dev) == LTR390_OK);
+
+	/* Far slower, a switch gives up a quarter conversion late */
+	emu.clock_ppm = 500000;
+	start_us = ltr390_emu_time_us();
+	TEST_CHECK(ltr390_get_pair(&pair, &dev) == LTR390_E_TIMEOUT);
+	TEST_CHECK(ltr390_emu_time_us() - start_us <= 500000);
+
+	ltr390_emu_detach(&emu);
+}
+
+static int8_t test_async_submit(struct ltr390_async_req *req, void *ctx)
+{
+	int8_t rslt;
+
+	/* Emulated bus, completed at once and processed by the next run */
+	if (req->dir == LTR390_ASYNC_READ)
+		rslt = ltr390_emu_read(req->dev_id, req->reg_addr, req->data, req->len);
+	else
+		rslt = ltr390_emu_write(req->dev_id, req->reg_addr, req->data, req->len);
+	ltr390_async_complete((struct ltr390_async_loop *)ctx, req, rslt);
+
+	return LTR390_OK;
+}
+
+static void test_async_done(struct ltr390_async_dev *adev, uint8_t op, int8_t rslt, void *ctx)
+{
+	(void)adev;
+	(void)op;
+	*(int8_t *)ctx = rslt;
+}
+
+static int8_t test_async_wait(struct ltr390_async_loop *loop, int8_t rslt)
+{
+	while ((rslt == LTR390_W_PENDING) && (ltr390_async_run(loop) != 0))
+		;
+
+	return rslt;
+}
+
+static void test_async(void)
+{
+	static struct ltr390_emu emu;
+	struct ltr390_dev dev;
+	struct ltr390_async_loop loop;
+	struct ltr390_async_dev adev;
+	struct ltr390_sample sample;
+	struct ltr390_pair pair;
+	double value;
+	int8_t done = LTR390_W_PENDING;
+
+	test_setup(&emu, &dev, LTR390_VAL_UVS_MODE_ALS, LTR390_VAL_RES_18_BIT);
+	ltr390_async_loop_init(&loop, test_async_submit, &loop);
+	TEST_CHECK(ltr390_async_attach(&adev, &dev, &loop, test_async_done, &done) == LTR390_OK);
+
+	TEST_CHECK(test_async_wait(&loop, ltr390_async_init(&adev)) == LTR390_W_PENDING);
+	TEST_CHECK(done == LTR390_OK);
+	/* Alternating mode seeded as by ltr390_init */
+	TEST_CHECK(dev.dual[LTR390_VAL_UVS_MODE_ALS].gain_range == LTR390_VAL_GAIN_RANGE_3);
+	TEST_CHECK(dev.dual[LTR390_VAL_UVS_MODE_ALS].resolution == LTR390_VAL_RES_18_BIT);
+	TEST_CHECK(dev.dual[LTR390_VAL_UVS_MODE_UVS].gain_range == LTR390_VAL_GAIN_RANGE_18);
+	TEST_CHECK(dev.dual[LTR390_VAL_UVS_MODE_UVS].resolution == LTR390_VAL_RES_20_BIT);
+
+	/* The second in standby before the enabling write is accounted as standby */
+	ltr390_power_init(&dev);
+	ltr390_emu_advance(1000000);
+	done = LTR390_W_PENDING;
+	TEST_CHECK(test_async_wait(&loop, ltr390_async_configure(&adev)) == LTR390_W_PENDING);
+	TEST_CHECK(done == LTR390_OK);
+	TEST_CHECK(dev.power.standby_us == 1000000);
+	TEST_CHECK(dev.power.active_us == 0);
+	TEST_CHECK(dev.shadow.valid == TRUE);
+	TEST_CHECK(test_regs_match(&emu, &dev) == TRUE);
+
+	/* Nothing to write, completes without a request */
+	TEST_CHECK(ltr390_async_configure(&adev) == LTR390_OK);
+
+	/* Brownout seen by a read, every changed block replayed */
+	ltr390_emu_advance(ltr390_meas_period_us(dev.settings.rate, dev.settings.resolution));
+	ltr390_emu_power_on(&emu);
+	done = LTR390_W_PENDING;
+	TEST_CHECK(test_async_wait(&loop, ltr390_async_read(&adev, &sample)) == LTR390_W_PENDING);
+	TEST_CHECK(done == LTR390_W_NO_NEW_DATA);
+	TEST_CHECK(sample.flags & LTR390_SAMPLE_PWR_ON);
+	TEST_CHECK(test_regs_match(&emu, &dev) == TRUE);
+
+	/* Both channels at their own setup after an async init */
+	TEST_CHECK(ltr390_get_pair(&pair, &dev) == LTR390_OK);
+	TEST_CHECK(pair.als.gain_range == LTR390_VAL_GAIN_RANGE_3);
+	TEST_CHECK(pair.uvs.gain_range == LTR390_VAL_GAIN_RANGE_18);
+	TEST_CHECK(ltr390_computed_sample(&pair.als, &value, &dev) == LTR390_OK);
+	TEST_CHECK(test_near(value, TEST_LUX, TEST_LUX / 200.) == TRUE);
+	TEST_CHECK(ltr390_computed_sample(&pair.uvs, &value, &dev) == LTR390_OK);
+	TEST_CHECK(test_near(value, TEST_UVI, TEST_UVI / 200.) == TRUE);
+
+	ltr390_emu_detach(&emu);
+}
+
+static void test_power_run(struct ltr390_dev *dev, uint8_t duty, uint8_t minutes)
+{
+	struct ltr390_sample sample;
+	uint64_t start;
+
+	/* One reading per minute, either duty-cycled or from a free-running sensor */
+	while (minutes--) {
+		start = ltr390_emu_now();
+		if (duty)
+			TEST_CHECK(ltr390_power_sample(&sample, dev) == LTR390_OK);
+		else
+			TEST_CHECK(ltr390_wait_new_data(&sample, 1000000, dev) == LTR390_OK);
+		TEST_CHECK(sample.flags & LTR390_SAMPLE_FRESH);
+		ltr390_emu_advance(60000000 - (ltr390_emu_now() - start));
+	}
+}
+
+static void test_power(void)
+{
+	static struct ltr390_emu emu;
+	struct ltr390_dev dev;
+
+	/* Always on: the active current, one conversion every 100ms */
+	test_setup(&emu, &dev, LTR390_VAL_UVS_MODE_ALS, LTR390_VAL_RES_18_BIT);
+	TEST_CHECK(ltr390_init(&dev) == LTR390_OK);
+	TEST_CHECK(ltr390_configure(&dev) == LTR390_OK);
+	ltr390_power_init(&dev);
+	test_power_run(&dev, FALSE, 10);
+	TEST_CHECK(ltr390_power_avg_na(&dev) == LTR390_POWER_ACTIVE_UA * 1000);
+	ltr390_emu_detach(&emu);
+
+	/* Duty-cycled: about 1.2uA, one conversion and one wake-up per reading */
+	test_setup(&emu, &dev, LTR390_VAL_UVS_MODE_ALS, LTR390_VAL_RES_18_BIT);
+	TEST_CHECK(ltr390_init(&dev) == LTR390_OK);
+	TEST_CHECK(ltr390_configure(&dev) == LTR390_OK);
+	ltr390_power_init(&dev);
+	TEST_CHECK(ltr390_set_enable(FALSE, &dev) == LTR390_OK);
+	ltr390_emu_reset_stats(&emu);
+	test_power_run(&dev, TRUE, 10);
+	TEST_CHECK(dev.power.wakeups == 10);
+	TEST_CHECK(emu.stats.conv_count == 10);
+	TEST_CHECK(test_near(ltr390_power_avg_na(&dev), 1200., 100.) == TRUE);
+	TEST_CHECK(!(emu.regs[LTR390_REG_MAIN_CTRL] & LTR390_MASK_ALS_UVS_EN));
+
+	ltr390_emu_detach(&emu);
+}
+
+static void test_change_light(uint64_t time_us, double *lux, double *uvi, void *ctx)
+{
+	uint64_t minute = time_us / 60000000;
+
+	(void)ctx;
+	/* Indoor light with slow drift and flicker, a lamp on for two minutes, one flash */
+	*uvi = 1.;
+	*lux = 300. + (double)(minute % 7) * 0.3 + (double)((time_us / 1000000) % 2) * 0.5;
+	if ((minute >= 30) && (minute < 32))
+		*lux = 900.;
+	if (time_us / 1000000 == 2000)
+		*lux = 3000.;
+}
+
+static void test_change_pin(uint8_t dev_id, void *ctx)
+{
+	(void)dev_id;
+	*(uint8_t *)ctx = TRUE;
+}
+
+static void test_change(void)
+{
+	static struct ltr390_emu emu;
+	struct ltr390_dev dev;
+	struct ltr390_change chg;
+	struct ltr390_sample sample;
+	struct ltr390_frame frame;
+	uint32_t wakeups = 0;
+	uint32_t i;
+	uint8_t pin = FALSE;
+
+	test_setup(&emu, &dev, LTR390_VAL_UVS_MODE_ALS, LTR390_VAL_RES_18_BIT);
+	ltr390_emu_set_input_fn(&emu, test_change_light, NULL);
+	ltr390_emu_set_int_fn(&emu, test_change_pin, &pin);
+	TEST_CHECK(ltr390_init(&dev) == LTR390_OK);
+	TEST_CHECK(ltr390_configure(&dev) == LTR390_OK);
+	TEST_CHECK(ltr390_change_init(&chg, 5, 32, LTR390_VAL_ALS_UVS_TRIG_INT_3_CONS, &dev) == LTR390_OK);
+	TEST_CHECK(ltr390_wait_new_data(&sample, 1000000, &dev) == LTR390_OK);
+	TEST_CHECK(ltr390_change_update(&chg, &sample, &dev) == LTR390_OK);
+	TEST_CHECK(test_regs_match(&emu, &dev) == TRUE);
+
+	/* One hour at 100ms: the host only wakes up for the lamp and the flash */
+	pin = FALSE;
+	ltr390_emu_reset_stats(&emu);
+	for (i = 0; i < 36000; i++) {
+		ltr390_emu_advance(100000);
+		if (!pin)
+			continue;
+		pin = FALSE;
+		wakeups++;
+		TEST_CHECK(ltr390_get_frame(&frame, &dev) == LTR390_OK);
+		TEST_CHECK(ltr390_change_update(&chg, &frame.sample, &dev) == LTR390_OK);
+	}
+	TEST_CHECK(emu.stats.conv_count == 36000);
+	TEST_CHECK(wakeups == 4);
+	TEST_CHECK(emu.stats.read_count + emu.stats.write_count == 8);
+	TEST_CHECK(test_regs_match(&emu, &dev) == TRUE);
+
+	ltr390_emu_detach(&emu);
+}
+
+static void test_phase_run(int32_t clock_ppm)
+{
+	static struct ltr390_emu emu;
+	struct ltr390_dev dev;
+	struct ltr390_phase phase;
+	struct ltr390_phase_sample out;
+	double period;
+	double offset;
+	double err_max = 0.;
+	uint64_t enabled;
+	uint16_t failed = 0;
+	uint16_t i;
+
+	test_setup(&emu, &dev, LTR390_VAL_UVS_MODE_ALS, LTR390_VAL_RES_18_BIT);
+	emu.clock_ppm = clock_ppm;
+	period = 100000. * (1. + (double)clock_ppm / 1e6);
+	TEST_CHECK(ltr390_init(&dev) == LTR390_OK);
+	TEST_CHECK(ltr390_configure(&dev) == LTR390_OK);
+	enabled = ltr390_emu_now();
+	ltr390_emu_advance(37000);
+	TEST_CHECK(ltr390_phase_init(&phase, 0, &dev) == LTR390_OK);
+
+	/* One minute of reads, the host stalls for 250ms halfway */
+	for (i = 0; i < 600; i++) {
+		if (ltr390_phase_read(&phase, &out, &dev) != LTR390_OK)
+			failed++;
+		if (i == 300)
+			ltr390_emu_advance(250000);
+		/* Edges fall on whole periods of the sensor clock since the enable */
+		offset = (double)out.end_us - (double)enabled;
+		offset -= period * (double)(uint32_t)(offset / period + 0.5);
+		if (offset < 0.)
+			offset = -offset;
+		if ((i >= 8) && (offset > err_max))
+			err_max = offset;
+	}
+
+	TEST_CHECK(failed == 0);
+	TEST_CHECK(test_near((double)phase.period_us, period, period / 500.) == TRUE);
+	TEST_CHECK(err_max <= (double)(phase.guard_us / 4));
+	TEST_CHECK(phase.stats.samples == 600);
+	TEST_CHECK(phase.stats.missed == 1);
+	TEST_CHECK(phase.stats.locks == 1);
+	TEST_CHECK(out.end_us - out.start_us == 100000);
+
+	ltr390_emu_detach(&emu);
+}
+
+static void test_phase(void)
+{
+	/* Sensor clock 2% slow, then 3% fast */
+	test_phase_run(20000);
+	test_phase_run(-30000);
+}
+
+static int test_open(const char *path, int flags)
+{
+	(void)flags;
+	if (strcmp(path, TEST_BUS_PATH) != 0)
+		return -1;
+
+	test_opens++;
+
+	return TEST_BUS_FD;
+}
+
+static int test_close(int fd)
+{
+	if (fd != TEST_BUS_FD)
+		return -1;
+
+	test_closes++;
+
+	return 0;
+}
+
+static int test_ioctl(int fd, unsigned long request, void *arg)
+{
+	struct i2c_rdwr_ioctl_data *xfer = (struct i2c_rdwr_ioctl_data *)arg;
+	struct i2c_msg *msg;
+	uint32_t i;
+	int8_t rslt;
+
+	if ((fd != TEST_BUS_FD) || (request != I2C_RDWR) || (xfer == NULL))
+		return -1;
+
+	test_ioctls++;
+
+	/*
+	 * Each write message starts with the register address. A write
+	 * followed by a read is a register read, joined by a repeated start.
+	 */
+	for (i = 0; i < xfer->nmsgs; i++) {
+		msg = &xfer->msgs[i];
+		if ((msg->flags & I2C_M_RD) || (msg->len == 0))
+			return -1;
+
+		if ((i + 1 < xfer->nmsgs) && (xfer->msgs[i + 1].flags & I2C_M_RD)) {
+			rslt = ltr390_emu_read((uint8_t)((msg->addr << 1) | 0x01), msg->buf[0],
+							xfer->msgs[i + 1].buf, xfer->msgs[i + 1].len);
+			i++;
+		} else {
+			rslt = ltr390_emu_write((uint8_t)(msg->addr << 1), msg->buf[0],
+							&msg->buf[1], (uint16_t)(msg->len - 1));
+		}
+		if (rslt != LTR390_OK)
+			return -1;
+	}
+
+	return 0;
+}
+
+static void test_linux(void)
+{
+	static struct ltr390_emu emu;
+	struct ltr390_dev dev;
+	struct ltr390_sample sample;
+	uint32_t ioctls;
+
+	ltr390_linux_set_ops(&test_linux_ops);
+
+	/* Handles 1 and 2 share the bus, the sensor answers at TEST_DEV_ID */
+	TEST_CHECK(ltr390_linux_open(1, "/dev/i2c-none", TEST_DEV_ID) == LTR390_E_DEV_NOT_FOUND);
+	TEST_CHECK(ltr390_linux_open(1, TEST_BUS_PATH, TEST_DEV_ID) == LTR390_OK);
+	TEST_CHECK(ltr390_linux_open(2, TEST_BUS_PATH, TEST_DEV_ID + 1) == LTR390_OK);
+	TEST_CHECK(test_opens == 1);
+
+	test_setup(&emu, &dev, LTR390_VAL_UVS_MODE_ALS, LTR390_VAL_RES_18_BIT);
+	dev.dev_id = 1;
+	dev.read = ltr390_linux_read;
+	dev.write = ltr390_linux_write;
+	TEST_CHECK(ltr390_init(&dev) == LTR390_OK);
+	TEST_CHECK(ltr390_configure(&dev) == LTR390_OK);
+	TEST_CHECK(test_regs_match(&emu, &dev) == TRUE);
+	ltr390_emu_advance(ltr390_meas_period_us(dev.settings.rate, dev.settings.resolution));
+	TEST_CHECK(ltr390_get_new_data(&sample, &dev) == LTR390_OK);
+	TEST_CHECK(sample.raw > 0);
+
+	/* Nothing answers at the second address */
+	dev.dev_id = 2;
+	TEST_CHECK(ltr390_init(&dev) < LTR390_OK);
+
+	/* Job transport: a whole restore in one ioctl */
+	dev.dev_id = 1;
+	dev.xfer = ltr390_linux_xfer;
+	ltr390_emu_power_on(&emu);
+	ioctls = test_ioctls;
+	TEST_CHECK(ltr390_restore(&dev) == LTR390_OK);
+	TEST_CHECK(test_ioctls == ioctls + 1);
+	TEST_CHECK(test_regs_match(&emu, &dev) == TRUE);
+	ltr390_emu_advance(ltr390_meas_period_us(dev.settings.rate, dev.settings.resolution));
+	TEST_CHECK(ltr390_get_new_data(&sample, &dev) == LTR390_OK);
+	TEST_CHECK(sample.flags & LTR390_SAMPLE_FRESH);
+
+	/* Unbound handle */
+	ltr390_linux_close(1);
+	TEST_CHECK(test_closes == 0);
+	TEST_CHECK(ltr390_restore(&dev) == LTR390_E_COMM_FAIL);
+
+	/* Last sensor closes the bus */
+	ltr390_linux_close(2);
+	TEST_CHECK(test_closes == 1);
+
+	ltr390_linux_set_ops(NULL);
+	ltr390_emu_detach(&emu);
+}
+
+static void test_event_cb(struct ltr390_dev *dev, const struct ltr390_frame *frame, void *ctx)
+{
+	(void)dev;
+	*(struct ltr390_frame *)ctx = *frame;
+}
+
+static void test_event(void)
+{
+	static struct ltr390_emu emu;
+	struct ltr390_dev dev;
+	struct ltr390_event_loop loop;
+	struct ltr390_event_stats stats;
+	struct ltr390_int_src src;
+	struct ltr390_frame frame;
+	uint8_t handled;
+
+	/* Upper threshold under the light level, the interrupt fires */
+	test_setup(&emu, &dev, LTR390_VAL_UVS_MODE_ALS, LTR390_VAL_RES_18_BIT);
+	dev.settings.int_thresh_up = 1000;
+	TEST_CHECK(ltr390_init(&dev) == LTR390_OK);
+	TEST_CHECK(ltr390_event_init(&loop, test_event_cb, &frame) == LTR390_OK);
+	TEST_CHECK(ltr390_event_eventfd_open(&src) == LTR390_OK);
+	TEST_CHECK(ltr390_event_add(&loop, &dev, &src) == LTR390_OK);
+	ltr390_emu_set_int_fn(&emu, ltr390_event_raise, &src);
+
+	/* Nothing pending: a timeout, and no bus access */
+	ltr390_emu_reset_stats(&emu);
+	TEST_CHECK(ltr390_event_run_once(&loop, 0, &handled) == LTR390_E_TIMEOUT);
+	TEST_CHECK(handled == 0);
+	TEST_CHECK(emu.stats.read_count + emu.stats.write_count == 0);
+
+	/* Persistence of 2: the second conversion over the threshold raises INT */
+	TEST_CHECK(ltr390_configure(&dev) == LTR390_OK);
+	ltr390_emu_advance(2 * ltr390_meas_period_us(dev.settings.rate, dev.settings.resolution));
+	memset(&frame, 0, sizeof(frame));
+	ltr390_emu_reset_stats(&emu);
+	TEST_CHECK(ltr390_event_run_once(&loop, 0, &handled) == LTR390_OK);
+	TEST_CHECK(handled == 1);
+	TEST_CHECK(emu.stats.read_count == 1);
+	TEST_CHECK(frame.status & LTR390_MASK_ALS_UVS_INT_STAT);
+	TEST_CHECK(frame.sample.flags & LTR390_SAMPLE_FRESH);
+	TEST_CHECK(frame.sample.raw > dev.settings.int_thresh_up);
+
+	/* Line raised with no interrupt pending */
+	ltr390_event_raise(TEST_DEV_ID, &src);
+	TEST_CHECK(ltr390_event_run_once(&loop, 0, &handled) == LTR390_OK);
+	TEST_CHECK(handled == 1);
+
+	TEST_CHECK(ltr390_event_get_stats(&loop, &dev, &stats) == LTR390_OK);
+	TEST_CHECK(stats.events == 2);
+	TEST_CHECK(stats.interrupts == 1);
+	TEST_CHECK(stats.spurious == 1);
+	TEST_CHECK(stats.errors == 0);
+
+	/* Acknowledged, idle again */
+	ltr390_emu_reset_stats(&emu);
+	TEST_CHECK(ltr390_event_run_once(&loop, 0, &handled) == LTR390_E_TIMEOUT);
+	TEST_CHECK(emu.stats.read_count + emu.stats.write_count == 0);
+
+	ltr390_emu_set_int_fn(&emu, NULL, NULL);
+	ltr390_event_deinit(&loop);
+	close(src.fd);
+	ltr390_emu_detach(&emu);
+}
+
+static int8_t test_log_flush(const uint8_t *data, uint32_t len, void *ctx)
+{
+	(void)ctx;
+
+	return (write(test_log_fd, data, len) == (ssize_t)len) ? LTR390_OK : LTR390_E_COMM_FAIL;
+}
+
+static void test_log(void)
+{
+	static uint8_t buf[TEST_LOG_BUF_LEN];
+	static struct ltr390_sample ref[TEST_LOG_SAMPLES];
+	static uint64_t ref_us[TEST_LOG_SAMPLES];
+	struct ltr390_log_index_ent index[TEST_LOG_INDEX_CAP];
+	struct ltr390_log_writer writer;
+	struct ltr390_log_reader reader;
+	struct ltr390_log_chunk chunk;
+	struct ltr390_log_cursor cursor;
+	struct ltr390_sample sample;
+	char path[] = TEST_LOG_PATH;
+	uint64_t time_us = 1000000;
+	uint32_t mismatches = 0;
+	uint32_t failed = 0;
+	uint32_t records = 0;
+	uint32_t chunks = 0;
+	uint32_t starts = 0;
+	uint32_t seed = 0x1234567;
+	size_t pos = 0;
+	size_t valid_len;
+	uint16_t i;
+
+	test_log_fd = mkstemp(path);
+	TEST_CHECK(test_log_fd >= 0);
+	if (test_log_fd < 0)
+		return;
+
+	/*
+	 * Jittered 100ms steps and random counts. The gain changes at 100, a
+	 * gap of an hour at 200, and the small buffer fills several times.
+	 */
+	TEST_CHECK(ltr390_log_writer_init(&writer, buf, sizeof(buf), test_log_flush, NULL) == LTR390_OK);
+	for (i = 0; i < TEST_LOG_SAMPLES; i++) {
+		seed = seed * 1664525 + 1013904223;
+		ref[i].raw = (seed >> 8) & ((i % 50 == 0) ? 0xFFFFF : 0x3FF);
+		ref[i].mode = LTR390_VAL_UVS_MODE_ALS;
+		ref[i].gain_range = (i < 100) ? LTR390_VAL_GAIN_RANGE_3 : LTR390_VAL_GAIN_RANGE_9;
+		ref[i].resolution = LTR390_VAL_RES_18_BIT;
+		ref[i].flags = (uint8_t)((seed >> 28) | LTR390_SAMPLE_FRESH);
+		time_us += 100000 + (seed & 0xFF) + ((i == 200) ? UINT64_C(3600000000) : 0);
+		ref_us[i] = time_us;
+		if (ltr390_log_append(&writer, &ref[i], time_us) != LTR390_OK)
+			failed++;
+	}
+	TEST_CHECK(failed == 0);
+	TEST_CHECK(ltr390_log_flush(&writer) == LTR390_OK);
+	TEST_CHECK(writer.chunks > 4);
+	valid_len = (size_t)lseek(test_log_fd, 0, SEEK_CUR);
+
+	/* A chunk cut short at the tail, as while still being written */
+	TEST_CHECK(write(test_log_fd, buf, LTR390_LOG_CHUNK_HDR_LEN + 4) == LTR390_LOG_CHUNK_HDR_LEN + 4);
+	close(test_log_fd);
+
+	/* Small index: every other entry dropped as the chunks come in */
+	TEST_CHECK(ltr390_log_open(&reader, path, index, TEST_LOG_INDEX_CAP) == LTR390_OK);
+	TEST_CHECK(reader.end == valid_len);
+	TEST_CHECK(reader.chunks == writer.chunks);
+	TEST_CHECK(reader.index_count <= TEST_LOG_INDEX_CAP);
+	TEST_CHECK(reader.index_stride > 1);
+	TEST_CHECK(reader.index[0].offset == LTR390_LOG_FILE_HDR_LEN);
+
+	/* Every record back, in order, one setup per chunk */
+	while (ltr390_log_next_chunk(&reader, &pos, &chunk) == LTR390_OK) {
+		chunks++;
+		if (ltr390_log_verify_chunk(&chunk) != LTR390_OK)
+			failed++;
+		/* The gain change and the gap both start a chunk */
+		if ((chunk.time_base_us == ref_us[100]) || (chunk.time_base_us == ref_us[200]))
+			starts++;
+		ltr390_log_cursor_init(&cursor, &chunk);
+		while ((records < TEST_LOG_SAMPLES) && (ltr390_log_cursor_next(&cursor, &sample, &time_us) == LTR390_OK)) {
+			if ((sample.raw != ref[records].raw) || (sample.flags != (ref[records].flags & 0x0F)) ||
+				(sample.gain_range != ref[records].gain_range) || (sample.mode != ref[records].mode) ||
+				(sample.resolution != ref[records].resolution) || (time_us != ref_us[records]))
+				mismatches++;
+			records++;
+		}
+		if (cursor.index != chunk.count)
+			failed++;
+	}
+	TEST_CHECK(failed == 0);
+	TEST_CHECK(starts == 2);
+	TEST_CHECK(chunks == writer.chunks);
+	TEST_CHECK(records == TEST_LOG_SAMPLES);
+	TEST_CHECK(mismatches == 0);
+
+	/* Seeking: the chunk holding a record, and the first one for an early time */
+	TEST_CHECK(ltr390_log_seek(&reader, ref_us[250], &pos) == LTR390_OK);
+	TEST_CHECK(ltr390_log_next_chunk(&reader, &pos, &chunk) == LTR390_OK);
+	TEST_CHECK((chunk.time_base_us <= ref_us[250]) && (chunk.time_base_us + chunk.span_us >= ref_us[250]));
+	TEST_CHECK(ltr390_log_seek(&reader, 0, &pos) == LTR390_OK);
+	TEST_CHECK(pos == LTR390_LOG_FILE_HDR_LEN);
+
+	/* Corrupted payload byte, then a truncated chunk */
+	pos = 0;
+	TEST_CHECK(ltr390_log_next_chunk(&reader, &pos, &chunk) == LTR390_OK);
+	memcpy(buf, &reader.data[chunk.offset], pos - chunk.offset);
+	buf[LTR390_LOG_CHUNK_HDR_LEN + 1] ^= 0x10;
+	TEST_CHECK(ltr390_log_parse_chunk(&chunk, buf, pos - LTR390_LOG_FILE_HDR_LEN) == LTR390_OK);
+	TEST_CHECK(ltr390_log_verify_chunk(&chunk) == LTR390_E_INVALID_VAL);
+	TEST_CHECK(ltr390_log_parse_chunk(&chunk, buf, pos - LTR390_LOG_FILE_HDR_LEN - 1) == LTR390_E_INVALID_LEN);
+
+	ltr390_log_close(&reader);
+	unlink(path);
+}
+
+static void test_ring_fill(struct ltr390_ring *ring, uint32_t first, uint32_t count, uint32_t *overflowed)
+{
+	struct ltr390_sample sample;
+	uint32_t i;
+
+	/* Record n holds raw n and timestamp 1000 * n */
+	memset(&sample, 0, sizeof(sample));
+	for (i = first; i < first + count; i++) {
+		sample.raw = i;
+		if (ltr390_ring_push(ring, &sample, 1000 * i) == LTR390_W_OVERFLOW)
+			(*overflowed)++;
+	}
+}
+
+static uint32_t test_ring_drain(struct ltr390_ring *ring, uint32_t first, uint32_t max_count)
+{
+	struct ltr390_ring_rec recs[TEST_RING_CAP];
+	uint32_t count;
+	uint32_t i;
+
+	/* Number of records popped, or UINT32_MAX if one is out of sequence */
+	count = ltr390_ring_pop(ring, recs, max_count);
+	for (i = 0; i < count; i++) {
+		if ((LTR390_RING_REC_RAW(&recs[i]) != first + i) || (recs[i].time_us != 1000 * (first + i)))
+			return UINT32_MAX;
+	}
+
+	return count;
+}
+
+static void test_ring(void)
+{
+	static struct ltr390_ring_rec storage[TEST_RING_CAP];
+	struct ltr390_ring ring;
+	struct ltr390_ring_rec rec;
+	struct ltr390_sample in;
+	struct ltr390_sample out;
+	uint32_t overflowed = 0;
+	uint32_t mismatches = 0;
+	uint32_t round;
+
+	TEST_CHECK(ltr390_ring_init(&ring, storage, 0, LTR390_RING_DROP_NEWEST) == LTR390_E_INVALID_LEN);
+	TEST_CHECK(ltr390_ring_init(&ring, storage, 6, LTR390_RING_DROP_NEWEST) == LTR390_E_INVALID_LEN);
+	TEST_CHECK(ltr390_ring_init(&ring, storage, TEST_RING_CAP, LTR390_RING_DROP_OLDEST + 1) == LTR390_E_INVALID_VAL);
+
+	/* Every field value survives packing */
+	memset(&in, 0, sizeof(in));
+	for (in.mode = 0; in.mode <= LTR390_VAL_UVS_MODE_UVS; in.mode++)
+		for (in.gain_range = 0; in.gain_range <= LTR390_VAL_GAIN_RANGE_18; in.gain_range++)
+			for (in.resolution = 0; in.resolution <= LTR390_VAL_RES_13_BIT; in.resolution++)
+				for (in.flags = 0; in.flags < 16; in.flags++) {
+					in.raw = (in.flags & 1) ? 0xFFFFF : (uint32_t)in.flags * 4099;
+					ltr390_ring_pack(&rec, &in, 0xFFFFFFFF);
+					ltr390_ring_unpack(&out, &rec);
+					if ((memcmp(&in, &out, sizeof(in)) != 0) || (rec.time_us != 0xFFFFFFFF))
+						mismatches++;
+				}
+	TEST_CHECK(mismatches == 0);
+
+	/* Wrap-around of the slots and of the free running indexes, batch pops */
+	TEST_CHECK(ltr390_ring_init(&ring, storage, TEST_RING_CAP, LTR390_RING_DROP_NEWEST) == LTR390_OK);
+	atomic_store(&ring.head, UINT32_MAX - 10);
+	atomic_store(&ring.tail, UINT32_MAX - 10);
+	for (round = 0; round < 10; round++) {
+		test_ring_fill(&ring, 5 * round, 5, &overflowed);
+		TEST_CHECK(ltr390_ring_count(&ring) == 5);
+		TEST_CHECK(test_ring_drain(&ring, 5 * round, 3) == 3);
+		TEST_CHECK(test_ring_drain(&ring, 5 * round + 3, TEST_RING_CAP) == 2);
+	}
+	TEST_CHECK(ltr390_ring_count(&ring) == 0);
+	TEST_CHECK(overflowed == 0);
+
+	/* Full, drop newest: the stored records are untouched */
+	test_ring_fill(&ring, 0, TEST_RING_CAP + 3, &overflowed);
+	TEST_CHECK(overflowed == 3);
+	TEST_CHECK(ltr390_ring_overflows(&ring) == 3);
+	TEST_CHECK(test_ring_drain(&ring, 0, TEST_RING_CAP) == TEST_RING_CAP);
+
+	/* Full, drop oldest: the newest capacity records are kept */
+	overflowed = 0;
+	TEST_CHECK(ltr390_ring_init(&ring, storage, TEST_RING_CAP, LTR390_RING_DROP_OLDEST) == LTR390_OK);
+	test_ring_fill(&ring, 0, TEST_RING_CAP + 12, &overflowed);
+	TEST_CHECK(overflowed == 12);
+	TEST_CHECK(ltr390_ring_overflows(&ring) == 12);
+	TEST_CHECK(ltr390_ring_count(&ring) == TEST_RING_CAP);
+	TEST_CHECK(test_ring_drain(&ring, 12, TEST_RING_CAP) == TEST_RING_CAP);
+}
+
+static int test_cmp_u32(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *)a;
+	uint32_t y = *(const uint32_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+static uint32_t test_filter_ref(const uint32_t *in, uint32_t index, uint8_t type, uint8_t window)
+{
+	uint32_t sorted[LTR390_FILTER_MAX_WINDOW];
+	uint32_t count = (index + 1 < window) ? index + 1 : window;
+	uint32_t sum = 0;
+	uint32_t i;
+
+	/* Brute force over the last window samples */
+	for (i = 0; i < count; i++) {
+		sorted[i] = in[index + 1 - count + i];
+		sum += sorted[i];
+	}
+	if (type == LTR390_FILTER_AVG)
+		return (sum + count / 2) / count;
+
+	qsort(sorted, count, sizeof(sorted[0]), test_cmp_u32);
+
+	return (sorted[(count - 1) / 2] + sorted[count / 2]) / 2;
+}
+
+static void test_filter(void)
+{
+	static const uint8_t windows[] = {1, 4, 7, LTR390_FILTER_MAX_WINDOW};
+	static uint32_t in[TEST_FILTER_SAMPLES];
+	struct ltr390_filter filter;
+	struct ltr390_sample sample;
+	struct ltr390_sample out;
+	uint32_t mismatches = 0;
+	uint32_t seed = 0xC0FFEE;
+	double decay;
+	uint32_t i;
+	uint8_t type;
+	uint8_t w;
+
+	memset(&sample, 0, sizeof(sample));
+	sample.gain_range = LTR390_VAL_GAIN_RANGE_3;
+	sample.resolution = LTR390_VAL_RES_18_BIT;
+	sample.flags = LTR390_SAMPLE_FRESH;
+	for (i = 0; i < TEST_FILTER_SAMPLES; i++) {
+		seed = seed * 1664525 + 1013904223;
+		in[i] = seed >> 12;
+	}
+
+	ltr390_filter_init(&filter);
+	TEST_CHECK(ltr390_filter_add_avg(&filter, 0) == LTR390_E_INVALID_LEN);
+	TEST_CHECK(ltr390_filter_add_median(&filter, LTR390_FILTER_MAX_WINDOW + 1) == LTR390_E_INVALID_LEN);
+	for (i = 0; i < LTR390_FILTER_MAX_STAGES; i++)
+		TEST_CHECK(ltr390_filter_add_ema(&filter, 1) == LTR390_OK);
+	TEST_CHECK(ltr390_filter_add_ema(&filter, 1) == LTR390_E_INVALID_LEN);
+
+	/* AVG and MEDIAN against the brute force reference, odd and even windows */
+	for (type = LTR390_FILTER_AVG; type <= LTR390_FILTER_MEDIAN; type++) {
+		for (w = 0; w < sizeof(windows); w++) {
+			ltr390_filter_init(&filter);
+			if (type == LTR390_FILTER_AVG)
+				TEST_CHECK(ltr390_filter_add_avg(&filter, windows[w]) == LTR390_OK);
+			else
+				TEST_CHECK(ltr390_filter_add_median(&filter, windows[w]) == LTR390_OK);
+			for (i = 0; i < TEST_FILTER_SAMPLES; i++) {
+				sample.raw = in[i];
+				if ((ltr390_filter_apply(&filter, &sample, &out) != LTR390_OK) ||
+					(out.raw != test_filter_ref(in, i, type, windows[w])))
+					mismatches++;
+			}
+		}
+	}
+	TEST_CHECK(mismatches == 0);
+
+	/* EMA, alpha 1/4: step response within a count of 1000 (1 - 0.75^k) */
+	ltr390_filter_init(&filter);
+	TEST_CHECK(ltr390_filter_add_ema(&filter, 2) == LTR390_OK);
+	sample.raw = 0;
+	TEST_CHECK(ltr390_filter_apply(&filter, &sample, &out) == LTR390_OK);
+	TEST_CHECK(out.raw == 0);
+	sample.raw = 1000;
+	mismatches = 0;
+	decay = 1.;
+	for (i = 1; i <= 40; i++) {
+		decay *= 0.75;
+		(void)ltr390_filter_apply(&filter, &sample, &out);
+		if (!test_near((double)out.raw, 1000. * (1. - decay), 1.))
+			mismatches++;
+	}
+	TEST_CHECK(mismatches == 0);
+	TEST_CHECK(out.raw == 1000);
+
+	/* SPIKE, 20% for at most 2 samples: a glitch is held, a step gets through */
+	ltr390_filter_init(&filter);
+	TEST_CHECK(ltr390_filter_add_spike(&filter, 20, 2) == LTR390_OK);
+	sample.raw = 1000;
+	TEST_CHECK((ltr390_filter_apply(&filter, &sample, &out) == LTR390_OK) && (out.raw == 1000));
+	sample.raw = 5000;
+	TEST_CHECK((ltr390_filter_apply(&filter, &sample, &out) == LTR390_OK) && (out.raw == 1000));
+	sample.raw = 1100;
+	TEST_CHECK((ltr390_filter_apply(&filter, &sample, &out) == LTR390_OK) && (out.raw == 1100));
+	sample.raw = 3000;
+	TEST_CHECK((ltr390_filter_apply(&filter, &sample, &out) == LTR390_OK) && (out.raw == 1100));
+	TEST_CHECK((ltr390_filter_apply(&filter, &sample, &out) == LTR390_OK) && (out.raw == 1100));
+	TEST_CHECK((ltr390_filter_apply(&filter, &sample, &out) == LTR390_OK) && (out.raw == 3000));
+	TEST_CHECK(filter.rejected == 3);
+
+	/* Stale samples rejected, a new gain or resolution starts over */
+	ltr390_filter_init(&filter);
+	TEST_CHECK(ltr390_filter_add_avg(&filter, 4) == LTR390_OK);
+	sample.raw = 1000;
+	TEST_CHECK(ltr390_filter_apply(&filter, &sample, &out) == LTR390_OK);
+	sample.raw = 9000;
+	sample.flags = 0;
+	TEST_CHECK(ltr390_filter_apply(&filter, &sample, &out) == LTR390_W_NO_NEW_DATA);
+	sample.flags = LTR390_SAMPLE_FRESH;
+	sample.raw = 2000;
+	TEST_CHECK((ltr390_filter_apply(&filter, &sample, &out) == LTR390_OK) && (out.raw == 1500));
+	sample.gain_range = LTR390_VAL_GAIN_RANGE_9;
+	sample.raw = 6000;
+	TEST_CHECK((ltr390_filter_apply(&filter, &sample, &out) == LTR390_OK) && (out.raw == 6000));
+	TEST_CHECK(filter.resets == 1);
+	sample.resolution = LTR390_VAL_RES_16_BIT;
+	sample.raw = 700;
+	TEST_CHECK((ltr390_filter_apply(&filter, &sample, &out) == LTR390_OK) && (out.raw == 700));
+	TEST_CHECK(out.resolution == LTR390_VAL_RES_16_BIT);
+	TEST_CHECK(filter.resets == 2);
+}
+
+static uint64_t test_sched_now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+static int8_t test_sched_read(uint8_t dev_id, uint8_t reg_addr, uint8_t *data, uint16_t len)
+{
+	int8_t rslt;
+
+	pthread_mutex_lock(&test_sched_lock);
+	ltr390_emu_set_time(test_sched_now_us() - test_sched_base_us);
+	rslt = ltr390_emu_read(dev_id, reg_addr, data, len);
+	pthread_mutex_unlock(&test_sched_lock);
+
+	return rslt;
+}
+
+static int8_t test_sched_write(uint8_t dev_id, uint8_t reg_addr, uint8_t *data, uint16_t len)
+{
+	int8_t rslt;
+
+	pthread_mutex_lock(&test_sched_lock);
+	ltr390_emu_set_time(test_sched_now_us() - test_sched_base_us);
+	rslt = ltr390_emu_write(dev_id, reg_addr, data, len);
+	pthread_mutex_unlock(&test_sched_lock);
+
+	return rslt;
+}
+
+static void test_sched_cb(struct ltr390_dev *dev, const struct ltr390_sample *sample, void *ctx)
+{
+	uint32_t *delivered = (uint32_t *)ctx;
+
+	/* Each sensor is only ever read from its own bus worker */
+	if ((sample->flags & LTR390_SAMPLE_FRESH) != 0)
+		delivered[dev->dev_id - TEST_DEV_ID]++;
+}
+
+static void test_sched(void)
+{
+	static struct ltr390_emu emu[TEST_SCHED_DEV];
+	static struct ltr390_dev dev[TEST_SCHED_DEV];
+	struct ltr390_sched sched;
+	struct ltr390_sched_bus_stats bus_stats;
+	struct ltr390_sched_dev_stats dev_stats;
+	struct ltr390_sample sample;
+	uint32_t delivered[TEST_SCHED_DEV] = {0};
+	uint32_t period_us;
+	uint64_t start_us;
+	uint64_t elapsed_us;
+	double expected;
+	uint8_t i;
+
+	/* Sensors on the emulator clock, which follows real time from here */
+	test_setup(&emu[0], &dev[0], LTR390_VAL_UVS_MODE_ALS, LTR390_VAL_RES_16_BIT);
+	dev[0].settings.rate = LTR390_VAL_MEAS_RATE_50_MS;
+	dev[0].read = test_sched_read;
+	dev[0].write = test_sched_write;
+	dev[0].delay_us = NULL;
+	dev[0].get_time_us = NULL;
+	test_sched_base_us = test_sched_now_us();
+	for (i = 1; i < TEST_SCHED_DEV; i++) {
+		dev[i] = dev[0];
+		dev[i].dev_id = (uint8_t)(TEST_DEV_ID + i);
+		TEST_CHECK(ltr390_emu_attach(&emu[i], dev[i].dev_id) == LTR390_OK);
+		ltr390_emu_set_input(&emu[i], TEST_LUX, TEST_UVI);
+	}
+	period_us = ltr390_meas_period_us(dev[0].settings.rate, dev[0].settings.resolution);
+	TEST_CHECK(period_us == 50000);
+
+	TEST_CHECK(ltr390_sched_init(&sched, test_sched_cb, delivered) == LTR390_OK);
+	for (i = 0; i < TEST_SCHED_DEV; i++) {
+		TEST_CHECK(ltr390_configure(&dev[i]) == LTR390_OK);
+		TEST_CHECK(ltr390_sched_add(&sched, &dev[i], (uint8_t)(i % 2)) == LTR390_OK);
+	}
+	TEST_CHECK(ltr390_sched_add(&sched, &dev[0], LTR390_SCHED_MAX_BUS) == LTR390_E_INVALID_VAL);
+
+	/* Start right after the first conversions, so an early read finds no data */
+	for (i = 0; i < TEST_SCHED_DEV; i++) {
+		while (ltr390_get_new_data(&sample, &dev[i]) == LTR390_W_NO_NEW_DATA)
+			usleep(100);
+	}
+	start_us = test_sched_now_us();
+	TEST_CHECK(ltr390_sched_start(&sched) == LTR390_OK);
+	usleep(TEST_SCHED_RUN_US);
+	TEST_CHECK(ltr390_sched_stop(&sched) == LTR390_OK);
+	elapsed_us = test_sched_now_us() - start_us;
+	TEST_CHECK((sched.buses[0].started == FALSE) && (sched.buses[1].started == FALSE));
+
+	/* First read one period after start, then one per period, never early */
+	expected = (double)elapsed_us / (double)period_us - 1.;
+	for (i = 0; i < TEST_SCHED_DEV; i++) {
+		TEST_CHECK(ltr390_sched_get_dev_stats(&sched, &dev[i], &dev_stats) == LTR390_OK);
+		TEST_CHECK(dev_stats.stale == 0);
+		TEST_CHECK(dev_stats.errors == 0);
+		TEST_CHECK(test_near((double)dev_stats.samples, expected, 2.) == TRUE);
+		TEST_CHECK(delivered[i] == dev_stats.samples);
+	}
+	for (i = 0; i < 2; i++) {
+		TEST_CHECK(ltr390_sched_get_bus_stats(&sched, i, &bus_stats) == LTR390_OK);
+		TEST_CHECK(test_near(bus_stats.samples_per_s, 2e6 / (double)period_us, 4.) == TRUE);
+	}
+
+	/* Stopped workers stay stopped */
+	TEST_CHECK(ltr390_sched_stop(&sched) == LTR390_OK);
+	TEST_CHECK(ltr390_sched_get_dev_stats(&sched, &dev[0], &dev_stats) == LTR390_OK);
+	usleep(2 * period_us);
+	TEST_CHECK(delivered[0] == dev_stats.samples);
+	ltr390_sched_deinit(&sched);
+
+	for (i = 0; i < TEST_SCHED_DEV; i++)
+		ltr390_emu_detach(&emu[i]);
+}